@@ -39,6 +39,8 @@ function shaders()
 	glslangValidator -V ./shaders/basic.frag.glsl -o ./shaders/Fbasic.spv
 	glslangValidator -V ./shaders/sampler2D.frag.glsl -o ./shaders/Fsampler2D.spv
 	glslangValidator -V ./shaders/lightning.frag.glsl -o ./shaders/Flightning.spv
+	glslangValidator -V ./shaders/instanced.vert.glsl -o ./shaders/Vinstanced.spv
+	glslangValidator -V ./shaders/pulled.vert.glsl -o ./shaders/Vpulled.spv
 }
 
 function hexshaders()
@@ -48,6 +50,8 @@ function hexshaders()
 	glslangValidator -V ./shaders/basic.frag.glsl -o ./shaders/Fbasic.h --vn Fbasic
 	glslangValidator -V ./shaders/sampler2D.frag.glsl -o ./shaders/Fsampler2D.h --vn Fsampler2D
 	glslangValidator -V ./shaders/lightning.frag.glsl -o ./shaders/Flightning.h --vn Flightning
+	glslangValidator -V ./shaders/instanced.vert.glsl -o ./shaders/Vinstanced.h --vn Vinstanced
+	glslangValidator -V ./shaders/pulled.vert.glsl -o ./shaders/Vpulled.h --vn Vpulled
 }
 
 function cross()
@@ -55,11 +59,11 @@ function cross()
 	if [ "$1" == "1" ]
 	then
 		hexshaders
-		$CC win32_tinyengine.c -luser32 -I./shaders -DHEX_SHADERS -o ../build/tinyengine.exe
+		$CC win32_tinyengine.c -luser32 -lwinmm -I./shaders -DHEX_SHADERS -o ../build/tinyengine.exe
 		exit 0
 	fi
 	shaders
-	$CC win32_tinyengine.c -luser32 -o ../build/tinyengine.exe
+	$CC win32_tinyengine.c -luser32 -lwinmm -o ../build/tinyengine.exe
 	exit 0
 }
 
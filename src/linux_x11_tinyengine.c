@@ -99,6 +99,7 @@ void LogSetfp(FILE *Fp);
 #endif
 
 #include "tiny_vulkan.h"
+#include "tiny_jobs.h"
 
 static const char *level_names[] =
 {
@@ -260,6 +261,18 @@ u8 *Tiny_ReadFile(const char *Filename, s32 *Size)
 	return Buffer;
 }
 
+b32 Tiny_WriteFile(const char *Filename, void *Data, u64 Size)
+{
+	FILE* File = fopen(Filename, "wb");
+	if(!File)
+	{
+		return false;
+	}
+	u64 rc = fwrite(Data, 1, Size, File);
+	fclose(File);
+	return rc == Size;
+}
+
 void* Tiny_Malloc(u64 Size)
 {
 	Size += sizeof(u64);
@@ -286,6 +299,71 @@ f64 Tiny_GetTime()
 	return (f64)(Tiny_GetTimerValue()-TimerOffset) / 1000000;
 }
 
+void Tiny_Sleep(f64 Seconds)
+{
+	if(Seconds <= 0)
+	{
+		return;
+	}
+	struct timespec Ts;
+	Ts.tv_sec = (time_t)Seconds;
+	Ts.tv_nsec = (long)((Seconds - (f64)Ts.tv_sec) * 1e9);
+	while(nanosleep(&Ts, &Ts) == -1){/*interrupted, sleep the rest*/};
+}
+
+void Tiny_Lock(volatile s32 *Lock)
+{
+	while(__sync_lock_test_and_set(Lock, 1))
+	{
+		while(*Lock){/*spin on the cached line*/};
+	}
+}
+
+void Tiny_Unlock(volatile s32 *Lock)
+{
+	__sync_lock_release(Lock);
+}
+
+u64 Tiny_GetThreadId()
+{
+	return (u64)pthread_self();
+}
+
+u32 Tiny_GetCoreCount()
+{
+	long Cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return Cores > 0 ? (u32)Cores : 1;
+}
+
+typedef struct thread_start_t
+{
+	void (*Func)(void *Data);
+	void *Data;
+} thread_start_t;
+
+void *ThreadTrampoline(void *Start)
+{
+	thread_start_t Copy = *(thread_start_t*)Start;
+	Tiny_Free(Start);
+	Copy.Func(Copy.Data);
+	return NULL;
+}
+
+b32 Tiny_CreateThread(void (*Func)(void *Data), void *Data)
+{
+	thread_start_t *Start = (thread_start_t*) Tiny_Malloc(sizeof(thread_start_t));
+	Start->Func = Func;
+	Start->Data = Data;
+	pthread_t Thread;
+	if(pthread_create(&Thread, NULL, &ThreadTrampoline, Start))
+	{
+		Tiny_Free(Start);
+		return false;
+	}
+	pthread_detach(Thread);
+	return true;
+}
+
 void *EventThread()
 {
 
@@ -373,6 +451,12 @@ void *EventThread()
 				break;
 			case ConfigureNotify: ;
 				DbgEvent("ConfigureNotify");
+				if((u32)Event.xconfigure.width != Wnd.Width || (u32)Event.xconfigure.height != Wnd.Height)
+				{
+					Wnd.Width = Event.xconfigure.width;
+					Wnd.Height = Event.xconfigure.height;
+					VkRequestSwapchainRebuild();
+				}
 				break;
 			case ConfigureRequest: ;
 				DbgEvent("ConfigureRequest");
@@ -388,11 +472,44 @@ void *EventThread()
 	return NULL;
 }
 
+#ifdef TINYENGINE_DEBUG
+//Resizes the window and keeps presenting past the debounce, so every resize
+//gets its own swapchain rebuild, then logs the rebuild stats.
+void ResizeStress(u32 Resizes)
+{
+	ASSERT(!FrameRecording, "ResizeStress: called inside a frame");
+	u32 Width = Wnd.Width;
+	u32 Height = Wnd.Height;
+	u32 Rebuilds = SwapchainRebuilds;
+	u32 Stalled = StalledFrames;
+	RebuildTimeMax = 0;
+
+	for(u32 i = 0; i < Resizes; i++)
+	{
+		XResizeWindow(Wnd.Display, Wnd.Window, 400 + i % 7 * 50, 300 + i % 5 * 50);
+		XFlush(Wnd.Display);
+		f64 Begin = Tiny_GetTime();
+		while(Tiny_GetTime() - Begin < ResizeDebounceTime * 2)
+		{
+			VkBeginRendering();
+			VkEndRendering();
+		}
+	}
+	XResizeWindow(Wnd.Display, Wnd.Window, Width, Height);
+	XFlush(Wnd.Display);
+
+	Info("Resize stress: %d resizes, %d swapchain rebuilds, %d stalled frames, worst rebuild %.2f ms",
+			Resizes, SwapchainRebuilds - Rebuilds, StalledFrames - Stalled, RebuildTimeMax * 1000);
+}
+#endif
+
 int main(int argc, char** argv)
 {
 	FILE* File = fopen("./log.txt","w");
 	LogSetfp(File);
 
+	//Before any other Xlib call, the event thread shares the display.
+	XInitThreads();
 	Wnd.Display = XOpenDisplay(getenv("DISPLAY"));
 	if (Wnd.Display == NULL)
 	{
@@ -423,7 +540,6 @@ int main(int argc, char** argv)
 			ButtonPress | ButtonRelease);
 
 	XMapWindow(Wnd.Display, Wnd.Window);
-	XInitThreads();
 
 	// Set window title
 	XStoreName(Wnd.Display, Wnd.Window, "TinyEngine");
@@ -443,6 +559,10 @@ int main(int argc, char** argv)
 
 	void* VulkanLoader = dlopen("libvulkan.so.1", RTLD_NOW | RTLD_DEEPBIND);
 	PFN_vkGetInstanceProcAddr ProcAddr = dlsym(VulkanLoader, "vkGetInstanceProcAddr");
+	//Kiosk builds want low latency, default is strict vsync.
+	//VkSetPresentModes(ArrayCount(VkLowLatencyPresentModes), VkLowLatencyPresentModes);
+	//O(1) allocations for the entity vertex zone instead of the first fit rover.
+	//ZSetZoneMode(1, ZONE_TLSF);
 	if(!InitVulkan(&ProcAddr, ArrayCount(RequiredExtensions), RequiredExtensions))
 	{
 		Fatal("Failed to initialize vulkan runtime!");
@@ -451,6 +571,26 @@ int main(int argc, char** argv)
 
 
 	TimerOffset = Tiny_GetTimerValue();
+	//Cap to 60 fps and keep at most one frame queued on the gpu.
+	//VkSetFramePacing(60, 1);
+	//Record draw slices on worker threads with VkBeginThreadRecording + VkCmdDraw*.
+	//VkSetRecordThreads(4);
+	//JobScalingBenchmark();
+	//ZoneBenchmark();
+	//HostAllocatorStress();
+	//Simulation and rendering on separate cores, VkDraw* only writes packets then.
+	//VkStartRenderThread();
+	//Bind every pipeline once per frame, opaque draws get ordered by depth test.
+	//VkSetDrawSorting(true);
+	//VkSetDrawIndirect(true);
+	//DrawIndirectBenchmark();
+	//DrawSortBenchmark();
+	//Swapchain rebuild stats under a burst of window resizes.
+	//ResizeStress(50);
+	//No vertex buffer binds, pairs well with indirect draws.
+	//VkSetVertexPulling(true);
+	//Half float positions, 12 byte vertices instead of 36.
+	//VkSetEntityFormat(&EntIds[1], VERTEX_PACKED_2D);
 
 	while (Sym != XK_Escape)
 	{
@@ -543,12 +683,17 @@ int main(int argc, char** argv)
 		Vertices[3].UVs[1] = 1.0f;
 
 		//VkDrawTextured(ArrayCount(Vertices), &Vertices[0], ArrayCount(indeces), &indeces[0], 1, &EntIds[1]);
+		//One textured draw for the whole row, VkFlushSprites runs at VkEndRendering.
+		//for(u32 s = 0; s < 16; s++) VkDrawSprite(-1.0f + s * 0.125f, 0.8f, 0.1f, 0.1f, NULL, NULL, NULL, true);
 
 		VkDrawLightnings(ArrayCount(Vertices), &Vertices[0], ArrayCount(indeces), &indeces[0], &EntIds[4]);
 
 		VkEndRendering();
 	}
 	p("Exit");
+	//Block map of the entity vertex zone, aging entity blocks are leaks.
+	//ZDumpZone(1, "zone1.txt");
+	VkStopRenderThread();
 	DeInitVulkan();
 	dlclose(VulkanLoader);
 	XCloseDisplay(Wnd.Display);
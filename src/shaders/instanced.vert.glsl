@@ -0,0 +1,22 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec4 inColor;
+
+//per instance, see instance_t
+layout(location = 3) in vec4 inTransform; //2x2 columns
+layout(location = 4) in vec2 inOffset;
+layout(location = 5) in vec4 inTint;
+layout(location = 6) in vec4 inUVRect; //xy offset, zw scale
+
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec4 fragColor;
+
+void main()
+{    
+    mat2 Transform = mat2(inTransform.xy, inTransform.zw);
+    gl_Position = vec4(Transform * inPosition.xy + inOffset, inPosition.z, 1.0);
+    fragColor = inColor * inTint;
+    fragTexCoord = inUVRect.xy + inTexCoord * inUVRect.zw;
+}
@@ -2,7 +2,7 @@
 #version 450
 layout(location = 0) out vec4 fragColor;
 
-layout(set = 0, binding = 0) uniform UniformBufferObject 
+layout(push_constant) uniform PushConstants 
 {
     vec2 Resolution;
     float Time;
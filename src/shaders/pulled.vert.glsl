@@ -0,0 +1,31 @@
+#version 450
+
+//Vertex pulling, no vertex bindings. vertex_t is fetched as 9 floats from
+//the zone vertex buffer or the frame ring, gl_VertexIndex already holds
+//the entity's whole vertices. firstInstance carries the rest: bit 4 picks
+//the ring, the low bits are the float remainder of the entity offset.
+layout(std430, set = 3, binding = 0) readonly buffer ZoneVertices
+{
+    float Data[];
+} zone;
+
+layout(std430, set = 3, binding = 1) readonly buffer RingVertices
+{
+    float Data[];
+} ring;
+
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec4 fragColor;
+
+float fetch(int word)
+{
+    return (gl_InstanceIndex & 16) != 0 ? ring.Data[word] : zone.Data[word];
+}
+
+void main()
+{
+    int base = gl_VertexIndex * 9 + (gl_InstanceIndex & 15);
+    gl_Position = vec4(fetch(base + 0), fetch(base + 1), fetch(base + 2), 1.0);
+    fragTexCoord = vec2(fetch(base + 3), fetch(base + 4));
+    fragColor = vec4(fetch(base + 5), fetch(base + 6), fetch(base + 7), fetch(base + 8));
+}
@@ -0,0 +1,262 @@
+#ifndef TINY_JOBS_H
+#define TINY_JOBS_H
+
+//NOTE(Kyryl): Work stealing job system. Thread 0 is whoever called
+//Tiny_InitJobs, 1..N are workers. Every thread owns a Chase-Lev deque,
+//pushes and pops its own jobs at the bottom and steals from the top of
+//the others when it runs dry. ThreadIndex is handed to every job so it
+//can pick per thread resources, e.g. VkBeginThreadRecording(ThreadIndex).
+//Only needs Tiny_CreateThread from the platform and gcc __atomic builtins,
+//workers give their host allocator slot back when tiny_vulkan.h is in.
+
+#define NUM_JOB_THREADS 32
+#define NUM_DEQUE_JOBS 1024 //must be ^2
+#define JOB_IDLE_SPINS 1000 //failed steals before a worker naps
+
+typedef struct job_deque_t
+{
+	volatile s64 Top;
+	u8 TopPad[56]; //thieves and owner on separate lines
+	volatile s64 Bottom;
+	u8 BottomPad[56];
+	tiny_job_t Jobs[NUM_DEQUE_JOBS];
+} job_deque_t;
+
+job_deque_t JobDeques[NUM_JOB_THREADS];
+u32 JobThreadCount; //workers + thread 0, 0 when not initialized
+volatile s32 JobsRunning;
+volatile s32 LiveWorkers;
+
+//Owner only.
+void DequePush(job_deque_t *Deque, tiny_job_t *Job)
+{
+	s64 Bottom = __atomic_load_n(&Deque->Bottom, __ATOMIC_RELAXED);
+	s64 Top = __atomic_load_n(&Deque->Top, __ATOMIC_ACQUIRE);
+	ASSERT(Bottom - Top < NUM_DEQUE_JOBS, "Job deque full, increase NUM_DEQUE_JOBS");
+	Deque->Jobs[Bottom & (NUM_DEQUE_JOBS-1)] = *Job;
+	__atomic_store_n(&Deque->Bottom, Bottom + 1, __ATOMIC_RELEASE);
+}
+
+//Owner only.
+b32 DequePop(job_deque_t *Deque, tiny_job_t *Job)
+{
+	s64 Bottom = __atomic_load_n(&Deque->Bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&Deque->Bottom, Bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	s64 Top = __atomic_load_n(&Deque->Top, __ATOMIC_RELAXED);
+
+	if(Top > Bottom)
+	{
+		//Empty.
+		__atomic_store_n(&Deque->Bottom, Bottom + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	*Job = Deque->Jobs[Bottom & (NUM_DEQUE_JOBS-1)];
+	if(Top != Bottom)
+	{
+		return true;
+	}
+
+	//Last job, race the thieves for it.
+	b32 Won = __atomic_compare_exchange_n(&Deque->Top, &Top, Top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	__atomic_store_n(&Deque->Bottom, Bottom + 1, __ATOMIC_RELAXED);
+	return Won;
+}
+
+//Any thread.
+b32 DequeSteal(job_deque_t *Deque, tiny_job_t *Job)
+{
+	s64 Top = __atomic_load_n(&Deque->Top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	s64 Bottom = __atomic_load_n(&Deque->Bottom, __ATOMIC_ACQUIRE);
+
+	if(Top >= Bottom)
+	{
+		return false;
+	}
+
+	*Job = Deque->Jobs[Top & (NUM_DEQUE_JOBS-1)];
+	return __atomic_compare_exchange_n(&Deque->Top, &Top, Top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+b32 RunOneJob(u32 ThreadIndex)
+{
+	tiny_job_t Job;
+	b32 Found = DequePop(&JobDeques[ThreadIndex], &Job);
+
+	//Start after ourselves so thieves spread out.
+	for(u32 i = 1; !Found && i < JobThreadCount; i++)
+	{
+		Found = DequeSteal(&JobDeques[(ThreadIndex + i) % JobThreadCount], &Job);
+	}
+
+	if(!Found)
+	{
+		return false;
+	}
+
+	Job.Func(Job.Data, ThreadIndex);
+	if(Job.Counter)
+	{
+		__atomic_sub_fetch(&Job.Counter->Value, 1, __ATOMIC_ACQ_REL);
+	}
+	return true;
+}
+
+void JobWorker(void *Data)
+{
+	u32 ThreadIndex = (u32)(uintptr_t)Data;
+	u32 Idle = 0;
+	while(__atomic_load_n(&JobsRunning, __ATOMIC_ACQUIRE))
+	{
+		if(RunOneJob(ThreadIndex))
+		{
+			Idle = 0;
+		}
+		else if(++Idle > JOB_IDLE_SPINS)
+		{
+			Tiny_Sleep(0.0002);
+		}
+	}
+#ifdef TINY_VULKAN_H
+	VkHostThreadExit();
+#endif
+	__atomic_sub_fetch(&LiveWorkers, 1, __ATOMIC_RELEASE);
+}
+
+//WorkerCount = 0 takes one worker per core besides the calling thread.
+void Tiny_InitJobs(u32 WorkerCount)
+{
+	ASSERT(!JobThreadCount, "Tiny_InitJobs: already running");
+	if(!WorkerCount)
+	{
+		u32 Cores = Tiny_GetCoreCount();
+		WorkerCount = Cores > 1 ? Cores - 1 : 0;
+	}
+	WorkerCount = Min(WorkerCount, NUM_JOB_THREADS - 1);
+
+	for(u32 i = 0; i <= WorkerCount; i++)
+	{
+		JobDeques[i].Top = 0;
+		JobDeques[i].Bottom = 0;
+	}
+
+	JobThreadCount = WorkerCount + 1;
+	JobsRunning = true;
+	LiveWorkers = WorkerCount;
+	for(u32 i = 1; i <= WorkerCount; i++)
+	{
+		ASSERT(Tiny_CreateThread(&JobWorker, (void*)(uintptr_t)i), "Tiny_InitJobs: failed to start worker %d", i);
+	}
+	Info("Job system: %d workers", WorkerCount);
+}
+
+//Pending jobs are dropped, wait on their counters first.
+void Tiny_DeInitJobs()
+{
+	__atomic_store_n(&JobsRunning, false, __ATOMIC_RELEASE);
+	while(__atomic_load_n(&LiveWorkers, __ATOMIC_ACQUIRE)){/*spin*/};
+	JobThreadCount = 0;
+}
+
+u32 Tiny_GetJobThreadCount()
+{
+	return Max(JobThreadCount, 1);
+}
+
+//Counter is raised by Count and drops to 0 once all jobs ran.
+void Tiny_RunJobs(u32 ThreadIndex, tiny_job_t *Jobs, u32 Count, tiny_counter_t *Counter)
+{
+	u32 i;
+	if(!JobThreadCount)
+	{
+		for(i = 0; i < Count; i++)
+		{
+			Jobs[i].Func(Jobs[i].Data, 0);
+		}
+		return;
+	}
+
+	__atomic_add_fetch(&Counter->Value, Count, __ATOMIC_RELEASE);
+	for(i = 0; i < Count; i++)
+	{
+		Jobs[i].Counter = Counter;
+		DequePush(&JobDeques[ThreadIndex], &Jobs[i]);
+	}
+}
+
+//NOTE(Kyryl): Runs other jobs while waiting, so jobs may wait on
+//jobs they spawned without starving the pool.
+void Tiny_WaitForCounter(u32 ThreadIndex, tiny_counter_t *Counter)
+{
+	while(__atomic_load_n(&Counter->Value, __ATOMIC_ACQUIRE) > 0)
+	{
+		RunOneJob(ThreadIndex);
+	}
+}
+
+#ifdef TINYENGINE_DEBUG
+#define BENCH_JOB_COUNT 1000 //fits one deque
+
+void BenchJob(void *Data, u32 ThreadIndex)
+{
+	f32 *Out = (f32*)Data;
+	f32 X = *Out;
+	for(u32 i = 0; i < 20000; i++)
+	{
+		X = X * 0.999f + 0.5f;
+	}
+	*Out = X;
+}
+
+//Same workload on 1..cores threads, logs time and speedup.
+void JobScalingBenchmark()
+{
+	static tiny_job_t Jobs[BENCH_JOB_COUNT];
+	static f32 Results[BENCH_JOB_COUNT];
+	u32 Cores = Min(Tiny_GetCoreCount(), NUM_JOB_THREADS);
+	f64 SingleTime = 0;
+
+	for(u32 Threads = 1; Threads <= Cores; Threads++)
+	{
+		if(Threads > 1)
+		{
+			Tiny_InitJobs(Threads - 1);
+		}
+		else
+		{
+			//Tiny_InitJobs(0) means all cores, run thread 0 alone instead.
+			JobDeques[0].Top = 0;
+			JobDeques[0].Bottom = 0;
+			JobThreadCount = 1;
+		}
+
+		for(u32 i = 0; i < BENCH_JOB_COUNT; i++)
+		{
+			Results[i] = (f32)i;
+			Jobs[i].Func = &BenchJob;
+			Jobs[i].Data = &Results[i];
+		}
+
+		tiny_counter_t Counter = {0};
+		f64 Begin = Tiny_GetTime();
+		Tiny_RunJobs(0, Jobs, BENCH_JOB_COUNT, &Counter);
+		Tiny_WaitForCounter(0, &Counter);
+		f64 Time = Tiny_GetTime() - Begin;
+
+		if(Threads > 1)
+		{
+			Tiny_DeInitJobs();
+		}
+		else
+		{
+			SingleTime = Time;
+			JobThreadCount = 0;
+		}
+		Info("Jobs: %d threads %.2f ms, x%.2f", Threads, Time * 1000, SingleTime / Time);
+	}
+}
+#endif
+
+#endif // TINY_JOBS_H
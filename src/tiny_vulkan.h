@@ -39,6 +39,7 @@ INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetPhysicalDeviceSurfaceCapabil
 INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetPhysicalDeviceSurfaceFormatsKHR, VK_KHR_SURFACE_EXTENSION_NAME )
 INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetPhysicalDeviceSurfacePresentModesKHR, VK_KHR_SURFACE_EXTENSION_NAME )
 INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkDestroySurfaceKHR, VK_KHR_SURFACE_EXTENSION_NAME )
+INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetPhysicalDeviceFeatures2KHR, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME )
 
 #ifdef VK_USE_PLATFORM_WIN32_KHR
 INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkCreateWin32SurfaceKHR, VK_KHR_WIN32_SURFACE_EXTENSION_NAME )
@@ -91,6 +92,7 @@ DEVICE_LEVEL_VULKAN_FUNCTION( vkCreateSemaphore )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCreateFence )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkWaitForFences )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkResetFences )
+DEVICE_LEVEL_VULKAN_FUNCTION( vkGetFenceStatus )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkDestroyFence )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkDestroySemaphore )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkResetCommandBuffer )
@@ -137,6 +139,7 @@ DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdSetScissor )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdBindVertexBuffers )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdDraw )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdDrawIndexed )
+DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdDrawIndexedIndirect )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdDispatch )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdCopyImage )
 DEVICE_LEVEL_VULKAN_FUNCTION( vkCmdPushConstants )
@@ -168,6 +171,10 @@ DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetSwapchainImagesKHR, VK_KHR_SWA
 DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkAcquireNextImageKHR, VK_KHR_SWAPCHAIN_EXTENSION_NAME )
 DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkQueuePresentKHR, VK_KHR_SWAPCHAIN_EXTENSION_NAME )
 DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkDestroySwapchainKHR, VK_KHR_SWAPCHAIN_EXTENSION_NAME )
+DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkGetSemaphoreCounterValueKHR, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME )
+DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkWaitSemaphoresKHR, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME )
+DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkSignalSemaphoreKHR, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME )
+DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( vkCmdDrawIndexedIndirectCountKHR, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME )
 
 #undef DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION
 #undef TINY_VULKAN_UPDATE
@@ -251,6 +258,7 @@ PFN_vkCreateSemaphore vkCreateSemaphore;
 PFN_vkCreateFence vkCreateFence;
 PFN_vkWaitForFences vkWaitForFences;
 PFN_vkResetFences vkResetFences;
+PFN_vkGetFenceStatus vkGetFenceStatus;
 PFN_vkDestroyFence vkDestroyFence;
 PFN_vkDestroySemaphore vkDestroySemaphore;
 PFN_vkResetCommandBuffer vkResetCommandBuffer;
@@ -297,6 +305,7 @@ PFN_vkCmdSetScissor vkCmdSetScissor;
 PFN_vkCmdBindVertexBuffers vkCmdBindVertexBuffers;
 PFN_vkCmdDraw vkCmdDraw;
 PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+PFN_vkCmdDrawIndexedIndirect vkCmdDrawIndexedIndirect;
 PFN_vkCmdDispatch vkCmdDispatch;
 PFN_vkCmdCopyImage vkCmdCopyImage;
 PFN_vkCmdPushConstants vkCmdPushConstants;
@@ -323,6 +332,10 @@ PFN_vkGetSwapchainImagesKHR vkGetSwapchainImagesKHR;
 PFN_vkAcquireNextImageKHR vkAcquireNextImageKHR;
 PFN_vkQueuePresentKHR vkQueuePresentKHR;
 PFN_vkDestroySwapchainKHR vkDestroySwapchainKHR;
+PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR;
+PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR;
+PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR;
+PFN_vkSignalSemaphoreKHR vkSignalSemaphoreKHR;
 //----------------------------------------------------------------------
 
 #define EXPORTED_VULKAN_FUNCTION( name ) PFN_##name name;
@@ -376,6 +389,11 @@ void ZInitZone(void *Mem, u32 Size, u32 Align, u8 Zoneid);
 void ZReset(u8 Zoneid);
 void *ZMalloc(s32 Size, u8 Zoneid);
 void ZFree(void *Ptr, u8 Zoneid);
+void ZSetZoneMode(u8 Zoneid, u8 Mode);
+void ZSetZoneGrowth(u8 Zoneid, u8 Growth, VkBufferUsageFlags Usage);
+VkBuffer ZBuffer(void *Ptr, u8 Zoneid, VkDeviceSize *Offset);
+b32 ZDumpZone(u8 Zoneid, const char *Path);
+void VkDeferDestroySwapchain(VkSwapchainKHR Swapchain);
 u8 *StagingDigress(VkDeviceSize Size, u8 BufIndex, VkDeviceSize *Offset);
 u8 *VboDigress(VkDeviceSize Size, u8 BufIndex, VkDeviceSize *Offset);
 u8 *IboDigress(VkDeviceSize Size, u8 BufIndex, VkDeviceSize *Offset);
@@ -403,20 +421,34 @@ u8 *UboDigress(VkDeviceSize Size, u8 BufIndex, VkDeviceSize *Offset);
 
 //UNCATEGORIZED VARS
 u32 MAX_FRAMES_IN_FLIGHT; //must be less than num Semaphores, Fences. 
+u32 FrameSlotCount; //MAX_FRAMES_IN_FLIGHT at PostInit, per slot regions are sized for it
 //-----------------------------------------------------
 VkAllocationCallbacks Allocator;
 VkAllocationCallbacks *VkAllocators = NULL;//&Allocator;
 VkInstance Instance;
 VkDebugReportCallbackEXT VulkanDebugCallback;
 VkQueryPool QueryPool;
-u32 CurrentFrame; 
+u32 CurrentFrame; //frame slot being recorded, FrameCount % MAX_FRAMES_IN_FLIGHT
+u64 FrameCount; //frames submitted since init
 u8 ColorPalette[768];
 u32 U32Palette[256];
 f64 FrameCpuAvg = 0;
 f64 FrameGpuAvg = 0;
+f64 FrameWaitAvg = 0; //cpu time blocked on the reused slot fence
 f64 HighTime;
 //-----------------------------------------------------
 
+//FRAME PACING
+//NOTE(Kyryl): Runs at the top of VkBeginRendering, before acquire.
+//Sample input after VkBeginRendering returns to get the freshest state.
+f64 TargetFrameTime = 0; //seconds, 0 = uncapped
+f64 PacerSpinTime = 0.002; //tail of the wait that is busy looped, os sleep overshoots
+u32 MaxQueuedFrames = 0; //frames the gpu may lag behind the cpu, 0 = MAX_FRAMES_IN_FLIGHT
+f64 NextFrameTime; //deadline of the next frame start
+f64 FrameSlack = 0; //cpu time the pacer waited last frame, seconds
+f64 FrameSlackAvg = 0; //ms
+//-----------------------------------------------------
+
 //Gpu init:
 VkDevice LogicalDevice;
 VkPhysicalDevice GpuDevice;
@@ -433,7 +465,26 @@ float QueuePriority[NUM_QUEUES];
 
 //Surface
 VkSurfaceKHR VkSurface;
-VkPresentModeKHR PresentationMode;
+VkPresentModeKHR PresentationMode; //mode the current swapchain was created with
+
+//NOTE(Kyryl): Present mode policy. The first mode of the list the surface
+//supports is used, FIFO is the spec guaranteed fallback. Set before InitVulkan
+//or at runtime through VkSetPresentModes, which rebuilds the swapchain.
+#define NUM_PRESENT_MODES 4
+VkPresentModeKHR VkPresentModePreferences[NUM_PRESENT_MODES] = {VK_PRESENT_MODE_FIFO_KHR};
+u32 PresentModePreferenceCount = 1;
+//Ready made policies.
+const VkPresentModeKHR VkLowLatencyPresentModes[] = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR};
+const VkPresentModeKHR VkVsyncPresentModes[] = {VK_PRESENT_MODE_FIFO_KHR};
+volatile s32 SwapchainDirty; //rebuild requested by any thread, picked up by VkBeginRendering
+//NOTE(Kyryl): Resize storms only rebuild once the size held still for
+//ResizeDebounceTime, unless the swapchain is out of date and can't be used.
+f64 SwapchainDirtyTime;
+f64 ResizeDebounceTime = 0.1;
+f64 StallThreshold = 0.008; //rebuild + acquire longer than this is a stalled frame
+u32 SwapchainRebuilds;
+u32 StalledFrames;
+f64 RebuildTimeMax;
 VkSurfaceCapabilitiesKHR SurfaceCapabilities;
 
 //Swapchain
@@ -441,7 +492,8 @@ VkImageUsageFlags SwchImageUsage;
 VkSurfaceTransformFlagBitsKHR SwchTransform;
 VkExtent2D SwchImageSize;
 VkImage *VkSwchImages;
-u32 SwchImageCount;
+u32 SwchImageCount; //images the swapchain actually has
+u32 SwchMinImageCount; //images we ask for
 VkColorSpaceKHR SwchImageColorSpace;
 VkFormat SwchImageFormat;
 VkSwapchainKHR VkSwapchains[10];
@@ -457,8 +509,10 @@ separate varibles, manage with indexing carefully.
 #define NUM_RENDERPASSES 10
 #define NUM_FRAMEBUFFERS 10
 #define NUM_IMAGEVIEWS 100
-#define NUM_PIPELINES 20
+#define NUM_PIPELINES 32
 #define NUM_PIPELINE_LAYOUTS 20
+#define MAX_PUSH_CONSTANTS 128 //bytes, the minimum maxPushConstantsSize
+#define PUSH_CONSTANT_STAGES (VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT)
 #define NUM_COMMAND_POOLS 10
 #define NUM_COMMAND_BUFFERS 10
 //----------------------------------------------------
@@ -473,10 +527,75 @@ VkPipelineLayout VkPipelineLayouts[NUM_PIPELINE_LAYOUTS];
 VkCommandPool VkCommandPools[NUM_COMMAND_POOLS];
 VkCommandBuffer VkCommandBuffers[NUM_COMMAND_BUFFERS];
 
+//TIMELINE SYNC
+//NOTE(Kyryl): Every queue submit gets the next value of one monotonic clock.
+//With VK_KHR_timeline_semaphore the gpu signals it directly, otherwise the
+//value is derived from the fences of the submits. Either way anyone can ask
+//VkGpuPassed(Value) instead of holding on to a fence.
+b32 UseTimelineSemaphores = true; //cleared by InitVulkan if the extension or the feature is missing.
+b32 UseDrawIndirectCount = true; //same, for VK_KHR_draw_indirect_count
+VkSemaphore TimelineSemaphore;
+u64 SubmitValue; //last value handed to a submit
+u64 CompletedValue; //last value known to be reached by the gpu
+u64 VkFrameValues[NUM_FENCES]; //value signaled by the last submit of each frame slot
+
 //FOCUS OBJECTS (1 varible version of objects above if feasible)
 VkCommandBuffer CommandBuffer;
 //-----------------------------
 
+//FRAME COMMAND POOLS
+//NOTE(Kyryl): Every recording thread owns a transient pool per frame slot,
+//so threads never share a pool and a slot's pools are reset in one go once
+//its fence passed, no per buffer reset. Thread 0 is the main thread, VkDraw*
+//records into it, its pool also holds the frame's primary buffers which are
+//handed out linearly by VkAllocFrameCommandBuffer.
+#define NUM_RECORD_THREADS 8
+#define NUM_FRAME_COMMAND_BUFFERS 32
+VkCommandPool VkFramePools[NUM_FENCES][NUM_RECORD_THREADS];
+VkCommandBuffer VkFrameCommandBuffers[NUM_FENCES][NUM_FRAME_COMMAND_BUFFERS];
+u32 FrameCommandBufferCounts[NUM_FENCES]; //allocated from the slot's pool so far
+u32 FrameCommandBuffersUsed; //handed out this frame
+VkCommandBuffer VkSecondaryCommandBuffers[NUM_FENCES][NUM_RECORD_THREADS];
+u32 RecordThreadCount; //0 records inline into the primary buffer
+b32 SecondaryRecorded[NUM_RECORD_THREADS];
+volatile s32 ZoneLock; //entity allocations may come from any recording thread
+
+//Push constant block waiting for the next draw, see VkCmdSetDrawConstants.
+typedef struct draw_constants_t
+{
+	u32 Size; //bytes, 0 when nothing is pending
+	u32 Data[MAX_PUSH_CONSTANTS / sizeof(u32)];
+} draw_constants_t;
+
+//BIND CACHE
+//NOTE(Kyryl): Last state bound per recording command buffer, one per recording
+//thread, so draws only bind what changed. Every entity lives in the same zone
+//buffers, those stay bound and the entity offset goes through vertexOffset
+//and firstIndex instead of a rebind.
+typedef struct bind_cache_t
+{
+	VkCommandBuffer Cmd;
+	VkPipeline Pipeline;
+	VkPipelineLayout Layout;
+	VkDescriptorSet DescriptorSet;
+	u32 DynamicOffset;
+	VkBuffer VertexBuffer;
+	VkDeviceSize VertexBase; //bound offset, the part of an entity offset that is not whole vertices
+	VkBuffer IndexBuffer;
+	u32 IndexSize;
+	VkBuffer InstanceBuffer;
+	VkDeviceSize InstanceBase;
+	b32 GeometryBound;
+	u32 PushSize;
+	u32 Push[MAX_PUSH_CONSTANTS / sizeof(u32)];
+	u32 BindsIssued;
+	u32 BindsSkipped;
+	draw_constants_t Constants; //pending for the next draw recorded into Cmd
+} bind_cache_t;
+bind_cache_t BindCaches[NUM_RECORD_THREADS];
+u32 FrameBindsIssued; //last frame
+u32 FrameBindsSkipped;
+
 //DEPTH
 VkImage DepthBuffer;
 VkImageView DepthBufferView;
@@ -491,9 +610,11 @@ VkDescriptorPool DescriptorPool;
 VkDescriptorSetLayout VertUniformDescriptorSetLayout;
 VkDescriptorSetLayout FragUniformDescriptorSetLayout;
 VkDescriptorSetLayout FragSamplerDescriptorSetLayout;
+VkDescriptorSetLayout GeometryDescriptorSetLayout;
 VkDescriptorSet VertUniformDescriptorSet;
 VkDescriptorSet FragUniformDescriptorSet;
 VkDescriptorSet FragSamplerDescriptorSet;
+VkDescriptorSet GeometryDescriptorSet; //set 3 of PULLED_LAYOUT, zone vertices and frame ring
 
 //TEXTURES
 #define NUM_TEXTURES 100
@@ -525,6 +646,7 @@ texture_t TexturePool[NUM_TEXTURES];
 #define NUM_VBO_BUFFERS 10
 #define NUM_IBO_BUFFERS 10
 #define NUM_UBO_BUFFERS 10
+#define NUM_IDO_BUFFERS 10
 #define NUM_STAGING_BUFFERS 1
 //----------------------------------------------------
 VkPhysicalDeviceMemoryProperties DeviceMemoryProperties;
@@ -560,12 +682,23 @@ typedef struct ubo_t
 }ubo_t;
 ubo_t UniformBuffers[NUM_UBO_BUFFERS];
 
+typedef struct ido_t
+{
+	VkBuffer Buffer;
+	VkDeviceMemory DeviceMemory;
+	u32 Size;
+	VkDeviceSize Offset;
+	void *Data;
+}ido_t;
+ido_t IndirectBuffers[NUM_IDO_BUFFERS];
+
 u32 StagingIndex;
 typedef struct staging_t
 {
 	VkBuffer Buffer;
 	VkCommandBuffer CommandBuffer;
 	VkFence Fence;
+	u64 Value; //timeline value of the last submit
 	VkDeviceMemory DeviceMemory;
 	b32 Pending;
 	b32 Submitted;
@@ -590,33 +723,241 @@ device_heap_t DeviceHeaps[NUM_DEVICE_HEAPS];
 #define	ZONEID	0x1d4a11
 #define MINFRAGMENT	64
 
+#define ZTAG_USED 1 //set by ZMalloc
+#define ZTAG_ENTITY 2 //entity geometry, ZMark'ed on every draw
+#define ZONE_STALE_FRAMES 600 //entity blocks unmarked this long count as stale
+
 typedef struct memblock_s
 {
 	s32 Size;	// including the header and possibly tiny fragments
 	s32 Tag;	// a tag of 0 is a free block
 	s32 Id;		// should be ZONEID
+	u32 Frame;	// FrameCount at ZMalloc or the last ZMark
 	struct memblock_s *Next, *Prev;
 } memblock_t;
 
-typedef struct
+//NOTE(Kyryl): Two level segregated fit, the other zone mode. Free blocks sit
+//in lists by size class, one first level per power of two split into
+//TLSF_SL_COUNT linear steps, and two bitmaps find a fitting list in O(1)
+//where the rover walks the block list. Block sizes and the first block keep
+//the zone's Align like rover blocks, so every payload is aligned.
+#define ZONE_ROVER 0 //first fit from the rover, the default
+#define ZONE_TLSF 1
+#define TLSF_SL_LOG2 3
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+#define TLSF_FL_COUNT 32
+
+typedef struct tlsfblock_s
+{
+	s32 Size;	// same leading fields as memblock_t, ZRealloc reads them
+	s32 Tag;
+	s32 Id;
+	u32 Frame;
+	struct tlsfblock_s *PrevPhys;	// NULL for the first block
+	struct tlsfblock_s *NextFree, *PrevFree;	// free blocks only
+} tlsfblock_t;
+
+typedef struct tlsf_t
+{
+	u32 FlBitmap;
+	u32 SlBitmap[TLSF_FL_COUNT];
+	tlsfblock_t *Heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+} tlsf_t;
+
+//NOTE(Kyryl): A full growable zone gets another page instead of failing.
+//Every page is a zone of its own, ZFree finds the page by address. Pages
+//double in size, so a zone needs few of them and ZMalloc tries at most
+//NUM_ZONE_PAGES. Buffer zones put each page in its own VkBuffer, use
+//ZBuffer to get the (buffer, offset) pair of a block.
+#define ZONE_FIXED 0 //ZMalloc fails when full, the default
+#define ZONE_GROW_HOST 1 //chains Tiny_Malloc regions
+#define ZONE_GROW_BUFFER 2 //chains host visible VkBuffer pages
+#define NUM_ZONE_PAGES 16 //per zone, the first page included
+
+typedef struct memzone_s
 {
 	s32 Size;		// total bytes malloced, including header
 	s32 Align;
 	s32 AlignedHeaderSize; //sizeof(memblock_t) based on memzone_t.Align
 	memblock_t Blocklist;	// start / end cap for linked list
 	memblock_t *Rover;
+	u8 Mode; //ZONE_*
+	tlsf_t *Tlsf; //ZONE_TLSF only, right after the zone header
+	struct memzone_s *Next; //next page, the first page is Mainzone
+	VkBuffer Buffer; //buffer zones, the page starts at offset 0
+	VkDeviceMemory DeviceMemory;
 } memzone_t;
 
 memzone_t *Mainzone[10];
+u8 ZoneModes[10]; //ZONE_*, picked up by ZInitZone
+u8 ZoneGrowth[10]; //ZONE_FIXED, ZONE_GROW_*
+VkBufferUsageFlags ZoneUsage[10]; //ZONE_GROW_BUFFER pages
+u32 ZonePages[10]; //including the first
+
+//NOTE(Kyryl): Running counters, kept by ZMalloc and ZFree under the
+//zone's lock. ZGetStats walks the blocks for the rest. Walks count the
+//blocks one ZMalloc looked at, bucket i holds 2^i..2^(i+1)-1 blocks.
+#define NUM_WALK_BUCKETS 16
+typedef struct zone_counters_t
+{
+	u64 Used; //bytes, headers included
+	u64 HighWater; //most Used seen since ZInitZone
+	u64 Allocs;
+	u64 Frees;
+	u64 Failures;
+	u64 Walks[NUM_WALK_BUCKETS];
+} zone_counters_t;
+zone_counters_t ZoneCounters[10];
+
+typedef struct zone_stats_t
+{
+	u32 Pages;
+	u64 Size; //all pages, zone headers included
+	u64 Used; //bytes, block headers included
+	u64 Free;
+	u32 UsedBlocks;
+	u32 FreeBlocks;
+	u32 LargestFree;
+	u32 StaleBlocks; //ZTAG_ENTITY blocks unmarked for ZONE_STALE_FRAMES
+	f32 Fragmentation; //1 - LargestFree / Free, 0 when all free bytes are in one block
+	zone_counters_t Counters;
+} zone_stats_t;
 //------------------------------SGM
 
+//HOST ALLOCATOR
+//NOTE(Kyryl): Backs VkAllocators. The driver calls it from whatever thread
+//creates objects or records, so blocks up to HOST_MAX_SMALL come from per
+//thread caches and only refills, flushes and large blocks take VkHostLock.
+//A host_header_t sits right before every payload. COMMAND scope memory is
+//gone within a frame, so it gets its own arena: separate small block lists
+//and a TLSF zone for large blocks, away from long lived objects in zone 0.
+#define VK_HOST_ZONE 0
+#define VK_COMMAND_ZONE 5
+#define VK_HOST_ZONE_SIZE 8000000
+#define VK_COMMAND_ZONE_SIZE (2 << 20)
+#define HOST_ARENA_OBJECT 0 //every scope but COMMAND
+#define HOST_ARENA_COMMAND 1
+#define NUM_HOST_ARENAS 2
+#define HOST_MIN_CLASS_LOG2 5
+#define NUM_HOST_CLASSES 6 //32..1024 byte blocks, header included
+#define HOST_MAX_SMALL (1 << (HOST_MIN_CLASS_LOG2 + NUM_HOST_CLASSES - 1))
+#define HOST_LARGE 0xffffffff //Class of zone blocks
+#define HOST_SLAB_SIZE 16384 //taken from the zone per refill when the shared list is empty
+#define HOST_CACHE_BYTES 32768 //per thread, arena and class, half goes back past that
+#define NUM_HOST_CACHES 64 //threads past that share HostOverflowCache under a lock
+#define HOST_CACHE_RELEASED 0xffffffffffffffffull //Thread of a slot given back by VkHostThreadExit
+
+typedef struct host_header_t
+{
+	u32 Class; //HOST_LARGE or size class
+	u32 Arena; //HOST_ARENA_*
+	u32 Size; //requested bytes, for VkRealloc
+	u32 Offset; //payload - zone block, large blocks only
+} host_header_t;
+#define HOST_HEADER_SIZE sizeof(host_header_t) //also the small block alignment
+
+typedef struct host_cache_t
+{
+	volatile u64 Thread; //Tiny_GetThreadId of the owner, 0 when never used
+	void *Free[NUM_HOST_ARENAS][NUM_HOST_CLASSES]; //linked through the payload
+	u32 Count[NUM_HOST_ARENAS][NUM_HOST_CLASSES];
+	u8 Pad[40]; //owners on separate lines
+} host_cache_t;
+
+host_cache_t HostCaches[NUM_HOST_CACHES];
+host_cache_t HostOverflowCache;
+volatile s32 HostOverflowLock;
+void *HostShared[NUM_HOST_ARENAS][NUM_HOST_CLASSES]; //flushed blocks, under VkHostLock
+volatile s32 VkHostLock; //zones 0 and VK_COMMAND_ZONE, HostShared
+u8 HostArenaZones[NUM_HOST_ARENAS] = {VK_HOST_ZONE, VK_COMMAND_ZONE};
+
+//ENTITY MODES
+//NOTE(Kyryl): Decides what a VkDraw* copies into the entity's zone blocks.
+//The first draw always copies everything. Static entities may also live in
+//their own device local buffer, see VkUploadStaticEntity, and are drawn by
+//handle: pass NULL vertex and index pointers, only the counts are used.
+#define ENTITY_DYNAMIC 0 //whole mesh on every draw into the frame ring, the default
+#define ENTITY_STATIC 1 //nothing after the first draw
+#define ENTITY_RANGED 2 //only the range set with VkSetEntityDirty, into a copy per frame slot, indices are kept
+
+#define MAX_FRAME_SLOTS (NUM_FENCES - 1) //MAX_FRAMES_IN_FLIGHT stays below NUM_FENCES
+
+//NOTE(Kyryl): Zone blocks owned by one frame slot. BeginFrame retires the
+//slot's last submit before recording into it again, so they are written over
+//in place instead of being freed and allocated every frame.
+typedef struct entity_slot_t
+{
+	u8 *Vbuf; //zone 1, ranged meshes and dynamic ones the frame ring could not take
+	u8 *Ibuf; //zone 2, dynamic meshes only
+	u8 *Instbuf; //zone 1, instances the frame ring could not take
+	u32 VCapacity; //bytes
+	u32 ICapacity;
+	u32 InstCapacity;
+	u32 DirtyFirst; //ranged meshes, vertices changed since this copy was written
+	u32 DirtyEnd;
+} entity_slot_t;
+
 typedef struct vk_entity_t
 {
 	b32 Tag;
-	u8 *Vbuf;
-	u8 *Ibuf; 
-	u8 *Ubuf;
+	u8 *Vbuf; //static meshes
+	u8 *Ibuf; //static and ranged meshes
+	u32 Mode; //ENTITY_*
+	u32 IndexSize; //2 or 4, picked from the vertex count on the first draw
+	u32 Format; //VERTEX_*
+	u32 DirtyFirst; //vertices, consumed by the next draw
+	u32 DirtyCount;
+	b32 InRing; //last upload went to the frame ring at RingOffset
+	VkDeviceSize RingOffset; //vertices, then indices at RingIOffset
+	VkDeviceSize RingIOffset;
+	VkBuffer StaticBuffer; //vertices then indices, replaces Vbuf and Ibuf
+	VkDeviceMemory StaticMemory;
+	VkDeviceSize StaticIOffset;
+	entity_slot_t Slots[MAX_FRAME_SLOTS]; //indexed by CurrentFrame
 } vk_entity_t;
+volatile u32 EntityFrameBytes; //copied into entity blocks this frame
+u32 EntityUploadBytes; //last frame
+
+
+//DEFERRED DESTRUCTION
+//NOTE(Kyryl): Objects that may still be read by frames in flight are queued
+//here with the completion clock value of the last submit that could use them,
+//and released by CollectDeferredFrees once the gpu passed that value.
+#define NUM_DEFERRED_FREES 512 //initial capacity, must be ^2, doubles when one frame fills it
+#define DEFERRED_BUFFER 1
+#define DEFERRED_IMAGE 2
+#define DEFERRED_IMAGE_VIEW 3
+#define DEFERRED_FRAMEBUFFER 4
+#define DEFERRED_MEMORY 5
+#define DEFERRED_SWAPCHAIN 6
+#define DEFERRED_ZONE_BLOCK 7
+#define DEFERRED_DEVICE_HEAP 8
+//----------------------------------------------------
+typedef union
+{
+	VkBuffer Buffer;
+	VkImage Image;
+	VkImageView ImageView;
+	VkFramebuffer Framebuffer;
+	VkDeviceMemory DeviceMemory;
+	VkSwapchainKHR Swapchain;
+	void *Ptr;
+} deferred_object_t;
+
+typedef struct deferred_free_t
+{
+	u32 Type;
+	u32 Index; //zone id or device heap index
+	u64 Value; //UINT64_MAX until the frame being recorded is submitted
+	deferred_object_t Object;
+} deferred_free_t;
+deferred_free_t DeferredFreeStorage[NUM_DEFERRED_FREES];
+deferred_free_t *DeferredFrees = DeferredFreeStorage; //Tiny_Malloc'ed once grown
+u32 DeferredCapacity = NUM_DEFERRED_FREES; //stays ^2
+u32 DeferredHead; //next entry to push, wraps
+u32 DeferredTail; //oldest pending entry, wraps
+u32 DeferredFrameFirst; //first entry pushed while recording the current frame
+b32 FrameRecording;
 
 //--------------------------------------MEMORY
 
@@ -648,21 +989,237 @@ typedef struct
 	f32 Normals[4]; // = vec4
 } vertex_t;
 
+//NOTE(Kyryl): Compact layouts an entity may store instead of vertex_t, see
+//VkSetEntityFormat. The app keeps passing vertex_t, uploads pack it. Same
+//shaders, missing components read 0 for z and 1 for alpha like vertex_t's
+//3 component color does. UVs are unorm so they must stay within 0..1.
+#define VERTEX_FLOAT 0 //vertex_t, 36 bytes
+#define VERTEX_PACKED 1 //vertex_packed_t, 16 bytes
+#define VERTEX_PACKED_2D 2 //vertex_packed2d_t, 12 bytes
+#define NUM_VERTEX_FORMATS 3
+#define NUM_VERTEX_PIPELINES 5 //pipelines 0..4 have a variant per format
+#define VERTEX_PIPELINE(Base, Format) ((Format) ? 8 + ((Format)-1) * NUM_VERTEX_PIPELINES + (Base) : (Base))
+
+//NOTE(Kyryl): With VkSetVertexPulling pipelines 0..4 have no vertex input,
+//pulled.vert.glsl reads vertex_t from storage buffers instead. Zone and ring
+//draws then never rebind a vertex buffer and every entity of a pipeline can
+//share one indirect run. Packed formats and static buffers stay as they are.
+#define PULLED_PIPELINE(Base) (18 + (Base))
+#define PULLED_LAYOUT 3
+#define PULLED_RING_BIT 16 //in firstInstance, see pulled.vert.glsl
+b32 UseVertexPulling;
+
+typedef struct
+{
+	u16 Xyz[4]; // = vec3, half floats, w is padding
+	u16 UVs[2]; // = vec2, unorm
+	u8 Color[4]; // = vec4, unorm
+} vertex_packed_t;
+
+typedef struct
+{
+	u16 Xy[2]; // = vec3, half floats
+	u16 UVs[2]; // = vec2, unorm
+	u8 Color[4]; // = vec4, unorm
+} vertex_packed2d_t;
+
+u32 VertexStrides[NUM_VERTEX_FORMATS] = { sizeof(vertex_t), sizeof(vertex_packed_t), sizeof(vertex_packed2d_t) };
+
 typedef struct
 {
 	f32 Xy[2]; // = vec2
 } vec2_t;
 
-//ubo
+//per instance stream, binding 1
+typedef struct
+{
+	f32 Transform[4]; // = mat2, column major
+	f32 Offset[2]; // = vec2
+	f32 Color[4]; // = vec4, multiplied with the vertex color
+	f32 UVRect[4]; // = vec4, xy offset, zw scale
+} instance_t;
+
+//push constants
 typedef struct
 {
 	f32 Resolution[2];
 	f32 Time;
-} ubo_lightning_t;
+} push_lightning_t;
 
 texture_t PixelTexture;
 //SHADER RESOURCES
 
+//RENDER THREAD
+//NOTE(Kyryl): With VkStartRenderThread the app thread only writes draw packets,
+//a dedicated thread replays the previous frame's packets into vulkan and
+//presents. Two streams, the app fills one while the other is replayed.
+#define RENDER_PACKET_BUFFER_SIZE (1 << 20)
+#define PACKET_DRAW_BASIC 1
+#define PACKET_DRAW_TEXTURED 2
+#define PACKET_DRAW_LINE 3
+#define PACKET_DRAW_LIGHTNINGS 4
+#define PACKET_DRAW_INSTANCED 5
+#define PACKET_DRAW_INSTANCED_TEXTURED 6
+#define PACKET_DRAW_SPRITES 7
+
+typedef struct packet_header_t
+{
+	u32 Type;
+	u32 Size; //header included
+} packet_header_t;
+
+//Followed by the vertices, the indices, the instances, then the draw constants.
+typedef struct draw_packet_t
+{
+	vk_entity_t *Id;
+	u32 VertexCount;
+	u32 IndexCount;
+	u32 IndexSize; //as passed by the app, narrowing happens on replay
+	u32 InstanceCount;
+	b32 Blend;
+	VkDescriptorSet DescriptorSet; //sprites only
+	b32 HasVertices; //static entities are drawn without a payload
+	b32 HasIndices;
+	u32 DirtyFirst; //taken from the entity when the packet was written
+	u32 DirtyCount;
+	u32 PushSize; //draw constants taken from PacketConstants
+} draw_packet_t;
+
+typedef struct packet_stream_t
+{
+	u8 *Data;
+	u32 Used;
+	f64 PublishTime;
+} packet_stream_t;
+
+packet_stream_t PacketStreams[2];
+volatile s32 PacketReady[2]; //set by the app thread, cleared once replayed
+u32 PacketWriteIndex;
+b32 UseRenderThread;
+volatile s32 RenderThreadRunning;
+volatile s32 RenderThreadAlive;
+f64 HandoffLatencyAvg; //publish to replay start, ms
+f64 AppWaitAvg; //app thread blocked on a stream still being replayed, ms
+draw_packet_t *ReplayPacket; //packet being replayed, render thread only
+u32 *ReplayPush; //draw constants of ReplayPacket
+b32 PushDrawPacket(u32 Type, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, void *IndexBuffer, u32 IndexSize, u32 InstanceCount, instance_t *InstanceBuffer, b32 Blend, vk_entity_t *Id);
+b32 PushSpritePacket(u32 QuadCount, vertex_t *Vertices, VkDescriptorSet Texture, b32 Blend);
+
+//DRAW BUCKET
+//NOTE(Kyryl): With VkSetDrawSorting inline draws are not recorded right away,
+//they get a 64 bit key and are replayed radix sorted at VkEndRendering so every
+//pipeline and descriptor set is bound once per group. Opaque draws are ordered
+//by the depth test, blended ones go into a later pass in submission order.
+//Key: pass 4 | pipeline 8 | set id 8 | buffer id 6 | vertex base 6 | depth 18 | sequence 14
+//Set and buffer ids are handed out per bucket in first seen order, see
+//BucketId, so draws of one texture or one zone page sort next to each other.
+//Vertex base is the entity offset modulo the vertex stride, draws sharing
+//buffer and base share a vertex binding and can merge into one indirect draw.
+#define NUM_BUCKET_DRAWS 16384 //must fit the 14 bit sequence
+#define DRAW_PASS_OPAQUE 0
+#define DRAW_PASS_BLEND 1
+#define NUM_BUCKET_ID_SLOTS 512 //^2, more than the largest id range
+#define NUM_SET_IDS 256 //the last one is shared by every set past it
+#define NUM_BUFFER_IDS 64
+
+typedef struct bucket_ids_t
+{
+	u64 Handles[NUM_BUCKET_ID_SLOTS]; //0 is an empty slot
+	u8 Ids[NUM_BUCKET_ID_SLOTS];
+	u32 Count; //ids handed out, VK_NULL_HANDLE always gets 0
+} bucket_ids_t;
+bucket_ids_t BucketSetIds;
+bucket_ids_t BucketBufferIds;
+
+typedef struct draw_item_t
+{
+	u32 Pipeline; //index into VkPipelines
+	u32 Layout; //index into VkPipelineLayouts
+	u32 FirstSet;
+	VkDescriptorSet DescriptorSet; //VK_NULL_HANDLE when unused
+	u32 DynamicOffsetCount;
+	u32 DynamicOffset;
+	b32 Blend;
+	VkBuffer VertexBuffer; //binding 0
+	VkBuffer IndexBuffer;
+	VkDeviceSize VOffset;
+	VkDeviceSize IOffset;
+	u32 VertexCount;
+	u32 IndexCount; //0 for non indexed
+	u32 IndexSize; //2 or 4
+	u32 VertexStride; //VertexStrides[Format]
+	u32 FirstInstance; //pulled draws only, source and float remainder
+	VkBuffer InstanceBuffer; //zone 1 page of the instance data
+	VkDeviceSize InstOffset;
+	u32 InstanceCount; //0 for non instanced
+	u32 PushSize; //bytes of Push, 0 when the pipeline reads none
+	u32 Push[MAX_PUSH_CONSTANTS / sizeof(u32)];
+} draw_item_t;
+
+typedef struct draw_key_t
+{
+	u64 Key;
+	u32 Index; //into DrawItems
+} draw_key_t;
+
+draw_item_t DrawItems[NUM_BUCKET_DRAWS];
+draw_key_t DrawKeys[2][NUM_BUCKET_DRAWS]; //ping pong for the radix passes
+u32 DrawItemCount;
+b32 DrawSorting;
+u32 DrawSortDepth; //set before VkDraw*, lower goes first within a state group
+u32 DrawBucketDraws; //last flush
+u32 DrawBucketGroups; //pipeline + descriptor changes of the last flush
+b32 DrawIndirect; //merge runs of indexed draws into vkCmdDrawIndexedIndirect at flush
+u32 IndirectRunMax; //1 without multiDrawIndirect
+u32 IndirectDraws; //commands written by the last flush
+u32 IndirectCalls; //indirect calls recorded by the last flush
+f64 FlushCpuAvg; //ms spent recording the bucket
+draw_constants_t PacketConstants; //VkSetDrawConstants in render thread mode, app thread only
+draw_constants_t FrameBufferConstants; //VkAllocFrameCommandBuffer buffers, main thread only
+
+//SPRITE BATCH
+//NOTE(Kyryl): VkDrawSprite writes quads straight into a persistently mapped
+//vertex stream, one region per frame slot, and all batches share a static
+//quad index buffer. A batch becomes one textured draw when the texture or
+//blend changes, on VkFlushSprites or at VkEndRendering.
+//With the render thread quads are gathered in SpriteScratch and shipped as
+//packets, the render thread copies them into its frame's region.
+#define NUM_SPRITE_QUADS 4096 //per frame slot, 16 bit indices up to 16384
+vbo_t SpriteVertexBuffer;
+ibo_t SpriteIndexBuffer;
+vertex_t SpriteScratch[NUM_SPRITE_QUADS * 4];
+u32 SpriteStreamUsed; //quads recorded into this slot's region
+VkDescriptorSet SpriteTexture;
+b32 SpriteBlend;
+u32 SpriteCount; //quads in the open batch
+u32 SpriteDraws; //draws of the last frame
+u32 SpriteQuads;
+u32 SpriteFrameDraws;
+u32 SpriteFrameQuads;
+
+//FRAME RING
+//NOTE(Kyryl): Transient vertex and index data of dynamic draws.
+//One persistently mapped buffer, one region per frame slot, bumped with an
+//atomic cursor so record threads can share it. A region is reused only
+//after BeginFrame waited on its slot, so the cpu never writes what the gpu
+//may still read and nothing is left behind in the zones. When a region runs
+//out, draws fall back to the entity's zone blocks for the rest of the frame.
+#define FRAME_RING_SIZE (256 * 1024) //per frame slot
+typedef struct ring_t
+{
+	VkBuffer Buffer;
+	VkDeviceMemory DeviceMemory;
+	u32 Size;
+	VkDeviceSize Offset;
+	void *Data;
+}ring_t;
+ring_t FrameRing;
+volatile u32 FrameRingUsed; //bytes of this slot's region
+volatile u32 FrameRingMisses; //allocations that did not fit
+u32 FrameRingBytes; //last frame
+u32 FrameRingOverflows; //last frame
+void FlushDrawBucket(VkCommandBuffer Cmd);
+
 //----------------------------------------------------VULKAN GLOBALS
 
 
@@ -721,6 +1278,65 @@ const char *GetVulkanResultString(VkResult result)
 	}
 }
 
+const char *GetPresentModeString(VkPresentModeKHR Mode)
+{
+	switch (Mode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "IMMEDIATE";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "MAILBOX";
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "FIFO";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "FIFO_RELAXED";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+VkPresentModeKHR ChoosePresentMode()
+{
+	u32 ModesCount = 0;
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(GpuDevice, VkSurface, &ModesCount, NULL));
+	ASSERT(ModesCount, "Failed to enumerate presentation modes!");
+
+	VkPresentModeKHR PresentModes[ModesCount];
+	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(GpuDevice, VkSurface, &ModesCount, &PresentModes[0]));
+
+	for(u32 c = 0; c < PresentModePreferenceCount; c++)
+	{
+		for(u32 i = 0; i < ModesCount; i++)
+		{
+			if(PresentModes[i] == VkPresentModePreferences[c])
+			{
+				return PresentModes[i];
+			}
+		}
+		Info("Presentation mode %s is not supported.", GetPresentModeString(VkPresentModePreferences[c]));
+	}
+	Warn("No preferred presentation mode supported, using FIFO.");
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+//Takes effect on the next VkBeginRendering.
+void VkSetPresentModes(u32 Count, const VkPresentModeKHR *Modes)
+{
+	ASSERT(Count && Count <= NUM_PRESENT_MODES, "VkSetPresentModes: 1 to %d modes expected.", NUM_PRESENT_MODES);
+	memcpy(VkPresentModePreferences, Modes, sizeof(VkPresentModeKHR) * Count);
+	PresentModePreferenceCount = Count;
+	if(LogicalDevice)
+	{
+		__atomic_store_n(&SwapchainDirty, true, __ATOMIC_RELEASE);
+	}
+}
+
+void VkGetSwapchainInfo(u32 *ImageCount, VkPresentModeKHR *Mode)
+{
+	*ImageCount = SwchImageCount;
+	*Mode = PresentationMode;
+}
+
 void SetSizeOfSwapchainImages(u32 x, u32 y)
 {
 	SwchImageSize.width = x;
@@ -739,7 +1355,7 @@ void CreateSwapchain(VkSwapchainKHR *Swapchain, VkSwapchainKHR *OldSwapchain)
 	SwapchainCI.pNext = NULL;
 	SwapchainCI.flags = 0;
 	SwapchainCI.surface = VkSurface;
-	SwapchainCI.minImageCount = SwchImageCount;
+	SwapchainCI.minImageCount = SwchMinImageCount;
 	SwapchainCI.imageFormat = SwchImageFormat;
 	SwapchainCI.imageColorSpace = SwchImageColorSpace;
 	SwapchainCI.imageExtent = SwchImageSize;
@@ -757,10 +1373,11 @@ void CreateSwapchain(VkSwapchainKHR *Swapchain, VkSwapchainKHR *OldSwapchain)
 	VK_CHECK(vkCreateSwapchainKHR(LogicalDevice, &SwapchainCI, VkAllocators, Swapchain));
 	ASSERT(Swapchain, "vkCreateSwapchainKHR failed.");
 
-	if(OldSwapchain != VK_NULL_HANDLE)
+	if(*OldSwapchain != VK_NULL_HANDLE)
 	{
-		vkDestroySwapchainKHR(LogicalDevice, *OldSwapchain, VkAllocators);
-		OldSwapchain = VK_NULL_HANDLE;
+		//Frames in flight may still present from it.
+		VkDeferDestroySwapchain(*OldSwapchain);
+		*OldSwapchain = VK_NULL_HANDLE;
 	}
 }
 
@@ -1094,6 +1711,293 @@ void UploadTexture(texture_t *Texture)
 	StagingBuffer->Pending = true;
 }
 
+//NOTE(Kyryl):
+//Submits on VkQueues[0] and returns the clock value the gpu reaches once
+//this batch is done. Fence is only used by the fence fallback.
+u64 VkSubmitTimeline(VkSubmitInfo *Info, VkFence Fence)
+{
+	u64 Value = ++SubmitValue;
+	if(!UseTimelineSemaphores)
+	{
+		VK_CHECK(vkQueueSubmit(VkQueues[0], 1, Info, Fence));
+		return Value;
+	}
+
+	//Timeline goes last, binary semaphores ignore their value.
+	u32 Count = Info->signalSemaphoreCount;
+	ASSERT(Count < NUM_SEMAPHORES, "VkSubmitTimeline: too many signal semaphores.");
+	VkSemaphore SignalSemaphores[NUM_SEMAPHORES];
+	u64 SignalValues[NUM_SEMAPHORES];
+	for(u32 i = 0; i < Count; i++)
+	{
+		SignalSemaphores[i] = Info->pSignalSemaphores[i];
+		SignalValues[i] = 0;
+	}
+	SignalSemaphores[Count] = TimelineSemaphore;
+	SignalValues[Count] = Value;
+
+	VkTimelineSemaphoreSubmitInfoKHR TimelineSI;
+	TimelineSI.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	TimelineSI.pNext = NULL;
+	TimelineSI.waitSemaphoreValueCount = 0;
+	TimelineSI.pWaitSemaphoreValues = NULL;
+	TimelineSI.signalSemaphoreValueCount = Count + 1;
+	TimelineSI.pSignalSemaphoreValues = SignalValues;
+
+	VkSubmitInfo TimelineSubmitInfo = *Info;
+	TimelineSubmitInfo.pNext = &TimelineSI;
+	TimelineSubmitInfo.signalSemaphoreCount = Count + 1;
+	TimelineSubmitInfo.pSignalSemaphores = SignalSemaphores;
+
+	VK_CHECK(vkQueueSubmit(VkQueues[0], 1, &TimelineSubmitInfo, VK_NULL_HANDLE));
+	return Value;
+}
+
+u64 VkGetCompletedValue()
+{
+	if(UseTimelineSemaphores)
+	{
+		u64 Value;
+		VK_CHECK(vkGetSemaphoreCounterValueKHR(LogicalDevice, TimelineSemaphore, &Value));
+		CompletedValue = Max(CompletedValue, Value);
+		return CompletedValue;
+	}
+
+	//Single queue, submits retire in order, so the highest
+	//signaled fence tells how far the gpu got.
+	for(u32 i = 0; i < FrameSlotCount; i++)
+	{
+		if(VkFrameValues[i] > CompletedValue && vkGetFenceStatus(LogicalDevice, VkFences[i]) == VK_SUCCESS)
+		{
+			CompletedValue = VkFrameValues[i];
+		}
+	}
+	for(u32 i = 0; i < NUM_STAGING_BUFFERS; i++)
+	{
+		staging_t *StagingBuffer = &StagingBuffers[i];
+		if(StagingBuffer->Submitted && StagingBuffer->Value > CompletedValue &&
+				vkGetFenceStatus(LogicalDevice, StagingBuffer->Fence) == VK_SUCCESS)
+		{
+			CompletedValue = StagingBuffer->Value;
+		}
+	}
+	return CompletedValue;
+}
+
+b32 VkGpuPassed(u64 Value)
+{
+	return Value <= CompletedValue || Value <= VkGetCompletedValue();
+}
+
+void VkWaitValue(u64 Value)
+{
+	if(VkGpuPassed(Value))
+	{
+		return;
+	}
+
+	if(UseTimelineSemaphores)
+	{
+		VkSemaphoreWaitInfoKHR SemaphoreWI;
+		SemaphoreWI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		SemaphoreWI.pNext = NULL;
+		SemaphoreWI.flags = 0;
+		SemaphoreWI.semaphoreCount = 1;
+		SemaphoreWI.pSemaphores = &TimelineSemaphore;
+		SemaphoreWI.pValues = &Value;
+		VK_CHECK(vkWaitSemaphoresKHR(LogicalDevice, &SemaphoreWI, UINT64_MAX));
+		CompletedValue = Max(CompletedValue, Value);
+		return;
+	}
+
+	//Wait on the earliest submit that covers Value.
+	VkFence Fence = VK_NULL_HANDLE;
+	u64 FenceValue = UINT64_MAX;
+	for(u32 i = 0; i < FrameSlotCount; i++)
+	{
+		if(VkFrameValues[i] >= Value && VkFrameValues[i] < FenceValue)
+		{
+			Fence = VkFences[i];
+			FenceValue = VkFrameValues[i];
+		}
+	}
+	for(u32 i = 0; i < NUM_STAGING_BUFFERS; i++)
+	{
+		if(StagingBuffers[i].Submitted && StagingBuffers[i].Value >= Value && StagingBuffers[i].Value < FenceValue)
+		{
+			Fence = StagingBuffers[i].Fence;
+			FenceValue = StagingBuffers[i].Value;
+		}
+	}
+	ASSERT(Fence, "VkWaitValue: value %llu was never submitted.", Value);
+	VK_CHECK(vkWaitForFences(LogicalDevice, 1, &Fence, VK_TRUE, UINT64_MAX));
+	CompletedValue = Max(CompletedValue, FenceValue);
+}
+
+void ReleaseDeferredFree(deferred_free_t *Entry)
+{
+	switch(Entry->Type)
+	{
+		case DEFERRED_BUFFER:
+			vkDestroyBuffer(LogicalDevice, Entry->Object.Buffer, VkAllocators);
+			break;
+		case DEFERRED_IMAGE:
+			vkDestroyImage(LogicalDevice, Entry->Object.Image, VkAllocators);
+			break;
+		case DEFERRED_IMAGE_VIEW:
+			vkDestroyImageView(LogicalDevice, Entry->Object.ImageView, VkAllocators);
+			break;
+		case DEFERRED_FRAMEBUFFER:
+			vkDestroyFramebuffer(LogicalDevice, Entry->Object.Framebuffer, VkAllocators);
+			break;
+		case DEFERRED_MEMORY:
+			vkFreeMemory(LogicalDevice, Entry->Object.DeviceMemory, VkAllocators);
+			break;
+		case DEFERRED_SWAPCHAIN:
+			vkDestroySwapchainKHR(LogicalDevice, Entry->Object.Swapchain, VkAllocators);
+			break;
+		case DEFERRED_ZONE_BLOCK:
+			ZFree(Entry->Object.Ptr, Entry->Index);
+			break;
+		case DEFERRED_DEVICE_HEAP:
+			VkDeviceFree(Entry->Index, Entry->Object.DeviceMemory);
+			break;
+		default:
+			ASSERT(0, "ReleaseDeferredFree: unknown type %d", Entry->Type);
+	}
+}
+
+//All = true releases everything, only after vkDeviceWaitIdle.
+void CollectDeferredFrees(b32 All)
+{
+	while(DeferredTail != DeferredHead)
+	{
+		deferred_free_t *Entry = &DeferredFrees[DeferredTail % DeferredCapacity];
+		if(!All && !VkGpuPassed(Entry->Value))
+		{
+			//Values only grow towards the head.
+			break;
+		}
+		ReleaseDeferredFree(Entry);
+		DeferredTail++;
+	}
+	if(All)
+	{
+		DeferredFrameFirst = DeferredHead;
+	}
+}
+
+void DeferFree(u32 Type, deferred_object_t Object, u32 Index)
+{
+	if(DeferredHead - DeferredTail == DeferredCapacity)
+	{
+		u64 Oldest = DeferredFrees[DeferredTail % DeferredCapacity].Value;
+		if(Oldest != UINT64_MAX)
+		{
+			//Full, retire the oldest entry the hard way.
+			VkWaitValue(Oldest);
+			CollectDeferredFrees(false);
+		}
+		else
+		{
+			//NOTE(Kyryl): Full within the frame being recorded, there is
+			//nothing to wait for. Entries keep their wrapped index, with both
+			//capacities ^2 they land in the same order in the bigger array.
+			u32 Capacity = DeferredCapacity * 2;
+			deferred_free_t *Frees = (deferred_free_t*) Tiny_Malloc(sizeof(deferred_free_t) * Capacity);
+			ASSERT(Frees, "DeferFree: failed to grow the queue to %d entries", Capacity);
+			for(u32 i = DeferredTail; i != DeferredHead; i++)
+			{
+				Frees[i % Capacity] = DeferredFrees[i % DeferredCapacity];
+			}
+			if(DeferredFrees != DeferredFreeStorage)
+			{
+				Tiny_Free(DeferredFrees);
+			}
+			DeferredFrees = Frees;
+			DeferredCapacity = Capacity;
+			Warn("DeferFree: queue grown to %d entries", Capacity);
+		}
+	}
+	deferred_free_t *Entry = &DeferredFrees[DeferredHead % DeferredCapacity];
+	Entry->Type = Type;
+	Entry->Index = Index;
+	Entry->Object = Object;
+	//While recording, the frame that uses it has no value yet, VkEndRendering stamps it.
+	Entry->Value = FrameRecording ? UINT64_MAX : SubmitValue;
+	DeferredHead++;
+}
+
+//Called after the frame submit.
+void StampDeferredFrees(u64 Value)
+{
+	for(u32 i = DeferredFrameFirst; i != DeferredHead; i++)
+	{
+		DeferredFrees[i % DeferredCapacity].Value = Value;
+	}
+	DeferredFrameFirst = DeferredHead;
+}
+
+void VkDeferDestroyBuffer(VkBuffer Buffer)
+{
+	deferred_object_t Object;
+	Object.Buffer = Buffer;
+	DeferFree(DEFERRED_BUFFER, Object, 0);
+}
+
+void VkDeferDestroyImage(VkImage Image)
+{
+	deferred_object_t Object;
+	Object.Image = Image;
+	DeferFree(DEFERRED_IMAGE, Object, 0);
+}
+
+void VkDeferDestroyImageView(VkImageView ImageView)
+{
+	deferred_object_t Object;
+	Object.ImageView = ImageView;
+	DeferFree(DEFERRED_IMAGE_VIEW, Object, 0);
+}
+
+void VkDeferDestroyFramebuffer(VkFramebuffer Framebuffer)
+{
+	deferred_object_t Object;
+	Object.Framebuffer = Framebuffer;
+	DeferFree(DEFERRED_FRAMEBUFFER, Object, 0);
+}
+
+void VkDeferFreeMemory(VkDeviceMemory DeviceMemory)
+{
+	deferred_object_t Object;
+	Object.DeviceMemory = DeviceMemory;
+	DeferFree(DEFERRED_MEMORY, Object, 0);
+}
+
+void VkDeferDestroySwapchain(VkSwapchainKHR Swapchain)
+{
+	deferred_object_t Object;
+	Object.Swapchain = Swapchain;
+	DeferFree(DEFERRED_SWAPCHAIN, Object, 0);
+}
+
+void VkDeferDeviceFree(u32 Index, VkDeviceMemory DeviceMemory)
+{
+	deferred_object_t Object;
+	Object.DeviceMemory = DeviceMemory;
+	DeferFree(DEFERRED_DEVICE_HEAP, Object, Index);
+}
+
+void ZDeferFree(void *Ptr, u8 Zoneid)
+{
+	if(!Ptr)
+	{
+		return;
+	}
+	deferred_object_t Object;
+	Object.Ptr = Ptr;
+	DeferFree(DEFERRED_ZONE_BLOCK, Object, Zoneid);
+}
+
 void ResetStagingBuffer()
 {
 	staging_t *StagingBuffer = &StagingBuffers[StagingIndex];
@@ -1103,9 +2007,16 @@ void ResetStagingBuffer()
 		return; 
 	}
 
-	VK_CHECK(vkWaitForFences(LogicalDevice, 1, &StagingBuffer->Fence, VK_TRUE, UINT64_MAX));
-
-	VK_CHECK(vkResetFences(LogicalDevice, 1, &StagingBuffer->Fence));
+	if(UseTimelineSemaphores)
+	{
+		VkWaitValue(StagingBuffer->Value);
+	}
+	else
+	{
+		VK_CHECK(vkWaitForFences(LogicalDevice, 1, &StagingBuffer->Fence, VK_TRUE, UINT64_MAX));
+		VK_CHECK(vkResetFences(LogicalDevice, 1, &StagingBuffer->Fence));
+		CompletedValue = Max(CompletedValue, StagingBuffer->Value);
+	}
 
 	VkCommandBufferBeginInfo CommandBufferBI;
 	CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1171,7 +2082,7 @@ b32 SubmitStagingBuffer()
 	SubmitInfo.signalSemaphoreCount = 0;
 	SubmitInfo.pSignalSemaphores = NULL;
 
-	VK_CHECK(vkQueueSubmit(VkQueues[0], 1, &SubmitInfo, StagingBuffer->Fence));
+	StagingBuffer->Value = VkSubmitTimeline(&SubmitInfo, StagingBuffer->Fence);
 
 	StagingBuffer->Submitted = true;
 	StagingIndex++;
@@ -1185,13 +2096,21 @@ void DestroyDepthBuffer()
 	vkDestroyImageView(LogicalDevice, DepthBufferView, VkAllocators);
 }
 
+//Same as DestroyDepthBuffer but waits for frames in flight.
+void RetireDepthBuffer()
+{
+	VkDeferDestroyImageView(DepthBufferView);
+	VkDeferDestroyImage(DepthBuffer);
+	VkDeferFreeMemory(DepthBufferMemory);
+}
+
 void CreateDepthBuffer()
 {
 	Trace("Creating depth buffer");
 
 	if(DepthBuffer)
 	{
-		DestroyDepthBuffer();
+		RetireDepthBuffer();
 	}
 
 	VkImageCreateInfo ImageCI;
@@ -1454,39 +2373,216 @@ void VkDeviceFree(u32 Index, VkDeviceMemory DeviceMemory)
 
 }
 
-void *ZMalloc(s32 Size, u8 Zoneid)
+void TlsfMapping(u32 Size, u32 *Fl, u32 *Sl)
 {
-	s32 Extra;
-	memblock_t *Start, *Rover, *Newblock, *Base;
-	memzone_t *Zone = Mainzone[Zoneid];
+	u32 F = 31 - __builtin_clz(Size);
+	if(F < TLSF_SL_LOG2)
+	{
+		*Fl = 0;
+		*Sl = Size;
+		return;
+	}
+	*Fl = F - TLSF_SL_LOG2 + 1;
+	*Sl = (Size >> (F - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+}
 
-//
-// scan through the block list looking for the first free block
-// of sufficient size
-//
-	Size += Zone->AlignedHeaderSize; // account for size of block header
+void TlsfInsert(tlsf_t *Tlsf, tlsfblock_t *Block)
+{
+	u32 Fl, Sl;
+	TlsfMapping(Block->Size, &Fl, &Sl);
+	tlsfblock_t *Head = Tlsf->Heads[Fl][Sl];
+	Block->NextFree = Head;
+	Block->PrevFree = NULL;
+	if(Head)
+	{
+		Head->PrevFree = Block;
+	}
+	Tlsf->Heads[Fl][Sl] = Block;
+	Tlsf->FlBitmap |= 1u << Fl;
+	Tlsf->SlBitmap[Fl] |= 1u << Sl;
+}
+
+void TlsfRemove(tlsf_t *Tlsf, tlsfblock_t *Block)
+{
+	u32 Fl, Sl;
+	TlsfMapping(Block->Size, &Fl, &Sl);
+	if(Block->NextFree)
+	{
+		Block->NextFree->PrevFree = Block->PrevFree;
+	}
+	if(Block->PrevFree)
+	{
+		Block->PrevFree->NextFree = Block->NextFree;
+		return;
+	}
+	Tlsf->Heads[Fl][Sl] = Block->NextFree;
+	if(!Block->NextFree)
+	{
+		Tlsf->SlBitmap[Fl] &= ~(1u << Sl);
+		if(!Tlsf->SlBitmap[Fl])
+		{
+			Tlsf->FlBitmap &= ~(1u << Fl);
+		}
+	}
+}
+
+//Any block of the returned list fits, NULL when none does.
+tlsfblock_t *TlsfFind(tlsf_t *Tlsf, u32 Size)
+{
+	//Round up to the next class, lists hold a range of sizes.
+	u32 F = 31 - __builtin_clz(Size);
+	if(F >= TLSF_SL_LOG2)
+	{
+		Size += (1u << (F - TLSF_SL_LOG2)) - 1;
+	}
+	u32 Fl, Sl;
+	TlsfMapping(Size, &Fl, &Sl);
+	u32 SlMap = Tlsf->SlBitmap[Fl] & (~0u << Sl);
+	if(!SlMap)
+	{
+		u32 FlMap = Fl + 1 < TLSF_FL_COUNT ? Tlsf->FlBitmap & (~0u << (Fl + 1)) : 0;
+		if(!FlMap)
+		{
+			return NULL;
+		}
+		Fl = __builtin_ctz(FlMap);
+		SlMap = Tlsf->SlBitmap[Fl];
+	}
+	return Tlsf->Heads[Fl][__builtin_ctz(SlMap)];
+}
+
+void *TlsfMalloc(memzone_t *Zone, s32 Size)
+{
+	Size += Zone->AlignedHeaderSize;
 #ifdef TINYENGINE_DEBUG
 	Size += sizeof(s32);		// space for memory trash tester
 #endif
 	Size = (Size + (Zone->Align-1)) & -Zone->Align;
-	//alignment must be consistent through out the allocator.
 
-	Base = Rover = Mainzone[Zoneid]->Rover;
-	Start = Base->Prev;
+	tlsfblock_t *Base = TlsfFind(Zone->Tlsf, Size);
+	if(!Base)
+	{
+		return NULL;
+	}
+	TlsfRemove(Zone->Tlsf, Base);
 
-	do
+	s32 Extra = Base->Size - Size;
+	if(Extra > MINFRAGMENT && Extra >= Zone->AlignedHeaderSize)
+	{
+		tlsfblock_t *Newblock = (tlsfblock_t*)((u8*)Base + Size);
+		Newblock->Size = Extra;
+		Newblock->Tag = 0;
+#ifdef TINYENGINE_DEBUG
+		Newblock->Id = ZONEID;
+#endif
+		Newblock->PrevPhys = Base;
+		((tlsfblock_t*)((u8*)Newblock + Extra))->PrevPhys = Newblock;
+		TlsfInsert(Zone->Tlsf, Newblock);
+		Base->Size = Size;
+	}
+	Base->Tag = 1;
+
+#ifdef TINYENGINE_DEBUG
+	Base->Id = ZONEID;
+	*(int *)((u8*)Base + Base->Size - sizeof(s32)) = ZONEID;
+#endif
+
+	return (void *) ((u8 *)Base + Zone->AlignedHeaderSize);
+}
+
+//Merges with free physical neighbours, the end sentinel is never free.
+void TlsfFree(memzone_t *Zone, tlsfblock_t *Block)
+{
+	Block->Tag = 0;
+	tlsfblock_t *Other = Block->PrevPhys;
+	if(Other && !Other->Tag)
+	{
+		TlsfRemove(Zone->Tlsf, Other);
+		Other->Size += Block->Size;
+		Block = Other;
+	}
+	Other = (tlsfblock_t*)((u8*)Block + Block->Size);
+	if(!Other->Tag)
+	{
+		TlsfRemove(Zone->Tlsf, Other);
+		Block->Size += Other->Size;
+	}
+	((tlsfblock_t*)((u8*)Block + Block->Size))->PrevPhys = Block;
+	TlsfInsert(Zone->Tlsf, Block);
+}
+
+//One free block and a used sentinel at the end, so TlsfFree never
+//looks past the zone.
+tlsfblock_t *TlsfFirstBlock(memzone_t *Zone)
+{
+	s32 ASize = (sizeof(memzone_t) + sizeof(tlsf_t) + (Zone->Align-1)) & -Zone->Align;
+	return (tlsfblock_t*)((u8*)Zone + ASize);
+}
+
+void ZInitTlsf(memzone_t *Zone, u32 Size)
+{
+	s32 Align = Zone->Align;
+	Zone->AlignedHeaderSize = (sizeof(tlsfblock_t) + (Align-1)) & -Align;
+	s32 ASize = (sizeof(memzone_t) + sizeof(tlsf_t) + (Align-1)) & -Align;
+	Zone->Size = Size;
+	Zone->Blocklist.Next = Zone->Blocklist.Prev = NULL;
+	Zone->Blocklist.Tag = 1;
+	Zone->Blocklist.Size = 0;
+	Zone->Rover = NULL;
+	Zone->Tlsf = (tlsf_t*)(Zone + 1);
+	memset(Zone->Tlsf, 0, sizeof(tlsf_t));
+
+	tlsfblock_t *Block = (tlsfblock_t*)((u8*)Zone + ASize);
+	s32 BlockSize = ((Size - ASize) & -Align) - Zone->AlignedHeaderSize;
+	tlsfblock_t *End = (tlsfblock_t*)((u8*)Block + BlockSize);
+	End->Size = 0;
+	End->Tag = 1;
+#ifdef TINYENGINE_DEBUG
+	End->Id = ZONEID;
+#endif
+	End->PrevPhys = Block;
+
+	Block->Size = BlockSize;
+	Block->Tag = 0;
+#ifdef TINYENGINE_DEBUG
+	Block->Id = ZONEID;
+#endif
+	Block->PrevPhys = NULL;
+	TlsfInsert(Zone->Tlsf, Block);
+}
+
+//One page, NULL when it has no room. Adds the blocks it looked at to Walk.
+void *ZPageMalloc(memzone_t *Zone, s32 Size, u32 *Walk)
+{
+	s32 Extra;
+	memblock_t *Start, *Rover, *Newblock, *Base;
+	if(Zone->Mode == ZONE_TLSF)
+	{
+		(*Walk)++;
+		return TlsfMalloc(Zone, Size);
+	}
+
+//
+// scan through the block list looking for the first free block
+// of sufficient size
+//
+	Size += Zone->AlignedHeaderSize; // account for size of block header
+#ifdef TINYENGINE_DEBUG
+	Size += sizeof(s32);		// space for memory trash tester
+#endif
+	Size = (Size + (Zone->Align-1)) & -Zone->Align;
+	//alignment must be consistent through out the allocator.
+
+	Base = Rover = Zone->Rover;
+	Start = Base->Prev;
+
+	do
 	{
 		if (Rover == Start)	// scaned all the way around the list
 		{
-			//NOTE(Kyryl):
-			//Not every allocation does check for NULL so
-			//also do notify here.
-			//TODO:
-			//Instead of returning NULL we can do another OS allocation here
-			//and link the last node of that to the blocklist.
-			Error("ZMalloc failed!");
 			return NULL;
 		}
+		(*Walk)++;
 		if (Rover->Tag)
 		{
 			Base = Rover = Rover->Next;
@@ -1531,6 +2627,102 @@ void *ZMalloc(s32 Size, u8 Zoneid)
 	return (void *) ((u8 *)Base + Zone->AlignedHeaderSize);
 }
 
+memzone_t *ZInitPage(void *Mem, u32 Size, u32 Align, u8 Mode);
+
+//Room for the request and the page's own headers, twice the newest page.
+memzone_t *ZGrow(u8 Zoneid, s32 Size)
+{
+	memzone_t *First = Mainzone[Zoneid];
+	if(ZoneGrowth[Zoneid] == ZONE_FIXED || ZonePages[Zoneid] >= NUM_ZONE_PAGES)
+	{
+		return NULL;
+	}
+	memzone_t *Newest = First->Next ? First->Next : First;
+	u32 PageSize = Max((u32)Newest->Size * 2, (u32)Size * 2 + 4096);
+
+	void *Mem;
+	VkBuffer Buffer = VK_NULL_HANDLE;
+	VkDeviceMemory DeviceMemory = VK_NULL_HANDLE;
+	if(ZoneGrowth[Zoneid] == ZONE_GROW_HOST)
+	{
+		Mem = Tiny_Malloc(PageSize);
+	}
+	else
+	{
+		Mem = VkHostMalloc(PageSize, &Buffer, &DeviceMemory, (VkBufferUsageFlagBits)ZoneUsage[Zoneid]);
+	}
+	if(!Mem)
+	{
+		return NULL;
+	}
+
+	memzone_t *Page = ZInitPage(Mem, PageSize, First->Align, First->Mode);
+	Page->Buffer = Buffer;
+	Page->DeviceMemory = DeviceMemory;
+	//Newest right after the first, ZBuffer may walk the chain unlocked.
+	Page->Next = First->Next;
+	__atomic_store_n(&First->Next, Page, __ATOMIC_RELEASE);
+	ZonePages[Zoneid]++;
+	Info("Zone %d grew by %d bytes to %d pages", Zoneid, PageSize, ZonePages[Zoneid]);
+	return Page;
+}
+
+void *ZMalloc(s32 Size, u8 Zoneid)
+{
+	zone_counters_t *Counters = &ZoneCounters[Zoneid];
+	memzone_t *Page = Mainzone[Zoneid];
+	void *Ptr = NULL;
+	u32 Walk = 0;
+	for(; Page; Page = Page->Next)
+	{
+		Ptr = ZPageMalloc(Page, Size, &Walk);
+		if(Ptr)
+		{
+			break;
+		}
+	}
+	if(!Ptr)
+	{
+		Page = ZGrow(Zoneid, Size);
+		Ptr = Page ? ZPageMalloc(Page, Size, &Walk) : NULL;
+	}
+	Counters->Walks[Min(31 - __builtin_clz(Walk | 1), NUM_WALK_BUCKETS - 1)]++;
+	if(!Ptr)
+	{
+		//NOTE(Kyryl):
+		//Not every allocation does check for NULL so
+		//also do notify here.
+		Error("ZMalloc failed!");
+		Counters->Failures++;
+		return NULL;
+	}
+
+	memblock_t *Block = (memblock_t*)((u8*)Ptr - Page->AlignedHeaderSize);
+	Block->Frame = (u32)FrameCount;
+	Counters->Allocs++;
+	Counters->Used += Block->Size;
+	Counters->HighWater = Max(Counters->HighWater, Counters->Used);
+	return Ptr;
+}
+
+//The page holding Ptr.
+memzone_t *ZFindPage(void *Ptr, u8 Zoneid)
+{
+	memzone_t *Zone = Mainzone[Zoneid];
+	while(Zone->Next && ((u8*)Ptr < (u8*)Zone || (u8*)Ptr >= (u8*)Zone + Zone->Size))
+	{
+		Zone = __atomic_load_n(&Zone->Next, __ATOMIC_ACQUIRE);
+	}
+	return Zone;
+}
+
+VkBuffer ZBuffer(void *Ptr, u8 Zoneid, VkDeviceSize *Offset)
+{
+	memzone_t *Page = ZFindPage(Ptr, Zoneid);
+	*Offset = (u8*)Ptr - (u8*)Page;
+	return Page->Buffer;
+}
+
 void ZFree(void *Ptr, u8 Zoneid)
 {
 	memblock_t *Block, *Other;
@@ -1540,7 +2732,7 @@ void ZFree(void *Ptr, u8 Zoneid)
 		return;
 	}
 
-	Zone = Mainzone[Zoneid];
+	Zone = ZFindPage(Ptr, Zoneid);
 	Block = (memblock_t *) ( (unsigned char *)Ptr - Zone->AlignedHeaderSize);
 #ifdef TINYENGINE_DEBUG
 	if (Block->Id != ZONEID)
@@ -1552,6 +2744,13 @@ void ZFree(void *Ptr, u8 Zoneid)
 		Warn("ZFree: freed a freed pointer zoneid: %d", Zoneid);
 	}
 #endif
+	ZoneCounters[Zoneid].Frees++;
+	ZoneCounters[Zoneid].Used -= Block->Size;
+	if(Zone->Mode == ZONE_TLSF)
+	{
+		TlsfFree(Zone, (tlsfblock_t*)Block);
+		return;
+	}
 	Block->Tag = 0;	// mark as free
 
 	Other = Block->Prev;
@@ -1624,20 +2823,29 @@ void *ZRealloc(void *Ptr, int Size, u8 Zoneid)
 	return Ptr;
 }
 
+//Grown pages are kept.
 void ZReset(u8 Zoneid)
 {
 	memblock_t *Block;
-	memzone_t *Zone = Mainzone[Zoneid];
-
-	for (Block = Zone->Blocklist.Next ; ; Block = Block->Next)
+	ZoneCounters[Zoneid].Used = 0;
+	for(memzone_t *Zone = Mainzone[Zoneid]; Zone; Zone = Zone->Next)
 	{
-		if (Block == &Zone->Blocklist)
+		if(Zone->Mode == ZONE_TLSF)
 		{
-			break;	// all blocks have been hit
+			ZInitTlsf(Zone, Zone->Size);
+			continue;
+		}
+
+		for (Block = Zone->Blocklist.Next ; ; Block = Block->Next)
+		{
+			if (Block == &Zone->Blocklist)
+			{
+				break;	// all blocks have been hit
+			}
+			Block->Prev->Next = NULL;
+			Block->Prev->Tag = 0;
+			Block->Prev->Size = 0;
 		}
-		Block->Prev->Next = NULL;
-		Block->Prev->Tag = 0;
-		Block->Prev->Size = 0;
 	}
 }
 
@@ -1654,14 +2862,24 @@ b32 IsPowerOfTwo(u32 N)
 	return 1; 
 } 
 
-void ZInitZone(void *Mem, u32 Size, u32 Align, u8 Zoneid)
+memzone_t *ZInitPage(void *Mem, u32 Size, u32 Align, u8 Mode)
 {
 	ASSERT(IsPowerOfTwo(Align), "Align must be ^2 is %d", Align);
 	memblock_t *Block;
 
 	memzone_t *Zone = (memzone_t*)Mem;
-	Mainzone[Zoneid] = Zone;
 	Zone->Align = Align;
+	Zone->Mode = Mode;
+	Zone->Tlsf = NULL;
+	Zone->Next = NULL;
+	Zone->Buffer = VK_NULL_HANDLE;
+	Zone->DeviceMemory = VK_NULL_HANDLE;
+	if(Zone->Mode == ZONE_TLSF)
+	{
+		ZInitTlsf(Zone, Size);
+		return Zone;
+	}
+	Zone->Size = Size;
 	Zone->AlignedHeaderSize = (sizeof(memblock_t) + (Align-1)) & -Align;
 	s32 ASize = (sizeof(memzone_t) + (Align-1)) & -Align;
 // set the entire zone to one free block
@@ -1681,133 +2899,753 @@ void ZInitZone(void *Mem, u32 Size, u32 Align, u8 Zoneid)
 	Block->Id = ZONEID;
 #endif	
 	Block->Size = Size - ASize;
+	return Zone;
 }
 
-void *VkAlloc(void *pusd, size_t size, size_t align, VkSystemAllocationScope allocationScope)
+void ZInitZone(void *Mem, u32 Size, u32 Align, u8 Zoneid)
 {
-	void* p = ZMalloc(size, 0);
-	ASSERT(p,"VkAlloc failed.");
-	return p;
+	Mainzone[Zoneid] = ZInitPage(Mem, Size, Align, ZoneModes[Zoneid]);
+	ZonePages[Zoneid] = 1;
+	memset(&ZoneCounters[Zoneid], 0, sizeof(zone_counters_t));
 }
 
-void *VkRealloc(void* pusd, void* porg, size_t size, size_t align, VkSystemAllocationScope allocationScope)
+//Retags a used block and stamps it with the current frame.
+void ZMark(void *Ptr, u8 Zoneid, s32 Tag)
 {
-	void* p = ZRealloc(porg, size, 0);
-	ASSERT(p,"VkRealloc failed.");
-	return p;
+	memblock_t *Block = (memblock_t*)((u8*)Ptr - Mainzone[Zoneid]->AlignedHeaderSize);
+	Block->Tag = Tag;
+	Block->Frame = (u32)FrameCount;
 }
 
-void VkFree(void *pusd, void *ptr)
+//Blocks of a page in address order, NULL past the last one.
+memblock_t *ZFirstBlock(memzone_t *Zone)
 {
-	ZFree(ptr, 0);
-	return;
+	if(Zone->Mode == ZONE_TLSF)
+	{
+		return (memblock_t*)TlsfFirstBlock(Zone);
+	}
+	return Zone->Blocklist.Next != &Zone->Blocklist ? Zone->Blocklist.Next : NULL;
 }
 
-//NOTE(Kyryl):
-//The reason we are storing shadermodules in global array
-//is so that we can easily iterate over them, and destroy when needed.
-void LoadShader(const char* Path)
+memblock_t *ZNextBlock(memzone_t *Zone, memblock_t *Block)
 {
-	ASSERT(ShaderCount < NUM_SHADERS, "Out of shader modules, Increase NUM_SHADERS");
-
-	s32 Size;
-	u8 *Buffer = Tiny_ReadFile(Path, &Size);
+	if(Zone->Mode == ZONE_TLSF)
+	{
+		//The end sentinel is the only block of size 0.
+		memblock_t *Next = (memblock_t*)((u8*)Block + Block->Size);
+		return Next->Size ? Next : NULL;
+	}
+	return Block->Next != &Zone->Blocklist ? Block->Next : NULL;
+}
 
-	VkShaderModuleCreateInfo ShaderModuleCI;
-	ShaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	ShaderModuleCI.pNext = NULL;
-	ShaderModuleCI.flags = 0;
-	ShaderModuleCI.codeSize = Size;
-	ShaderModuleCI.pCode = (const u32*)(Buffer);
+//Call with the zone's lock held, ZoneLock for 1..4 and VkHostLock for the
+//host allocator zones.
+void ZGetStats(u8 Zoneid, zone_stats_t *Stats)
+{
+	memset(Stats, 0, sizeof(zone_stats_t));
+	for(memzone_t *Page = Mainzone[Zoneid]; Page; Page = Page->Next)
+	{
+		Stats->Pages++;
+		Stats->Size += Page->Size;
+		for(memblock_t *Block = ZFirstBlock(Page); Block; Block = ZNextBlock(Page, Block))
+		{
+			if(!Block->Tag)
+			{
+				Stats->Free += Block->Size;
+				Stats->FreeBlocks++;
+				Stats->LargestFree = Max(Stats->LargestFree, (u32)Block->Size);
+				continue;
+			}
+			Stats->Used += Block->Size;
+			Stats->UsedBlocks++;
+			if(Block->Tag == ZTAG_ENTITY && (u32)FrameCount - Block->Frame > ZONE_STALE_FRAMES)
+			{
+				Stats->StaleBlocks++;
+			}
+		}
+	}
+	Stats->Fragmentation = Stats->Free ? 1.0f - (f32)Stats->LargestFree / (f32)Stats->Free : 0.0f;
+	Stats->Counters = ZoneCounters[Zoneid];
+}
 
-	VK_CHECK(vkCreateShaderModule(LogicalDevice, &ShaderModuleCI, 0, &VkShaderModules[ShaderCount]));
-	Tiny_Free(Buffer);
-	ShaderCount++;
+void ZDumpf(char *Text, u64 *Length, u64 Capacity, const char *Fmt, ...)
+{
+	va_list Args;
+	va_start(Args, Fmt);
+	s32 Written = stbsp_vsnprintf(Text + *Length, (s32)(Capacity - *Length), Fmt, Args);
+	va_end(Args);
+	*Length = Min(*Length + Written, Capacity - 1);
 }
 
-void LoadHexShader(const u32 *Buffer, u32 Size)
+//NOTE(Kyryl): Stats, then one line per block of every page: offset into
+//the page, size, tag and frames since ZMalloc or the last ZMark. Entity
+//blocks that keep aging belong to entities dropped without Tag = 2.
+//Same locking as ZGetStats.
+b32 ZDumpZone(u8 Zoneid, const char *Path)
 {
-	ASSERT(ShaderCount < NUM_SHADERS, "Out of shader modules, Increase NUM_SHADERS");
-	VkShaderModuleCreateInfo ShaderModuleCI;
-	ShaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	ShaderModuleCI.pNext = NULL;
-	ShaderModuleCI.flags = 0;
-	ShaderModuleCI.codeSize = Size;
-	ShaderModuleCI.pCode = Buffer;
+	const char *Tags[] = {"free", "used", "entity"};
+	zone_stats_t Stats;
+	ZGetStats(Zoneid, &Stats);
+	u64 Capacity = (u64)(Stats.UsedBlocks + Stats.FreeBlocks + Stats.Pages + 16) * 80;
+	char *Text = (char*)Tiny_Malloc(Capacity);
+	u64 Length = 0;
+
+	ZDumpf(Text, &Length, Capacity, "zone %d: %d pages, %llu bytes\n", Zoneid, Stats.Pages, Stats.Size);
+	ZDumpf(Text, &Length, Capacity, "used %llu bytes in %d blocks, high water %llu, %d stale\n",
+			Stats.Used, Stats.UsedBlocks, Stats.Counters.HighWater, Stats.StaleBlocks);
+	ZDumpf(Text, &Length, Capacity, "free %llu bytes in %d blocks, largest %d, fragmentation %.3f\n",
+			Stats.Free, Stats.FreeBlocks, Stats.LargestFree, Stats.Fragmentation);
+	ZDumpf(Text, &Length, Capacity, "allocs %llu, frees %llu, failures %llu\nwalks:",
+			Stats.Counters.Allocs, Stats.Counters.Frees, Stats.Counters.Failures);
+	for(u32 i = 0; i < NUM_WALK_BUCKETS; i++)
+	{
+		if(Stats.Counters.Walks[i])
+		{
+			ZDumpf(Text, &Length, Capacity, " %d+ %llu,", 1 << i, Stats.Counters.Walks[i]);
+		}
+	}
 
-	VK_CHECK(vkCreateShaderModule(LogicalDevice, &ShaderModuleCI, 0, &VkShaderModules[ShaderCount]));
-	ShaderCount++;
+	u32 PageIndex = 0;
+	for(memzone_t *Page = Mainzone[Zoneid]; Page; Page = Page->Next, PageIndex++)
+	{
+		ZDumpf(Text, &Length, Capacity, "\n\npage %d: %d bytes, buffer %p\n%10s %10s %8s %8s\n",
+				PageIndex, Page->Size, (void*)Page->Buffer, "offset", "size", "tag", "age");
+		for(memblock_t *Block = ZFirstBlock(Page); Block; Block = ZNextBlock(Page, Block))
+		{
+			u32 Tag = Min((u32)Block->Tag, ArrayCount(Tags) - 1);
+			ZDumpf(Text, &Length, Capacity, "%10d %10d %8s %8d\n", (s32)((u8*)Block - (u8*)Page), Block->Size,
+					Tags[Tag], Block->Tag ? (u32)FrameCount - Block->Frame : 0);
+		}
+	}
+
+	b32 Written = Tiny_WriteFile(Path, Text, Length);
+	Tiny_Free(Text);
+	if(!Written)
+	{
+		Warn("ZDumpZone: could not write %s", Path);
+	}
+	return Written;
 }
 
-void CreateShaderPipelines()
+//Takes effect on the next ZInitZone, zones 1..4 are set up by InitVulkan.
+void ZSetZoneMode(u8 Zoneid, u8 Mode)
 {
+	ASSERT(Mode <= ZONE_TLSF, "ZSetZoneMode: unknown mode %d", Mode);
+	ZoneModes[Zoneid] = Mode;
+}
 
-//TEMPLATE
+//Usage is for ZONE_GROW_BUFFER pages, the first page of a buffer zone
+//also needs its Buffer set.
+void ZSetZoneGrowth(u8 Zoneid, u8 Growth, VkBufferUsageFlags Usage)
+{
+	ASSERT(Growth <= ZONE_GROW_BUFFER, "ZSetZoneGrowth: unknown growth %d", Growth);
+	ZoneGrowth[Zoneid] = Growth;
+	ZoneUsage[Zoneid] = Usage;
+}
 
-	VkPipelineShaderStageCreateInfo ShaderStageCI[6];
-	ShaderStageCI[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[0].pNext = NULL;
-	ShaderStageCI[0].flags = 0;
-	ShaderStageCI[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-	ShaderStageCI[0].module = VK_NULL_HANDLE;
-	ShaderStageCI[0].pName = "main";
-	ShaderStageCI[0].pSpecializationInfo = NULL;
+//Grown buffer pages, the first page belongs to whoever made it.
+void ZDestroyPages(u8 Zoneid)
+{
+	for(memzone_t *Page = Mainzone[Zoneid]->Next; Page; Page = Page->Next)
+	{
+		vkDestroyBuffer(LogicalDevice, Page->Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, Page->DeviceMemory, VkAllocators);
+	}
+}
 
-	ShaderStageCI[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[1].pNext = NULL;
-	ShaderStageCI[1].flags = 0;
-	ShaderStageCI[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	ShaderStageCI[1].module = VK_NULL_HANDLE;
-	ShaderStageCI[1].pName = "main";
-	ShaderStageCI[1].pSpecializationInfo = NULL;
+#ifdef TINYENGINE_DEBUG
+#define ZONE_BENCH_SIZE (8 << 20)
+#define ZONE_BENCH_SLOTS 4096
+#define ZONE_BENCH_OPS 262144
+#define ZONE_BENCH_BATCH 64 //the timer is too coarse for single calls
+#define ZONE_BENCH_ZONE 9
 
-	ShaderStageCI[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[2].pNext = NULL;
-	ShaderStageCI[2].flags = 0;
-	ShaderStageCI[2].stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
-	ShaderStageCI[2].module = VK_NULL_HANDLE;
-	ShaderStageCI[2].pName = "main";
-	ShaderStageCI[2].pSpecializationInfo = NULL;
+int CompareLatency(const void *A, const void *B)
+{
+	f64 Diff = *(const f64*)A - *(const f64*)B;
+	return (Diff > 0) - (Diff < 0);
+}
 
-	ShaderStageCI[3].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[3].pNext = NULL;
-	ShaderStageCI[3].flags = 0;
-	ShaderStageCI[3].stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
-	ShaderStageCI[3].module = VK_NULL_HANDLE;
-	ShaderStageCI[3].pName = "main";
-	ShaderStageCI[3].pSpecializationInfo = NULL;
+//Same random alloc/free trace on both modes, logs ns per call percentiles.
+void ZoneBenchmark()
+{
+	static f64 Latencies[ZONE_BENCH_OPS / ZONE_BENCH_BATCH];
+	static void *Slots[ZONE_BENCH_SLOTS];
+	const char *Names[] = {"rover", "tlsf"};
+	u32 Count = ArrayCount(Latencies);
+	u8 OldMode = ZoneModes[ZONE_BENCH_ZONE];
+	void *Mem = Tiny_Malloc(ZONE_BENCH_SIZE);
+
+	for(u32 Mode = ZONE_ROVER; Mode <= ZONE_TLSF; Mode++)
+	{
+		ZoneModes[ZONE_BENCH_ZONE] = Mode;
+		ZInitZone(Mem, ZONE_BENCH_SIZE, 8, ZONE_BENCH_ZONE);
+		memset(Slots, 0, sizeof(Slots));
+		u32 Seed = 1234;
+		u32 Failed = 0;
 
-	ShaderStageCI[4].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[4].pNext = NULL;
-	ShaderStageCI[4].flags = 0;
-	ShaderStageCI[4].stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-	ShaderStageCI[4].module = VK_NULL_HANDLE;
-	ShaderStageCI[4].pName = "main";
-	ShaderStageCI[4].pSpecializationInfo = NULL;
+		for(u32 b = 0; b < Count; b++)
+		{
+			f64 Begin = Tiny_GetTime();
+			for(u32 i = 0; i < ZONE_BENCH_BATCH; i++)
+			{
+				Seed = Seed * 1664525 + 1013904223;
+				u32 Slot = (Seed >> 8) % ZONE_BENCH_SLOTS;
+				if(Slots[Slot])
+				{
+					ZFree(Slots[Slot], ZONE_BENCH_ZONE);
+					Slots[Slot] = NULL;
+				}
+				else
+				{
+					//Mostly small blocks with a tail, like entities and VkAlloc.
+					u32 Size = 16 << ((Seed >> 24) % 7);
+					Size += (Seed >> 4) % Size;
+					Slots[Slot] = ZMalloc(Size, ZONE_BENCH_ZONE);
+					Failed += !Slots[Slot];
+				}
+			}
+			Latencies[b] = (Tiny_GetTime() - Begin) * 1e9 / ZONE_BENCH_BATCH;
+		}
 
-	ShaderStageCI[5].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	ShaderStageCI[5].pNext = NULL;
-	ShaderStageCI[5].flags = 0;
-	ShaderStageCI[5].stage = VK_SHADER_STAGE_COMPUTE_BIT;
-	ShaderStageCI[5].module = VK_NULL_HANDLE;
-	ShaderStageCI[5].pName = "main";
-	ShaderStageCI[5].pSpecializationInfo = NULL;
+		zone_stats_t Stats;
+		ZGetStats(ZONE_BENCH_ZONE, &Stats);
+		Info("Zone %s: fragmentation %.3f, %d free blocks, high water %d bytes", Names[Mode],
+				Stats.Fragmentation, Stats.FreeBlocks, (s32)Stats.Counters.HighWater);
+		qsort(Latencies, Count, sizeof(f64), &CompareLatency);
+		Info("Zone %s: p50 %.0f ns, p90 %.0f ns, p99 %.0f ns, p99.9 %.0f ns, max %.0f ns, %d failed", Names[Mode],
+				Latencies[Count/2], Latencies[Count*9/10], Latencies[Count*99/100], Latencies[Count*999/1000], Latencies[Count-1], Failed);
+	}
 
-	VkPipelineInputAssemblyStateCreateInfo InputAssemblyCI;
-	InputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	InputAssemblyCI.pNext = NULL;
-	InputAssemblyCI.flags = 0;
-	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	InputAssemblyCI.primitiveRestartEnable = VK_FALSE;
+	Mainzone[ZONE_BENCH_ZONE] = NULL;
+	ZoneModes[ZONE_BENCH_ZONE] = OldMode;
+	Tiny_Free(Mem);
+}
+#endif
 
-	VkPipelineViewportStateCreateInfo ViewportState;
-	ViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	ViewportState.pNext = NULL;
-	ViewportState.flags = 0;
-	ViewportState.viewportCount = 1;
-	ViewportState.pViewports = NULL;
-	ViewportState.scissorCount = 1;
-	ViewportState.pScissors = NULL;
+void InitHostAllocator()
+{
+	ZInitZone(Tiny_Malloc(VK_HOST_ZONE_SIZE), VK_HOST_ZONE_SIZE, 8, VK_HOST_ZONE);
+	ZSetZoneGrowth(VK_HOST_ZONE, ZONE_GROW_HOST, 0);
+	ZSetZoneMode(VK_COMMAND_ZONE, ZONE_TLSF);
+	ZInitZone(Tiny_Malloc(VK_COMMAND_ZONE_SIZE), VK_COMMAND_ZONE_SIZE, 8, VK_COMMAND_ZONE);
+	ZSetZoneGrowth(VK_COMMAND_ZONE, ZONE_GROW_HOST, 0);
+	memset(HostCaches, 0, sizeof(HostCaches));
+	memset(&HostOverflowCache, 0, sizeof(HostOverflowCache));
+	memset(HostShared, 0, sizeof(HostShared));
+}
+
+//NOTE(Kyryl): Open addressed on the thread id. Slots given back by
+//VkHostThreadExit keep HOST_CACHE_RELEASED so the probe runs on to the first
+//never used slot, a thread that finds no slot of its own takes the first
+//released one on the way. Only the owner claims its id, a lost claim just
+//means another thread took that slot.
+host_cache_t *GetHostCache()
+{
+	u64 Thread = Tiny_GetThreadId();
+	u32 Start = (u32)((Thread * 0x9E3779B97F4A7C15ull) >> 32) % NUM_HOST_CACHES;
+	for(;;)
+	{
+		host_cache_t *Claim = NULL;
+		u64 ClaimOwner = 0;
+		for(u32 i = 0; i < NUM_HOST_CACHES; i++)
+		{
+			host_cache_t *Cache = &HostCaches[(Start + i) % NUM_HOST_CACHES];
+			u64 Owner = __atomic_load_n(&Cache->Thread, __ATOMIC_ACQUIRE);
+			if(Owner == Thread)
+			{
+				return Cache;
+			}
+			if(!Claim && (!Owner || Owner == HOST_CACHE_RELEASED))
+			{
+				Claim = Cache;
+				ClaimOwner = Owner;
+			}
+			if(!Owner)
+			{
+				break;
+			}
+		}
+		if(!Claim)
+		{
+			return NULL;
+		}
+		if(__atomic_compare_exchange_n(&Claim->Thread, &ClaimOwner, Thread, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			return Claim;
+		}
+	}
+}
+
+//NOTE(Kyryl): Call at the end of any thread that went through VkAlloc or
+//VkFree, before whatever tells the engine the thread is done. Cached blocks
+//go to the shared lists and the slot is free for the next thread.
+void VkHostThreadExit()
+{
+	u64 Thread = Tiny_GetThreadId();
+	u32 Start = (u32)((Thread * 0x9E3779B97F4A7C15ull) >> 32) % NUM_HOST_CACHES;
+	host_cache_t *Cache = NULL;
+	for(u32 i = 0; i < NUM_HOST_CACHES && !Cache; i++)
+	{
+		host_cache_t *Slot = &HostCaches[(Start + i) % NUM_HOST_CACHES];
+		u64 Owner = __atomic_load_n(&Slot->Thread, __ATOMIC_ACQUIRE);
+		if(!Owner)
+		{
+			break;
+		}
+		if(Owner == Thread)
+		{
+			Cache = Slot;
+		}
+	}
+	if(!Cache)
+	{
+		return;
+	}
+
+	Tiny_Lock(&VkHostLock);
+	for(u32 Arena = 0; Arena < NUM_HOST_ARENAS; Arena++)
+	{
+		for(u32 Class = 0; Class < NUM_HOST_CLASSES; Class++)
+		{
+			void **Free = &Cache->Free[Arena][Class];
+			void **Shared = &HostShared[Arena][Class];
+			while(*Free)
+			{
+				void *Block = *Free;
+				*Free = *(void**)Block;
+				*(void**)Block = *Shared;
+				*Shared = Block;
+			}
+			Cache->Count[Arena][Class] = 0;
+		}
+	}
+	Tiny_Unlock(&VkHostLock);
+	__atomic_store_n(&Cache->Thread, HOST_CACHE_RELEASED, __ATOMIC_RELEASE);
+}
+
+u32 HostClass(u32 Bytes)
+{
+	return Bytes <= (1u << HOST_MIN_CLASS_LOG2) ? 0 : 32 - __builtin_clz(Bytes - 1) - HOST_MIN_CLASS_LOG2;
+}
+
+//Shared list first, a fresh slab cut into blocks when that is empty.
+void HostRefill(host_cache_t *Cache, u32 Arena, u32 Class)
+{
+	u32 BlockSize = 1 << (Class + HOST_MIN_CLASS_LOG2);
+	u32 Limit = Max(HOST_CACHE_BYTES / BlockSize / 2, 1);
+	void **Free = &Cache->Free[Arena][Class];
+	u32 *Count = &Cache->Count[Arena][Class];
+
+	Tiny_Lock(&VkHostLock);
+	void **Shared = &HostShared[Arena][Class];
+	while(*Shared && *Count < Limit)
+	{
+		void *Block = *Shared;
+		*Shared = *(void**)Block;
+		*(void**)Block = *Free;
+		*Free = Block;
+		(*Count)++;
+	}
+	if(!*Count)
+	{
+		u8 *Slab = (u8*)ZMalloc(HOST_SLAB_SIZE + HOST_HEADER_SIZE, HostArenaZones[Arena]);
+		if(Slab)
+		{
+			Slab = (u8*)(((uintptr_t)Slab + HOST_HEADER_SIZE - 1) & ~(uintptr_t)(HOST_HEADER_SIZE - 1));
+			for(u32 i = 0; i < HOST_SLAB_SIZE / BlockSize; i++)
+			{
+				host_header_t *Header = (host_header_t*)(Slab + i * BlockSize);
+				Header->Class = Class;
+				Header->Arena = Arena;
+				Header->Offset = 0;
+				*(void**)(Header + 1) = *Free;
+				*Free = Header + 1;
+				(*Count)++;
+			}
+		}
+	}
+	Tiny_Unlock(&VkHostLock);
+}
+
+//Keeps half of HOST_CACHE_BYTES, the rest goes to the shared list for
+//threads that allocate what this one frees.
+void HostFlush(host_cache_t *Cache, u32 Arena, u32 Class)
+{
+	u32 BlockSize = 1 << (Class + HOST_MIN_CLASS_LOG2);
+	u32 Limit = HOST_CACHE_BYTES / BlockSize / 2;
+	void **Free = &Cache->Free[Arena][Class];
+	u32 *Count = &Cache->Count[Arena][Class];
+
+	Tiny_Lock(&VkHostLock);
+	void **Shared = &HostShared[Arena][Class];
+	while(*Count > Limit)
+	{
+		void *Block = *Free;
+		*Free = *(void**)Block;
+		*(void**)Block = *Shared;
+		*Shared = Block;
+		(*Count)--;
+	}
+	Tiny_Unlock(&VkHostLock);
+}
+
+void *HostAlloc(size_t Size, size_t Align, u32 Arena)
+{
+	Align = Max(Align, HOST_HEADER_SIZE);
+	if(Size + HOST_HEADER_SIZE <= HOST_MAX_SMALL && Align == HOST_HEADER_SIZE)
+	{
+		u32 Class = HostClass(Size + HOST_HEADER_SIZE);
+		host_cache_t *Cache = GetHostCache();
+		if(!Cache)
+		{
+			Tiny_Lock(&HostOverflowLock);
+			Cache = &HostOverflowCache;
+		}
+		if(!Cache->Free[Arena][Class])
+		{
+			HostRefill(Cache, Arena, Class);
+		}
+		void *Ptr = Cache->Free[Arena][Class];
+		if(Ptr)
+		{
+			Cache->Free[Arena][Class] = *(void**)Ptr;
+			Cache->Count[Arena][Class]--;
+			((host_header_t*)Ptr - 1)->Size = Size;
+		}
+		if(Cache == &HostOverflowCache)
+		{
+			Tiny_Unlock(&HostOverflowLock);
+		}
+		return Ptr;
+	}
+
+	Tiny_Lock(&VkHostLock);
+	u8 *Block = (u8*)ZMalloc(Size + HOST_HEADER_SIZE + Align - 1, HostArenaZones[Arena]);
+	Tiny_Unlock(&VkHostLock);
+	if(!Block)
+	{
+		return NULL;
+	}
+	u8 *Ptr = (u8*)(((uintptr_t)Block + HOST_HEADER_SIZE + Align - 1) & ~(uintptr_t)(Align - 1));
+	host_header_t *Header = (host_header_t*)Ptr - 1;
+	Header->Class = HOST_LARGE;
+	Header->Arena = Arena;
+	Header->Size = Size;
+	Header->Offset = Ptr - Block;
+	return Ptr;
+}
+
+void HostFree(void *Ptr)
+{
+	host_header_t *Header = (host_header_t*)Ptr - 1;
+	u32 Arena = Header->Arena;
+	u32 Class = Header->Class;
+	if(Class == HOST_LARGE)
+	{
+		Tiny_Lock(&VkHostLock);
+		ZFree((u8*)Ptr - Header->Offset, HostArenaZones[Arena]);
+		Tiny_Unlock(&VkHostLock);
+		return;
+	}
+
+	//Goes to the freeing thread's cache, whoever allocated it.
+	host_cache_t *Cache = GetHostCache();
+	if(!Cache)
+	{
+		Tiny_Lock(&HostOverflowLock);
+		Cache = &HostOverflowCache;
+	}
+	*(void**)Ptr = Cache->Free[Arena][Class];
+	Cache->Free[Arena][Class] = Ptr;
+	if(++Cache->Count[Arena][Class] << (Class + HOST_MIN_CLASS_LOG2) > HOST_CACHE_BYTES)
+	{
+		HostFlush(Cache, Arena, Class);
+	}
+	if(Cache == &HostOverflowCache)
+	{
+		Tiny_Unlock(&HostOverflowLock);
+	}
+}
+
+void *VkAlloc(void *pusd, size_t size, size_t align, VkSystemAllocationScope allocationScope)
+{
+	u32 Arena = allocationScope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND ? HOST_ARENA_COMMAND : HOST_ARENA_OBJECT;
+	void* p = HostAlloc(size, align, Arena);
+	ASSERT(p,"VkAlloc failed.");
+	return p;
+}
+
+//Stays in the arena of the original allocation.
+void *VkRealloc(void* pusd, void* porg, size_t size, size_t align, VkSystemAllocationScope allocationScope)
+{
+	if(!porg)
+	{
+		return VkAlloc(pusd, size, align, allocationScope);
+	}
+	if(!size)
+	{
+		HostFree(porg);
+		return NULL;
+	}
+	host_header_t *Header = (host_header_t*)porg - 1;
+	void* p = HostAlloc(size, align, Header->Arena);
+	ASSERT(p,"VkRealloc failed.");
+	memcpy(p, porg, Min(size, Header->Size));
+	HostFree(porg);
+	return p;
+}
+
+void VkFree(void *pusd, void *ptr)
+{
+	if(ptr)
+	{
+		HostFree(ptr);
+	}
+	return;
+}
+
+#ifdef TINYENGINE_DEBUG
+#define HOST_STRESS_THREADS 8
+#define HOST_STRESS_OPS 200000
+#define HOST_STRESS_SLOTS 256
+
+void *volatile HostStressMailbox[HOST_STRESS_THREADS]; //handed to the next thread to free
+volatile s32 HostStressErrors;
+volatile s32 HostStressRunning;
+
+//First u32 is the size, the rest a byte pattern from it.
+void HostStressFill(u8 *Ptr, u32 Size)
+{
+	*(u32*)Ptr = Size;
+	memset(Ptr + sizeof(u32), (u8)Size, Size - sizeof(u32));
+}
+
+b32 HostStressCheck(u8 *Ptr, u32 Size)
+{
+	if(*(u32*)Ptr != Size)
+	{
+		return false;
+	}
+	for(u32 i = sizeof(u32); i < Size; i++)
+	{
+		if(Ptr[i] != (u8)Size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void HostStressFree(u8 *Ptr)
+{
+	if(Ptr && !HostStressCheck(Ptr, *(u32*)Ptr))
+	{
+		__atomic_add_fetch(&HostStressErrors, 1, __ATOMIC_RELAXED);
+	}
+	VkFree(NULL, Ptr);
+}
+
+//Random alloc, realloc and free through the callbacks with mixed scopes
+//and alignments, every fourth free goes through another thread.
+void HostStressThread(void *Data)
+{
+	u32 Index = (u32)(uintptr_t)Data;
+	u8 *Slots[HOST_STRESS_SLOTS] = {0};
+	u32 Aligns[HOST_STRESS_SLOTS];
+	u32 Seed = Index * 7919 + 1;
+	u32 Errors = 0;
+
+	for(u32 i = 0; i < HOST_STRESS_OPS; i++)
+	{
+		Seed = Seed * 1664525 + 1013904223;
+		u32 Slot = (Seed >> 8) % HOST_STRESS_SLOTS;
+		//Mostly small blocks, one in 16 past HOST_MAX_SMALL.
+		u32 Size = (Seed >> 28) ? 4 + (Seed >> 4) % 600 : 4 + (Seed >> 4) % 8192;
+		if(!Slots[Slot])
+		{
+			VkSystemAllocationScope Scope = (Seed >> 16) % 5;
+			Aligns[Slot] = 1 << ((Seed >> 20) % 8);
+			Slots[Slot] = (u8*)VkAlloc(NULL, Size, Aligns[Slot], Scope);
+			Errors += ((uintptr_t)Slots[Slot] & (Aligns[Slot] - 1)) != 0;
+			HostStressFill(Slots[Slot], Size);
+		}
+		else if(((Seed >> 20) & 3) == 0)
+		{
+			u32 OldSize = *(u32*)Slots[Slot];
+			u8 *Ptr = (u8*)VkRealloc(NULL, Slots[Slot], Size, Aligns[Slot], VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+			Errors += ((uintptr_t)Ptr & (Aligns[Slot] - 1)) != 0;
+			Errors += *(u32*)Ptr != OldSize;
+			for(u32 j = sizeof(u32); j < Min(OldSize, Size); j++)
+			{
+				Errors += Ptr[j] != (u8)OldSize;
+			}
+			HostStressFill(Ptr, Size);
+			Slots[Slot] = Ptr;
+		}
+		else if(((Seed >> 20) & 3) == 1)
+		{
+			u8 *Old = (u8*)__atomic_exchange_n(&HostStressMailbox[(Index + 1) % HOST_STRESS_THREADS], Slots[Slot], __ATOMIC_ACQ_REL);
+			HostStressFree(Old);
+			Slots[Slot] = NULL;
+		}
+		else
+		{
+			HostStressFree(Slots[Slot]);
+			Slots[Slot] = NULL;
+		}
+
+		if(!(i & 63))
+		{
+			HostStressFree((u8*)__atomic_exchange_n(&HostStressMailbox[Index], NULL, __ATOMIC_ACQ_REL));
+		}
+	}
+
+	for(u32 i = 0; i < HOST_STRESS_SLOTS; i++)
+	{
+		HostStressFree(Slots[i]);
+	}
+	__atomic_add_fetch(&HostStressErrors, Errors, __ATOMIC_RELAXED);
+	VkHostThreadExit();
+	__atomic_sub_fetch(&HostStressRunning, 1, __ATOMIC_RELEASE);
+}
+
+//Logs the time and the number of blocks that came back misaligned or with
+//someone else's bytes in them.
+void HostAllocatorStress()
+{
+	if(!Mainzone[VK_HOST_ZONE])
+	{
+		InitHostAllocator();
+	}
+	HostStressErrors = 0;
+	HostStressRunning = HOST_STRESS_THREADS;
+	memset((void*)HostStressMailbox, 0, sizeof(HostStressMailbox));
+
+	f64 Begin = Tiny_GetTime();
+	for(u32 i = 0; i < HOST_STRESS_THREADS; i++)
+	{
+		ASSERT(Tiny_CreateThread(&HostStressThread, (void*)(uintptr_t)i), "HostAllocatorStress: failed to start thread %d", i);
+	}
+	while(__atomic_load_n(&HostStressRunning, __ATOMIC_ACQUIRE))
+	{
+		Tiny_Sleep(0.001);
+	}
+	f64 Time = Tiny_GetTime() - Begin;
+
+	for(u32 i = 0; i < HOST_STRESS_THREADS; i++)
+	{
+		HostStressFree((u8*)HostStressMailbox[i]);
+	}
+	Info("Host allocator: %d threads x %d ops in %.2f ms, %d errors", HOST_STRESS_THREADS, HOST_STRESS_OPS, Time * 1000, HostStressErrors);
+}
+#endif
+
+//NOTE(Kyryl):
+//The reason we are storing shadermodules in global array
+//is so that we can easily iterate over them, and destroy when needed.
+void LoadShader(const char* Path)
+{
+	ASSERT(ShaderCount < NUM_SHADERS, "Out of shader modules, Increase NUM_SHADERS");
+
+	s32 Size;
+	u8 *Buffer = Tiny_ReadFile(Path, &Size);
+
+	VkShaderModuleCreateInfo ShaderModuleCI;
+	ShaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ShaderModuleCI.pNext = NULL;
+	ShaderModuleCI.flags = 0;
+	ShaderModuleCI.codeSize = Size;
+	ShaderModuleCI.pCode = (const u32*)(Buffer);
+
+	VK_CHECK(vkCreateShaderModule(LogicalDevice, &ShaderModuleCI, 0, &VkShaderModules[ShaderCount]));
+	Tiny_Free(Buffer);
+	ShaderCount++;
+}
+
+void LoadHexShader(const u32 *Buffer, u32 Size)
+{
+	ASSERT(ShaderCount < NUM_SHADERS, "Out of shader modules, Increase NUM_SHADERS");
+	VkShaderModuleCreateInfo ShaderModuleCI;
+	ShaderModuleCI.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	ShaderModuleCI.pNext = NULL;
+	ShaderModuleCI.flags = 0;
+	ShaderModuleCI.codeSize = Size;
+	ShaderModuleCI.pCode = Buffer;
+
+	VK_CHECK(vkCreateShaderModule(LogicalDevice, &ShaderModuleCI, 0, &VkShaderModules[ShaderCount]));
+	ShaderCount++;
+}
+
+void CreateShaderPipelines()
+{
+
+//TEMPLATE
+
+	VkPipelineShaderStageCreateInfo ShaderStageCI[6];
+	ShaderStageCI[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[0].pNext = NULL;
+	ShaderStageCI[0].flags = 0;
+	ShaderStageCI[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	ShaderStageCI[0].module = VK_NULL_HANDLE;
+	ShaderStageCI[0].pName = "main";
+	ShaderStageCI[0].pSpecializationInfo = NULL;
+
+	ShaderStageCI[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[1].pNext = NULL;
+	ShaderStageCI[1].flags = 0;
+	ShaderStageCI[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	ShaderStageCI[1].module = VK_NULL_HANDLE;
+	ShaderStageCI[1].pName = "main";
+	ShaderStageCI[1].pSpecializationInfo = NULL;
+
+	ShaderStageCI[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[2].pNext = NULL;
+	ShaderStageCI[2].flags = 0;
+	ShaderStageCI[2].stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+	ShaderStageCI[2].module = VK_NULL_HANDLE;
+	ShaderStageCI[2].pName = "main";
+	ShaderStageCI[2].pSpecializationInfo = NULL;
+
+	ShaderStageCI[3].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[3].pNext = NULL;
+	ShaderStageCI[3].flags = 0;
+	ShaderStageCI[3].stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+	ShaderStageCI[3].module = VK_NULL_HANDLE;
+	ShaderStageCI[3].pName = "main";
+	ShaderStageCI[3].pSpecializationInfo = NULL;
+
+	ShaderStageCI[4].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[4].pNext = NULL;
+	ShaderStageCI[4].flags = 0;
+	ShaderStageCI[4].stage = VK_SHADER_STAGE_GEOMETRY_BIT;
+	ShaderStageCI[4].module = VK_NULL_HANDLE;
+	ShaderStageCI[4].pName = "main";
+	ShaderStageCI[4].pSpecializationInfo = NULL;
+
+	ShaderStageCI[5].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	ShaderStageCI[5].pNext = NULL;
+	ShaderStageCI[5].flags = 0;
+	ShaderStageCI[5].stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	ShaderStageCI[5].module = VK_NULL_HANDLE;
+	ShaderStageCI[5].pName = "main";
+	ShaderStageCI[5].pSpecializationInfo = NULL;
+
+	VkPipelineInputAssemblyStateCreateInfo InputAssemblyCI;
+	InputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	InputAssemblyCI.pNext = NULL;
+	InputAssemblyCI.flags = 0;
+	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	InputAssemblyCI.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo ViewportState;
+	ViewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	ViewportState.pNext = NULL;
+	ViewportState.flags = 0;
+	ViewportState.viewportCount = 1;
+	ViewportState.pViewports = NULL;
+	ViewportState.scissorCount = 1;
+	ViewportState.pScissors = NULL;
 
 	VkPipelineRasterizationStateCreateInfo RasterizationStateCI;
 	RasterizationStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -1816,1582 +3654,3435 @@ void CreateShaderPipelines()
 	RasterizationStateCI.depthClampEnable = VK_FALSE;
 	RasterizationStateCI.rasterizerDiscardEnable = VK_FALSE;
 	RasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-	RasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
-	RasterizationStateCI.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	RasterizationStateCI.depthBiasEnable = VK_FALSE;
-	RasterizationStateCI.depthBiasConstantFactor = 0.0f;
-	RasterizationStateCI.depthBiasClamp = 0.0f;
-	RasterizationStateCI.depthBiasSlopeFactor = 0.0f;
-	RasterizationStateCI.lineWidth = 1.0f;
+	RasterizationStateCI.cullMode = VK_CULL_MODE_NONE;
+	RasterizationStateCI.frontFace = VK_FRONT_FACE_CLOCKWISE;
+	RasterizationStateCI.depthBiasEnable = VK_FALSE;
+	RasterizationStateCI.depthBiasConstantFactor = 0.0f;
+	RasterizationStateCI.depthBiasClamp = 0.0f;
+	RasterizationStateCI.depthBiasSlopeFactor = 0.0f;
+	RasterizationStateCI.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo MultisampleStateCI;
+	MultisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	MultisampleStateCI.pNext = NULL;
+	MultisampleStateCI.flags = 0;
+	MultisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+	MultisampleStateCI.sampleShadingEnable = VK_FALSE;
+	MultisampleStateCI.minSampleShading = 0.0f;
+	MultisampleStateCI.pSampleMask = NULL;
+	MultisampleStateCI.alphaToCoverageEnable = VK_FALSE;
+	MultisampleStateCI.alphaToOneEnable = VK_FALSE;
+
+	VkPipelineDepthStencilStateCreateInfo DepthStensilStateCI;
+	DepthStensilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	DepthStensilStateCI.pNext = NULL;
+	DepthStensilStateCI.flags = 0;
+
+	VkPipelineColorBlendAttachmentState ColorBlendAttachment;
+	ColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo ColorBlendStateCI;
+	ColorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	ColorBlendStateCI.pNext = NULL;
+	ColorBlendStateCI.flags = 0;
+	ColorBlendStateCI.attachmentCount = 1;
+	ColorBlendStateCI.pAttachments = &ColorBlendAttachment;
+	ColorBlendStateCI.logicOpEnable = VK_FALSE;
+	ColorBlendStateCI.logicOp = VK_LOGIC_OP_COPY;
+	ColorBlendStateCI.attachmentCount = 1;
+	ColorBlendStateCI.blendConstants[0] = 1.0f;
+	ColorBlendStateCI.blendConstants[1] = 1.0f;
+	ColorBlendStateCI.blendConstants[2] = 1.0f;
+	ColorBlendStateCI.blendConstants[3] = 1.0f;
+
+	VkStencilOpState sos = {0};
+	DepthStensilStateCI.depthTestEnable = VK_TRUE;
+	DepthStensilStateCI.depthWriteEnable = VK_TRUE;
+	DepthStensilStateCI.depthCompareOp = VK_COMPARE_OP_LESS;
+	DepthStensilStateCI.depthBoundsTestEnable = VK_FALSE;
+	DepthStensilStateCI.stencilTestEnable = VK_FALSE;
+	DepthStensilStateCI.front = sos;
+	DepthStensilStateCI.back = sos;
+	DepthStensilStateCI.minDepthBounds = 0.0f;
+	DepthStensilStateCI.maxDepthBounds = 0.0f;
+
+	ColorBlendAttachment.blendEnable = VK_FALSE;
+	ColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	ColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkDynamicState DynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo PipelineDynamicStateCI;
+	PipelineDynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	PipelineDynamicStateCI.pNext = NULL;
+	PipelineDynamicStateCI.flags = 0;
+	PipelineDynamicStateCI.dynamicStateCount = ArrayCount(DynamicStates);
+	PipelineDynamicStateCI.pDynamicStates = DynamicStates;
+
+	VkVertexInputBindingDescription VertexInputBD[1]; 
+	VertexInputBD[0].binding = 0;
+	VertexInputBD[0].stride = sizeof(vertex_t);
+	VertexInputBD[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	VkVertexInputAttributeDescription VertexInputAD[3];
+	VertexInputAD[0].binding = 0;
+	VertexInputAD[0].location = 0;
+	VertexInputAD[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	VertexInputAD[0].offset = offsetof(vertex_t, Xyz);
+	VertexInputAD[1].binding = 0;
+	VertexInputAD[1].location = 1;
+	VertexInputAD[1].format = VK_FORMAT_R32G32_SFLOAT;
+	VertexInputAD[1].offset = offsetof(vertex_t, UVs);
+	VertexInputAD[2].binding = 0;
+	VertexInputAD[2].location = 2;
+	VertexInputAD[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+	VertexInputAD[2].offset = offsetof(vertex_t, Normals);
+
+	//instanced, binding 0 as above plus instance_t at binding 1
+	VkVertexInputBindingDescription InstanceInputBD[2];
+	InstanceInputBD[0] = VertexInputBD[0];
+	InstanceInputBD[1].binding = 1;
+	InstanceInputBD[1].stride = sizeof(instance_t);
+	InstanceInputBD[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	VkVertexInputAttributeDescription InstanceInputAD[7];
+	InstanceInputAD[0] = VertexInputAD[0];
+	InstanceInputAD[1] = VertexInputAD[1];
+	InstanceInputAD[2] = VertexInputAD[2];
+	InstanceInputAD[3].binding = 1;
+	InstanceInputAD[3].location = 3;
+	InstanceInputAD[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	InstanceInputAD[3].offset = offsetof(instance_t, Transform);
+	InstanceInputAD[4].binding = 1;
+	InstanceInputAD[4].location = 4;
+	InstanceInputAD[4].format = VK_FORMAT_R32G32_SFLOAT;
+	InstanceInputAD[4].offset = offsetof(instance_t, Offset);
+	InstanceInputAD[5].binding = 1;
+	InstanceInputAD[5].location = 5;
+	InstanceInputAD[5].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	InstanceInputAD[5].offset = offsetof(instance_t, Color);
+	InstanceInputAD[6].binding = 1;
+	InstanceInputAD[6].location = 6;
+	InstanceInputAD[6].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	InstanceInputAD[6].offset = offsetof(instance_t, UVRect);
+
+	//packed formats, binding 0 only
+	VkVertexInputBindingDescription PackedInputBD[2];
+	VkVertexInputAttributeDescription PackedInputAD[2][3];
+	for(u32 i = 0; i < 2; i++)
+	{
+		u32 Format = VERTEX_PACKED + i;
+		PackedInputBD[i] = VertexInputBD[0];
+		PackedInputBD[i].stride = VertexStrides[Format];
+		PackedInputAD[i][0] = VertexInputAD[0];
+		PackedInputAD[i][0].format = Format == VERTEX_PACKED ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R16G16_SFLOAT;
+		PackedInputAD[i][0].offset = 0;
+		PackedInputAD[i][1] = VertexInputAD[1];
+		PackedInputAD[i][1].format = VK_FORMAT_R16G16_UNORM;
+		PackedInputAD[i][1].offset = Format == VERTEX_PACKED ? offsetof(vertex_packed_t, UVs) : offsetof(vertex_packed2d_t, UVs);
+		PackedInputAD[i][2] = VertexInputAD[2];
+		PackedInputAD[i][2].format = VK_FORMAT_R8G8B8A8_UNORM;
+		PackedInputAD[i][2].offset = Format == VERTEX_PACKED ? offsetof(vertex_packed_t, Color) : offsetof(vertex_packed2d_t, Color);
+	}
+
+	//0 vertex_t, 1 instanced, 2 + i packed formats, 4 pulled
+	VkPipelineVertexInputStateCreateInfo VertexInputStateCI[5];
+	VertexInputStateCI[0].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	VertexInputStateCI[0].pNext = NULL;
+	VertexInputStateCI[0].flags = 0;
+	VertexInputStateCI[0].vertexBindingDescriptionCount = 1;
+	VertexInputStateCI[0].vertexAttributeDescriptionCount = 3;
+	VertexInputStateCI[0].pVertexBindingDescriptions = VertexInputBD;
+	VertexInputStateCI[0].pVertexAttributeDescriptions = &VertexInputAD[0];
+	VertexInputStateCI[1].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	VertexInputStateCI[1].pNext = NULL;
+	VertexInputStateCI[1].flags = 0;
+	VertexInputStateCI[1].vertexBindingDescriptionCount = ArrayCount(InstanceInputBD);
+	VertexInputStateCI[1].vertexAttributeDescriptionCount = ArrayCount(InstanceInputAD);
+	VertexInputStateCI[1].pVertexBindingDescriptions = InstanceInputBD;
+	VertexInputStateCI[1].pVertexAttributeDescriptions = &InstanceInputAD[0];
+	for(u32 i = 0; i < 2; i++)
+	{
+		VertexInputStateCI[2 + i] = VertexInputStateCI[0];
+		VertexInputStateCI[2 + i].pVertexBindingDescriptions = &PackedInputBD[i];
+		VertexInputStateCI[2 + i].pVertexAttributeDescriptions = &PackedInputAD[i][0];
+	}
+	VertexInputStateCI[4] = VertexInputStateCI[0];
+	VertexInputStateCI[4].vertexBindingDescriptionCount = 0;
+	VertexInputStateCI[4].vertexAttributeDescriptionCount = 0;
+	VertexInputStateCI[4].pVertexBindingDescriptions = NULL;
+	VertexInputStateCI[4].pVertexAttributeDescriptions = NULL;
+
+	VkGraphicsPipelineCreateInfo PipelineCI;
+	PipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	PipelineCI.pNext = NULL;
+	PipelineCI.flags = 0;
+	PipelineCI.stageCount = ArrayCount(ShaderStageCI);
+	PipelineCI.pStages = ShaderStageCI;
+	PipelineCI.pVertexInputState = &VertexInputStateCI[0];
+	PipelineCI.pInputAssemblyState = &InputAssemblyCI;
+	PipelineCI.pTessellationState = NULL;
+	PipelineCI.pViewportState = &ViewportState;
+	PipelineCI.pRasterizationState = &RasterizationStateCI;
+	PipelineCI.pMultisampleState = &MultisampleStateCI;
+	PipelineCI.pDepthStencilState = &DepthStensilStateCI;
+	PipelineCI.pColorBlendState = &ColorBlendStateCI;
+	PipelineCI.pDynamicState = &PipelineDynamicStateCI;
+	PipelineCI.layout = VkPipelineLayouts[0];
+	PipelineCI.renderPass = VkRenderPasses[0];
+	PipelineCI.subpass = 0;
+	PipelineCI.basePipelineHandle = 0;
+	PipelineCI.basePipelineIndex = 0;
+
+//TEMPLATE
+
+	//These asserts tell you what is what.
+	ASSERT(VkShaderModules[0], "Failed to load Basic Vertex Shader.");
+	ASSERT(VkShaderModules[1], "Failed to load Basic Fragment Shader.");
+	ASSERT(VkShaderModules[2], "Failed to load Sampler Fragment Shader.");
+	ASSERT(VkShaderModules[3], "Failed to load Lightning Fragment Shader.");
+	ASSERT(VkShaderModules[4], "Failed to load Instanced Vertex Shader.");
+	ASSERT(VkShaderModules[5], "Failed to load Pulled Vertex Shader.");
+
+	//basic pipeline
+	ShaderStageCI[0].module = VkShaderModules[0];
+	ShaderStageCI[1].module = VkShaderModules[1];
+	PipelineCI.stageCount = 2;
+	PipelineCI.layout = VkPipelineLayouts[0];
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[0]));
+
+	//line draw pipeline
+	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+	RasterizationStateCI.polygonMode = VK_POLYGON_MODE_LINE;
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[1]));
+
+	//sampler pipeline
+	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	RasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
+	ShaderStageCI[0].module = VkShaderModules[0];
+	ShaderStageCI[1].module = VkShaderModules[2];
+	PipelineCI.layout = VkPipelineLayouts[1];
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[2]));
+
+	//alpha blend texture pipeline
+	ShaderStageCI[0].module = VkShaderModules[0];
+	ShaderStageCI[1].module = VkShaderModules[2];
+	PipelineCI.layout = VkPipelineLayouts[1];
+	ColorBlendAttachment.blendEnable = VK_TRUE;
+	DepthStensilStateCI.depthTestEnable = VK_FALSE; //disable depth so 2d images only.
+	DepthStensilStateCI.depthWriteEnable = VK_FALSE;
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[3]));
+
+	//lightning pipeline
+	ShaderStageCI[0].module = VkShaderModules[0];
+	ShaderStageCI[1].module = VkShaderModules[3];
+	PipelineCI.layout = VkPipelineLayouts[2];
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[4]));
+
+	//instanced basic pipeline
+	PipelineCI.pVertexInputState = &VertexInputStateCI[1];
+	ShaderStageCI[0].module = VkShaderModules[4];
+	ShaderStageCI[1].module = VkShaderModules[1];
+	PipelineCI.layout = VkPipelineLayouts[0];
+	ColorBlendAttachment.blendEnable = VK_FALSE;
+	DepthStensilStateCI.depthTestEnable = VK_TRUE;
+	DepthStensilStateCI.depthWriteEnable = VK_TRUE;
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[5]));
+
+	//instanced sampler pipeline
+	ShaderStageCI[1].module = VkShaderModules[2];
+	PipelineCI.layout = VkPipelineLayouts[1];
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[6]));
+
+	//instanced alpha blend texture pipeline
+	ColorBlendAttachment.blendEnable = VK_TRUE;
+	DepthStensilStateCI.depthTestEnable = VK_FALSE;
+	DepthStensilStateCI.depthWriteEnable = VK_FALSE;
+	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[7]));
+
+	//packed vertex variants of pipelines 0..4, same state otherwise
+	for(u32 Format = VERTEX_PACKED; Format < NUM_VERTEX_FORMATS; Format++)
+	{
+		PipelineCI.pVertexInputState = &VertexInputStateCI[2 + Format - VERTEX_PACKED];
+		for(u32 Base = 0; Base < NUM_VERTEX_PIPELINES; Base++)
+		{
+			b32 Line = Base == 1;
+			b32 Blend = Base >= 3; //lightning shares the blend state of 3
+			InputAssemblyCI.topology = Line ? VK_PRIMITIVE_TOPOLOGY_LINE_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			RasterizationStateCI.polygonMode = Line ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+			ShaderStageCI[0].module = VkShaderModules[0];
+			ShaderStageCI[1].module = VkShaderModules[Base < 2 ? 1 : Base == 4 ? 3 : 2];
+			PipelineCI.layout = VkPipelineLayouts[Base < 2 ? 0 : Base == 4 ? 2 : 1];
+			ColorBlendAttachment.blendEnable = Blend ? VK_TRUE : VK_FALSE;
+			DepthStensilStateCI.depthTestEnable = Blend ? VK_FALSE : VK_TRUE;
+			DepthStensilStateCI.depthWriteEnable = Blend ? VK_FALSE : VK_TRUE;
+			VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[VERTEX_PIPELINE(Base, Format)]));
+		}
+	}
+
+	//vertex pulling variants of pipelines 0..4
+	PipelineCI.pVertexInputState = &VertexInputStateCI[4];
+	PipelineCI.layout = VkPipelineLayouts[PULLED_LAYOUT];
+	ShaderStageCI[0].module = VkShaderModules[5];
+	for(u32 Base = 0; Base < NUM_VERTEX_PIPELINES; Base++)
+	{
+		b32 Line = Base == 1;
+		b32 Blend = Base >= 3;
+		InputAssemblyCI.topology = Line ? VK_PRIMITIVE_TOPOLOGY_LINE_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		RasterizationStateCI.polygonMode = Line ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+		ShaderStageCI[1].module = VkShaderModules[Base < 2 ? 1 : Base == 4 ? 3 : 2];
+		ColorBlendAttachment.blendEnable = Blend ? VK_TRUE : VK_FALSE;
+		DepthStensilStateCI.depthTestEnable = Blend ? VK_FALSE : VK_TRUE;
+		DepthStensilStateCI.depthWriteEnable = Blend ? VK_FALSE : VK_TRUE;
+		VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[PULLED_PIPELINE(Base)]));
+	}
+
+	return;
+}
+
+
+#ifdef TINYENGINE_DEBUG
+
+VkBool32 VKAPI_CALL DebugReportCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, u64 object, size_t location, s32 messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
+{
+	// This silences warnings like "For optimal performance image layout should be VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL instead of GENERAL."
+	// We'll assume other performance warnings are also not useful.
+	if (flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
+		return VK_FALSE;
+
+	const char* type =
+	    (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+	    ? "ERROR"
+	    : (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
+	    ? "WARNING"
+	    : "INFO";
+
+	char message[4096];
+	stbsp_sprintf(message, "%s: %s\n", type, pMessage);
+
+	Fatal("%s", message);
+
+	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
+		Info("Validation error encountered!");
+
+	if(flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
+		return VK_FALSE;
+
+
+	ASSERT(0,"");
+	return VK_FALSE;
+}
+
+b32 CheckValidationLayerSupport(const char** DebugLayers, s32 ReqCount)
+{
+	u32 LayerCount;
+	vkEnumerateInstanceLayerProperties(&LayerCount, NULL);
+
+	VkLayerProperties AvailableLayers[LayerCount];
+	vkEnumerateInstanceLayerProperties(&LayerCount, &AvailableLayers[0]);
+
+	for(s32 i = 0; i<ReqCount; i++)
+	{
+		b32 LayerFound = false;
+		for (u32 z = 0; z<LayerCount; z++)
+		{
+			if (strcmp(DebugLayers[i], (char*) &AvailableLayers[z]) == 0)
+			{
+				LayerFound = true;
+				break;
+			}
+		}
+		if (!LayerFound)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void RegisterDebugCallback()
+{
+	if(vkCreateDebugReportCallbackEXT)
+	{
+		VkDebugReportCallbackCreateInfoEXT DebugReportCallbackCI;
+		DebugReportCallbackCI.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
+		DebugReportCallbackCI.pNext = NULL;
+		DebugReportCallbackCI.flags = VK_DEBUG_REPORT_WARNING_BIT_EXT |
+			VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
+			VK_DEBUG_REPORT_ERROR_BIT_EXT;
+		DebugReportCallbackCI.pfnCallback = DebugReportCallback;
+		DebugReportCallbackCI.pUserData = NULL;
+
+		VK_CHECK(vkCreateDebugReportCallbackEXT(Instance, &DebugReportCallbackCI, 0, &VulkanDebugCallback));
+	}
+}
+
+#endif
+
+//Only raises a flag, safe to call from the platform event thread.
+void VkRequestSwapchainRebuild()
+{
+	f64 Now = Tiny_GetTime();
+	__atomic_store(&SwapchainDirtyTime, &Now, __ATOMIC_RELAXED);
+	__atomic_store_n(&SwapchainDirty, true, __ATOMIC_RELEASE);
+}
+
+//NOTE(Kyryl): No vkDeviceWaitIdle, everything the frames in flight
+//may still touch goes through the deferred queue.
+void RebuildRenderer()
+{
+	u32 i;
+	SwapchainRebuilds++;
+
+	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GpuDevice, VkSurface, &SurfaceCapabilities));
+	SwchImageSize = SurfaceCapabilities.currentExtent;
+
+	if(SwchImageSize.width == 0 || SwchImageSize.height == 0)
+	{
+		return; //if window is minimized.
+	}
+
+	__atomic_store_n(&SwapchainDirty, false, __ATOMIC_RELEASE);
+	PresentationMode = ChoosePresentMode();
+
+	//Ask for enough images to keep every frame slot, the present mode may
+	//otherwise hand back fewer than PostInit sized things for.
+	SwchMinImageCount = Max(SwchMinImageCount, FrameSlotCount + 1);
+	if(SurfaceCapabilities.maxImageCount > 0)
+	{
+		SwchMinImageCount = Min(SwchMinImageCount, SurfaceCapabilities.maxImageCount);
+	}
+
+	VkSwapchains[1] = VkSwapchains[0];
+	VkSwapchains[0] = VK_NULL_HANDLE;
+
+    	CreateSwapchain(&VkSwapchains[0], &VkSwapchains[1]);
+
+	u32 ImageCount = 0;
+	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, NULL));
+	ASSERT(ImageCount, "Failed to get swapchain image count.");
+	ASSERT(ImageCount <= NUM_FRAMEBUFFERS, "Too many swapchain images, increase NUM_FRAMEBUFFERS");
+
+	ASSERT(VkSwchImages, "Swapchain images unallocated.");
+
+	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, &VkSwchImages[0]));
+
+	//Delete incompatible objects.
+	for(i = 0; i<SwchImageCount; i++)
+	{
+		VkDeferDestroyImageView(VkSwchImageViews[i]);
+		VkDeferDestroyFramebuffer(VkFramebuffers[i]);
+	}
+
+	//Count may change with the present mode. Never more frames in flight
+	//than images to present them, nor than the slots PostInit made.
+	//Slots past the new count keep their fences, so
+	//VkGetCompletedValue and VkWaitValue still scan all FrameSlotCount.
+	SwchImageCount = ImageCount;
+	MAX_FRAMES_IN_FLIGHT = Max(Min(FrameSlotCount, SwchImageCount - 1), 1);
+	Info("Swapchain: %d images, present mode %s", SwchImageCount, GetPresentModeString(PresentationMode));
+
+	CreateSwapchainImageViews();
+	CreateDepthBuffer();
+	CreateSwchFrameBuffers();
+
+}
+
+void DeInitVulkan()
+{
+	u32 i;
+	VK_CHECK(vkDeviceWaitIdle(LogicalDevice));
+	//Before the zones backing them are gone.
+	CollectDeferredFrees(true);
+#ifdef TINYENGINE_DEBUG
+	Info("Swapchain: %d rebuilds, %d stalled frames, worst %.2f ms", SwapchainRebuilds, StalledFrames, RebuildTimeMax * 1000);
+	vkDestroyQueryPool(LogicalDevice, QueryPool, VkAllocators);
+	if(VulkanDebugCallback != VK_NULL_HANDLE)
+	{
+		vkDestroyDebugReportCallbackEXT(Instance, VulkanDebugCallback, VkAllocators);
+	}
+#endif
+	vkFreeCommandBuffers(LogicalDevice, VkCommandPools[0], NUM_COMMAND_BUFFERS, &VkCommandBuffers[0]);
+	DestroyDepthBuffer();
+	for(i = 0; i<SwchImageCount; i++)
+	{
+		vkDestroyImageView(LogicalDevice, VkSwchImageViews[i], VkAllocators);
+	}
+	for(i = 0; i < SwchImageCount; i++)
+	{
+		vkDestroyFramebuffer(LogicalDevice, VkFramebuffers[i], VkAllocators);
+	}
+	for(i = 1; i <= 4; i++)
+	{
+		ZDestroyPages(i);
+	}
+	for(i = 0; VertexBuffers[i].Buffer != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyBuffer(LogicalDevice, VertexBuffers[i].Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, VertexBuffers[i].DeviceMemory, VkAllocators);
+	}
+	for(i = 0; UniformBuffers[i].Buffer != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyBuffer(LogicalDevice, UniformBuffers[i].Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, UniformBuffers[i].DeviceMemory, VkAllocators);
+	}
+	for(i = 0; IndexBuffers[i].Buffer != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyBuffer(LogicalDevice, IndexBuffers[i].Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, IndexBuffers[i].DeviceMemory, VkAllocators);
+	}
+	for(i = 0; IndirectBuffers[i].Buffer != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyBuffer(LogicalDevice, IndirectBuffers[i].Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, IndirectBuffers[i].DeviceMemory, VkAllocators);
+	}
+	vkDestroyBuffer(LogicalDevice, SpriteVertexBuffer.Buffer, VkAllocators);
+	vkFreeMemory(LogicalDevice, SpriteVertexBuffer.DeviceMemory, VkAllocators);
+	vkDestroyBuffer(LogicalDevice, SpriteIndexBuffer.Buffer, VkAllocators);
+	vkFreeMemory(LogicalDevice, SpriteIndexBuffer.DeviceMemory, VkAllocators);
+	vkDestroyBuffer(LogicalDevice, FrameRing.Buffer, VkAllocators);
+	vkFreeMemory(LogicalDevice, FrameRing.DeviceMemory, VkAllocators);
+	for(i = 0; i < NUM_STAGING_BUFFERS; i++)
+	{
+		vkDestroyBuffer(LogicalDevice, StagingBuffers[i].Buffer, VkAllocators);
+		vkFreeMemory(LogicalDevice, StagingBuffers[i].DeviceMemory, VkAllocators);
+	}
+	for(i = 0; i < NUM_COMMAND_POOLS; i++)
+	{
+		vkDestroyCommandPool(LogicalDevice, VkCommandPools[i], VkAllocators);
+	}
+	for(i = 0; i < NUM_FENCES; i++)
+	{
+		for(u32 j = 0; j < NUM_RECORD_THREADS; j++)
+		{
+			//Frees its buffer too.
+			vkDestroyCommandPool(LogicalDevice, VkFramePools[i][j], VkAllocators);
+		}
+	}
+	for(i = 0; i < TextureCount; i++)
+	{
+		vkFreeMemory(LogicalDevice, TexturePool[i].DeviceMemory, VkAllocators);
+		vkDestroyImage(LogicalDevice, TexturePool[i].Image, VkAllocators);
+		vkDestroyImageView(LogicalDevice, TexturePool[i].ImageView, VkAllocators);
+	}
+	for(i = 0; i < NUM_SEMAPHORES; i++)
+	{
+		vkDestroySemaphore(LogicalDevice, VkWaitSemaphores[i], VkAllocators);
+		vkDestroySemaphore(LogicalDevice, VkSignalSemaphores[i], VkAllocators);
+	}
+	for(i = 0; i < NUM_FENCES; i++)
+	{
+		vkDestroyFence(LogicalDevice, VkFences[i], VkAllocators);
+	}
+	if(TimelineSemaphore != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(LogicalDevice, TimelineSemaphore, VkAllocators);
+	}
+	for(i = 0; VkShaderModules[i] != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyShaderModule(LogicalDevice, VkShaderModules[i], VkAllocators);
+	}
+	for(i = 0; VkPipelines[i] != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyPipeline(LogicalDevice, VkPipelines[i], VkAllocators);
+	}
+	for(i = 0; VkPipelineLayouts[i] != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyPipelineLayout(LogicalDevice, VkPipelineLayouts[i], VkAllocators);
+	}
+	for(i = 0; VkRenderPasses[i] != VK_NULL_HANDLE; i++)
+	{
+		vkDestroyRenderPass(LogicalDevice, VkRenderPasses[i], VkAllocators);
+	}
+	for(i = 0; DeviceHeapCount; i++)
+	{
+		VkDeviceFree(i, DeviceHeaps[i].DeviceMemory);
+	}
+
+	vkDestroyDescriptorPool(LogicalDevice, DescriptorPool, VkAllocators);
+	vkDestroyDescriptorSetLayout(LogicalDevice, VertUniformDescriptorSetLayout, VkAllocators);
+	vkDestroyDescriptorSetLayout(LogicalDevice, FragUniformDescriptorSetLayout, VkAllocators);
+	vkDestroyDescriptorSetLayout(LogicalDevice, FragSamplerDescriptorSetLayout, VkAllocators);
+	vkDestroyDescriptorSetLayout(LogicalDevice, GeometryDescriptorSetLayout, VkAllocators);
+	vkDestroySampler(LogicalDevice, PointSampler, VkAllocators);
+	vkDestroySwapchainKHR(LogicalDevice, VkSwapchains[0], VkAllocators);
+	vkDestroySurfaceKHR(Instance, VkSurface, VkAllocators);
+	vkDestroyDevice(LogicalDevice, VkAllocators);
+	vkDestroyInstance(Instance, VkAllocators);
+}
+
+b32 IsDeviceExtensionSupported(const char *Name)
+{
+	for(u32 i = 0; i < DeviceExtPropCount; i++)
+	{
+		if(!strcmp(Name, VkDeviceExtensionProperties[i].extensionName))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+b32 InitVulkan(PFN_vkGetInstanceProcAddr *GetProcAddr, u32 ReqExCount, const char **RequiredExtensions)
+{
+	u32 i;
+
+	if(!GetProcAddr || !RequiredExtensions || !ReqExCount)
+	{
+		return false;
+	}
+	vkGetInstanceProcAddr = *GetProcAddr;
+
+	#define GLOBAL_LEVEL_VULKAN_FUNCTION( name )				\
+    	name = (PFN_##name) (vkGetInstanceProcAddr(NULL, #name));	\
+    	if(name == NULL)							\
+      	{									\
+		Fatal("Could not load global Vulkan function: %s", #name);	\
+		return false;							\
+      	}else								\
+      	{Info("Loaded global Vulkan function: %s", #name);}	\
+
+	#define TINY_VULKAN_UPDATE
+	#include "tiny_vulkan.h"
+
+	u32 ExtensionCount;
+	VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &ExtensionCount, NULL));
+	VkExtensionProperties InstanceExtensions[ExtensionCount];
+	VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &ExtensionCount, &InstanceExtensions[0]));
+
+	for(u32 c = 0; c < ReqExCount; c++)
+	{
+		for(i = 0; i<ExtensionCount; i++)
+		{
+			if(strstr((char*)&InstanceExtensions[i], RequiredExtensions[c]))
+			{
+				Info("Using instance extension: %s ", RequiredExtensions[c]);
+				goto _continue;
+			}
+		}
+		Debug("Available Extensions: ");
+		for(i = 0; i<ExtensionCount; i++)
+		{
+			Debug("%s", (char*)&InstanceExtensions[i]);
+		}
+		Fatal("Extension %s  is not supported!", RequiredExtensions[c]);
+		return false;
+_continue:;
+	}
+
+	//NOTE(Kyryl): VK_KHR_timeline_semaphore needs this one on a 1.0 instance,
+	//the feature itself is queried through vkGetPhysicalDeviceFeatures2KHR.
+	const char *InstanceExtensionNames[ReqExCount + 1];
+	memcpy(InstanceExtensionNames, RequiredExtensions, sizeof(const char*) * ReqExCount);
+	b32 HasProperties2 = false;
+	for(i = 0; i < ExtensionCount && UseTimelineSemaphores; i++)
+	{
+		if(!strcmp(InstanceExtensions[i].extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME))
+		{
+			Info("Using instance extension: %s ", VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+			InstanceExtensionNames[ReqExCount++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+			HasProperties2 = true;
+			break;
+		}
+	}
+	RequiredExtensions = InstanceExtensionNames;
+
+	VkApplicationInfo AppI =
+	{
+		VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		NULL,
+		"TinyEngine",
+		VK_MAKE_VERSION(1,0,0),
+		"TinyEngine",
+		VK_MAKE_VERSION(1,0,0),
+		VK_MAKE_VERSION(1,0,0)
+	};
+
+	VkInstanceCreateInfo InstanceCI;
+	InstanceCI.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	InstanceCI.pNext = NULL;
+	InstanceCI.flags = 0;
+	InstanceCI.pApplicationInfo = &AppI;
+	InstanceCI.enabledLayerCount = 0;
+	InstanceCI.ppEnabledLayerNames = NULL;
+	InstanceCI.enabledExtensionCount = ReqExCount;
+	InstanceCI.ppEnabledExtensionNames = &RequiredExtensions[0];
+
+#ifdef TINYENGINE_DEBUG
+	const char* DebugLayers[] =
+	{
+		"VK_LAYER_KHRONOS_validation"
+	};
+	if(!CheckValidationLayerSupport(DebugLayers, ArrayCount(DebugLayers)))
+	{
+		Warn("Debug Layers are not found! ");
+	}
+	else
+	{
+		InstanceCI.enabledLayerCount = ArrayCount(DebugLayers);
+		InstanceCI.ppEnabledLayerNames = DebugLayers;
+	}
+#endif
+
+
+	//define custom vulkan allocators
+	//allocators = NULL;
+	if(VkAllocators)
+	{
+		InitHostAllocator();
+		VkAllocators->pUserData = NULL;
+		VkAllocators->pfnAllocation = (PFN_vkAllocationFunction)VkAlloc;
+		VkAllocators->pfnReallocation = (PFN_vkReallocationFunction)VkRealloc;
+		VkAllocators->pfnFree = (PFN_vkFreeFunction)VkFree;
+		VkAllocators->pfnInternalAllocation = NULL;
+		VkAllocators->pfnInternalFree = NULL;
+	}
+	VK_CHECK(vkCreateInstance(&InstanceCI, VkAllocators, &Instance));
+
+
+	#define INSTANCE_LEVEL_VULKAN_FUNCTION( name )				\
+    	name = (PFN_##name) (vkGetInstanceProcAddr(Instance, #name));	\
+    	if(name == NULL)							\
+      	{									\
+		Fatal("Could not load instance Vulkan function: %s", #name);	\
+		return false;							\
+      	}else								\
+      	{Info("Loaded instance Vulkan function: %s", #name);}	\
+
+	#define TINY_VULKAN_UPDATE
+	#include "tiny_vulkan.h"
+
+	//(Kyryl): For what it takes, do not touch this code !
+	//C preprocessor is an evil thing!
+	#define INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( name, extension ) \
+	for(i = 0; i<ReqExCount; i++) {				\
+		if( strstr(RequiredExtensions[i], extension) ) { \
+			name = (PFN_##name)vkGetInstanceProcAddr( Instance, #name );	\
+			if( name == NULL ){						\
+				Warn("Could not load instance-level Vulkan function named: %s", #name);  \
+				return false;                                                        \
+			}else                                                                       \
+			{Info("Loaded function from extension: %s", #name);}		\
+		}\
+	}  
+	#define TINY_VULKAN_UPDATE
+	#include "tiny_vulkan.h"
+
+#ifdef TINYENGINE_DEBUG
+	RegisterDebugCallback();
+#endif
+
+	u32 DeviceCount = 0;
+	VK_CHECK(vkEnumeratePhysicalDevices(Instance, &DeviceCount, NULL));
+	ASSERT(DeviceCount, "No Gpus enumerated");
+
+	VkPhysicalDevice Devices[DeviceCount];
+	VK_CHECK(vkEnumeratePhysicalDevices(Instance, &DeviceCount, &Devices[0]));
+	
+	u32 DeviceExtensionCount = 0;
+	GpuDevice = VK_NULL_HANDLE;
+	//NOTE(Kyryl): Second pass accepts software rasterizers (lavapipe, swiftshader)
+	//so the renderer still runs and can be profiled on a box without a gpu.
+	for(u32 Pass = 0; Pass < 2 && !GpuDevice; Pass++)
+	{
+		for(i = 0; i<DeviceCount; i++)
+		{
+			VK_CHECK(vkEnumerateDeviceExtensionProperties(Devices[i], NULL, &DeviceExtensionCount, NULL));
+
+			VkExtensionProperties ExtensionProperties[DeviceExtensionCount];
+
+			VK_CHECK(vkEnumerateDeviceExtensionProperties(Devices[i], NULL, &DeviceExtensionCount, &ExtensionProperties[0]));
+
+			vkGetPhysicalDeviceFeatures(Devices[i], &DeviceFeatures);
+			vkGetPhysicalDeviceProperties(Devices[i], &DeviceProperties);
+
+			b32 IsGpu = DeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU || DeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+			b32 IsCpu = DeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+			if(Pass == 0 ? !IsGpu : !IsCpu)
+			{
+				continue;
+			}
+			else
+			{
+				//Found a Gpu
+				u32 Size = (sizeof(VkExtensionProperties)  *DeviceExtensionCount);
+				VkDeviceExtensionProperties = (VkExtensionProperties*) Tiny_Malloc(Size);
+				memcpy(VkDeviceExtensionProperties, ExtensionProperties, Size);
+				DeviceExtPropCount = DeviceExtensionCount;
+				GpuDevice = Devices[i];
+
+				Trace("Using Device: %s", DeviceProperties.deviceName);
+				break;
+			}
+
+		}
+	}
+	ASSERT(GpuDevice, "Found no matching GpuDevice!");
+
+	//Surface 
+	//Is created via platform layer callback.
+	SurfaceCallback(&VkSurface); 
+
+	PresentationMode = ChoosePresentMode();
+
+	//NOTE(Kyryl): This is necessary for swapchain resize.
+	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GpuDevice, VkSurface, &SurfaceCapabilities));
+	SwchImageSize = SurfaceCapabilities.currentExtent;
+	//End Surface
+
+	//Vulkan Queue init. 
+	u32 QFamiliesCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(GpuDevice, &QFamiliesCount, NULL);
+	ASSERT(QFamiliesCount, "Could not enumerate family queues!");
+
+	VkQueueFamilyProperties QueueFamilies[QFamiliesCount];
+	vkGetPhysicalDeviceQueueFamilyProperties(GpuDevice, &QFamiliesCount, &QueueFamilies[0]);
+
+	//(Kyryl): Find a graphics Queue.
+	//In case we require move than 1 queue, just copy paste this code with different flags.
+	for(i = 0; i<QFamiliesCount; ++i)
+	{
+		if(QueueFamilies[i].queueCount > 0 && (QueueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == VK_QUEUE_GRAPHICS_BIT)
+		{
+			break;
+		}
+	}
+	ASSERT(i != QFamiliesCount, "Graphics Queue not found.");
+	QueueIndex[0] = i;
+	QueuePriority[0] = 1.0f;
+
+	VkBool32 PresentationSupport = VK_FALSE;
+	VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(GpuDevice, i, VkSurface, &PresentationSupport));
+	ASSERT(PresentationSupport, "Presentation not supported on Queue index %d", i);
+	QueueIndex[0] = i;
+
+
+	//LogicalDevice
+	//The reason it's named like this is because we can derive multiple of these 
+	//objects from single GpuDevice. Probably the most used object in Vulkan.
+
+	//Required extensions first, optional ones are appended below.
+	const char *DeviceExtensions[8] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	u32 EnabledDeviceExtCount = 1;
+	for(u32 c = 0; c < EnabledDeviceExtCount; c++)
+	{
+		for(i = 0; i < DeviceExtPropCount; i++)
+		{
+			if(strstr(DeviceExtensions[c], (char*)&VkDeviceExtensionProperties[i]))
+			{
+				Info("Using device extension: %s ", DeviceExtensions[c]);
+				goto __continue;
+			}
+		}
+		Debug("Available Extensions: ");
+		for(i = 0; i < DeviceExtPropCount; i++)
+		{
+			Debug("%s", (char*)&VkDeviceExtensionProperties[i]);
+		}
+		Fatal("Extension %s is not supported by physical device!", DeviceExtensions[c]);
+		return false;
+__continue:;
+	}
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR TimelineFeatures;
+	TimelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	TimelineFeatures.pNext = NULL;
+	TimelineFeatures.timelineSemaphore = VK_FALSE;
+	if(UseTimelineSemaphores && HasProperties2 && IsDeviceExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+	{
+		VkPhysicalDeviceFeatures2KHR Features2;
+		Features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		Features2.pNext = &TimelineFeatures;
+		vkGetPhysicalDeviceFeatures2KHR(GpuDevice, &Features2);
+	}
+	if(TimelineFeatures.timelineSemaphore)
+	{
+		Info("Using device extension: %s ", VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		DeviceExtensions[EnabledDeviceExtCount++] = VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME;
+	}
+	else
+	{
+		Info("Timeline semaphores unavailable, falling back to fences.");
+		UseTimelineSemaphores = false;
+	}
+
+	if(UseDrawIndirectCount && IsDeviceExtensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+	{
+		Info("Using device extension: %s ", VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		DeviceExtensions[EnabledDeviceExtCount++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+	}
+	else
+	{
+		UseDrawIndirectCount = false;
+	}
+
+	VkDeviceQueueCreateInfo QueueCI[NUM_QUEUES];
+	for(i = 0; i<NUM_QUEUES; i++)
+	{
+		QueueCI[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		QueueCI[i].pNext = NULL;
+		QueueCI[i].flags = 0;
+		QueueCI[i].queueFamilyIndex = QueueIndex[i];
+		QueueCI[i].queueCount = 1;
+		QueueCI[i].pQueuePriorities = &QueuePriority[i];
+	}
+
+	VkDeviceCreateInfo DeviceCI;
+	DeviceCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	DeviceCI.pNext = UseTimelineSemaphores ? &TimelineFeatures : NULL;
+	DeviceCI.flags = 0;
+	DeviceCI.queueCreateInfoCount = NUM_QUEUES;
+	DeviceCI.pQueueCreateInfos = &QueueCI[0];
+	DeviceCI.enabledLayerCount = 0;
+	DeviceCI.ppEnabledLayerNames = NULL;
+	DeviceCI.enabledExtensionCount = EnabledDeviceExtCount;
+	DeviceCI.ppEnabledExtensionNames = &DeviceExtensions[0];
+	DeviceCI.pEnabledFeatures = &DeviceFeatures;
+	VK_CHECK(vkCreateDevice(GpuDevice, &DeviceCI, VkAllocators, &LogicalDevice));
+
+	//End LogicalDevice
+
+	// Load core Vulkan API device-level functions
+#define DEVICE_LEVEL_VULKAN_FUNCTION( name )				\
+	name = (PFN_##name)vkGetDeviceProcAddr( LogicalDevice, #name );	\
+	if( name == NULL ) {						\
+		Warn("Could not load device-level Vulkan function named: %s",#name); \
+		return false;							\
+	}else	{								\
+		Info("Loaded device-level function: %s",#name);} \
+
+#define TINY_VULKAN_UPDATE
+#include "tiny_vulkan.h"
+
+	// Load device-level functions from enabled extensions
+#define DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( name, extension )	\
+	for(i = 0; i<EnabledDeviceExtCount; i++) {				\
+		if( strstr(DeviceExtensions[i], extension ) ) { \
+			name = (PFN_##name)vkGetDeviceProcAddr( LogicalDevice, #name );	\
+			if( name == NULL ) {						\
+				Warn("Could not load device-level Vulkan function from extension: %s", #name); \
+				return false;							\
+			}else{								\
+				Info("Loaded device-level function from extension: %s", #name);}	\
+		}									\
+	}
+
+#define TINY_VULKAN_UPDATE
+#include "tiny_vulkan.h"
+
+	vkGetDeviceQueue(LogicalDevice, QueueIndex[0], 0, &VkQueues[0]); //Graphics queue.
+	//End Vulkan Queue
+
+	//Swapchain
+	SwchMinImageCount = SurfaceCapabilities.minImageCount + 1;
+	if(SurfaceCapabilities.maxImageCount > 0 && SwchMinImageCount > SurfaceCapabilities.maxImageCount)
+	{
+		SwchMinImageCount = SurfaceCapabilities.maxImageCount;
+	}
+	SwchMinImageCount += 1;
+	SwchImageCount = SwchMinImageCount;
+
+	//Driver may give us more images than asked for, and a rebuild with
+	//another present mode may change the count, so size for the worst case.
+	VkSwchImageViews = (VkImageView*) Tiny_Malloc(sizeof(VkImageView) * NUM_FRAMEBUFFERS);
+
+	VkImageUsageFlags TmpImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	SwchImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	SwchImageUsage &= SurfaceCapabilities.supportedUsageFlags;
+	ASSERT(TmpImageUsage == SwchImageUsage, "Swapchain images do not support Color | Transfer Attachments");
+
+	SwchTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	if(!(SurfaceCapabilities.supportedTransforms & SwchTransform))
+	{
+		SwchTransform = SurfaceCapabilities.currentTransform;
+	}
+
+	// Enumerate supported swapchain image formats.
+	//NOTE(Kyryl): This is default cofig we are seaching for.
+	u32 FormatCount = 0;
+	VkSurfaceFormatKHR SurfaceFormat;
+	SurfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
+	SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+
+	VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(GpuDevice, VkSurface, &FormatCount, NULL));
+	ASSERT(FormatCount, "Failed to enumerate swapchain image formats.");
+
+	VkSurfaceFormatKHR SurfaceFormats[FormatCount];
+	VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(GpuDevice, VkSurface, &FormatCount, &SurfaceFormats[0]));
+
+	// Select surface format
+	if(FormatCount == 1 && SurfaceFormats[0].format == VK_FORMAT_UNDEFINED)
+	{
+		SwchImageFormat = SurfaceFormat.format;
+		SwchImageColorSpace = SurfaceFormat.colorSpace;
+		goto out;
+	}
+	else
+	{
+		for(i = 0; i<FormatCount; i++)
+		{
+			if(SurfaceFormat.format == SurfaceFormats[i].format && SurfaceFormat.colorSpace == SurfaceFormats[i].colorSpace)
+			{
+				SwchImageFormat = SurfaceFormat.format;
+				SwchImageColorSpace = SurfaceFormat.colorSpace;
+				goto out;
+			}
+		}
+
+		for(i = 0; i<FormatCount; i++)
+		{
+			if( (SurfaceFormat.format == SurfaceFormats[i].format) )
+			{
+				SwchImageFormat = SurfaceFormat.format;
+				SwchImageColorSpace = SurfaceFormats[i].colorSpace;
+				Warn("Combination of format and colorspace is not supported. Selecting other colorspace.");
+				goto out;
+			}
+		}
+	}
+	SwchImageFormat = SurfaceFormats[0].format;
+	SwchImageColorSpace = SurfaceFormats[0].colorSpace;
+	Warn("Surface format is not supported. Selecting available format - colorspace combination." );
+out:;
+
+    	CreateSwapchain(&VkSwapchains[0], &VkSwapchains[1]);
 
-	VkPipelineMultisampleStateCreateInfo MultisampleStateCI;
-	MultisampleStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	MultisampleStateCI.pNext = NULL;
-	MultisampleStateCI.flags = 0;
-	MultisampleStateCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	MultisampleStateCI.sampleShadingEnable = VK_FALSE;
-	MultisampleStateCI.minSampleShading = 0.0f;
-	MultisampleStateCI.pSampleMask = NULL;
-	MultisampleStateCI.alphaToCoverageEnable = VK_FALSE;
-	MultisampleStateCI.alphaToOneEnable = VK_FALSE;
+	//Swapchain Images, required for rendering.
+	//They are treated as special an unique.
+	u32 ImageCount = 0;
+	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, NULL));
+	ASSERT(ImageCount, "Failed to get swapchain image count.");
 
-	VkPipelineDepthStencilStateCreateInfo DepthStensilStateCI;
-	DepthStensilStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	DepthStensilStateCI.pNext = NULL;
-	DepthStensilStateCI.flags = 0;
+	ASSERT(ImageCount <= NUM_FRAMEBUFFERS, "Too many swapchain images, increase NUM_FRAMEBUFFERS");
+	VkSwchImages = (VkImage*) Tiny_Malloc(sizeof(VkImage) * NUM_FRAMEBUFFERS);
 
-	VkPipelineColorBlendAttachmentState ColorBlendAttachment;
-	ColorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, &VkSwchImages[0]));
+	SwchImageCount = ImageCount;
+	Info("Swapchain: %d images, present mode %s", SwchImageCount, GetPresentModeString(PresentationMode));
 
-	VkPipelineColorBlendStateCreateInfo ColorBlendStateCI;
-	ColorBlendStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	ColorBlendStateCI.pNext = NULL;
-	ColorBlendStateCI.flags = 0;
-	ColorBlendStateCI.attachmentCount = 1;
-	ColorBlendStateCI.pAttachments = &ColorBlendAttachment;
-	ColorBlendStateCI.logicOpEnable = VK_FALSE;
-	ColorBlendStateCI.logicOp = VK_LOGIC_OP_COPY;
-	ColorBlendStateCI.attachmentCount = 1;
-	ColorBlendStateCI.blendConstants[0] = 1.0f;
-	ColorBlendStateCI.blendConstants[1] = 1.0f;
-	ColorBlendStateCI.blendConstants[2] = 1.0f;
-	ColorBlendStateCI.blendConstants[3] = 1.0f;
+	CreateSwapchainImageViews();
 
-	VkStencilOpState sos = {0};
-	DepthStensilStateCI.depthTestEnable = VK_TRUE;
-	DepthStensilStateCI.depthWriteEnable = VK_TRUE;
-	DepthStensilStateCI.depthCompareOp = VK_COMPARE_OP_LESS;
-	DepthStensilStateCI.depthBoundsTestEnable = VK_FALSE;
-	DepthStensilStateCI.stencilTestEnable = VK_FALSE;
-	DepthStensilStateCI.front = sos;
-	DepthStensilStateCI.back = sos;
-	DepthStensilStateCI.minDepthBounds = 0.0f;
-	DepthStensilStateCI.maxDepthBounds = 0.0f;
+	//End Swapchain
 
-	ColorBlendAttachment.blendEnable = VK_FALSE;
-	ColorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	ColorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	ColorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	ColorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	ColorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	ColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	//RENDER RESOURCES
+	VkSemaphoreCreateInfo SemaphoreCI;
+	SemaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	SemaphoreCI.pNext = NULL;
+	SemaphoreCI.flags = 0;
 
-	VkDynamicState DynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	for(i = 0; i < NUM_SEMAPHORES; i++)
+	{
+		VK_CHECK(vkCreateSemaphore(LogicalDevice, &SemaphoreCI, VkAllocators, &VkWaitSemaphores[i]));
+		VK_CHECK(vkCreateSemaphore(LogicalDevice, &SemaphoreCI, VkAllocators, &VkSignalSemaphores[i]));
+	}
 
-	VkPipelineDynamicStateCreateInfo PipelineDynamicStateCI;
-	PipelineDynamicStateCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	PipelineDynamicStateCI.pNext = NULL;
-	PipelineDynamicStateCI.flags = 0;
-	PipelineDynamicStateCI.dynamicStateCount = ArrayCount(DynamicStates);
-	PipelineDynamicStateCI.pDynamicStates = DynamicStates;
+	if(UseTimelineSemaphores)
+	{
+		VkSemaphoreTypeCreateInfoKHR SemaphoreTypeCI;
+		SemaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		SemaphoreTypeCI.pNext = NULL;
+		SemaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		SemaphoreTypeCI.initialValue = 0;
+
+		SemaphoreCI.pNext = &SemaphoreTypeCI;
+		VK_CHECK(vkCreateSemaphore(LogicalDevice, &SemaphoreCI, VkAllocators, &TimelineSemaphore));
+		SemaphoreCI.pNext = NULL;
+	}
+	SubmitValue = 0;
+	CompletedValue = 0;
 
-	VkVertexInputBindingDescription VertexInputBD[1]; 
-	VertexInputBD[0].binding = 0;
-	VertexInputBD[0].stride = sizeof(vertex_t);
-	VertexInputBD[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	VkFenceCreateInfo FenceCI;
+	FenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	FenceCI.pNext = NULL;
+	FenceCI.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-	VkVertexInputAttributeDescription VertexInputAD[3];
-	VertexInputAD[0].binding = 0;
-	VertexInputAD[0].location = 0;
-	VertexInputAD[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	VertexInputAD[0].offset = offsetof(vertex_t, Xyz);
-	VertexInputAD[1].binding = 0;
-	VertexInputAD[1].location = 1;
-	VertexInputAD[1].format = VK_FORMAT_R32G32_SFLOAT;
-	VertexInputAD[1].offset = offsetof(vertex_t, UVs);
-	VertexInputAD[2].binding = 0;
-	VertexInputAD[2].location = 2;
-	VertexInputAD[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	VertexInputAD[2].offset = offsetof(vertex_t, Normals);
+	for(i = 0; i < NUM_FENCES; i++)
+	{
+		VK_CHECK(vkCreateFence(LogicalDevice, &FenceCI, VkAllocators, &VkFences[i]));
+	}
 
-	VkPipelineVertexInputStateCreateInfo VertexInputStateCI[1];
-	VertexInputStateCI[0].sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	VertexInputStateCI[0].pNext = NULL;
-	VertexInputStateCI[0].flags = 0;
-	VertexInputStateCI[0].vertexBindingDescriptionCount = 1;
-	VertexInputStateCI[0].vertexAttributeDescriptionCount = 3;
-	VertexInputStateCI[0].pVertexBindingDescriptions = VertexInputBD;
-	VertexInputStateCI[0].pVertexAttributeDescriptions = &VertexInputAD[0];
+	//NOTE(Kyryl): We can have 1 command pool and many buffers
+	//or command pool for every command buffer. 
+	//I will make command pool for every buffer in case of future multithreading.
+	VkCommandPoolCreateInfo CommandPoolCI;
+	CommandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	CommandPoolCI.pNext = NULL;
+	CommandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	CommandPoolCI.queueFamilyIndex = QueueIndex[0]; //graphics queue.
 
-	VkGraphicsPipelineCreateInfo PipelineCI;
-	PipelineCI.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	PipelineCI.pNext = NULL;
-	PipelineCI.flags = 0;
-	PipelineCI.stageCount = ArrayCount(ShaderStageCI);
-	PipelineCI.pStages = ShaderStageCI;
-	PipelineCI.pVertexInputState = &VertexInputStateCI[0];
-	PipelineCI.pInputAssemblyState = &InputAssemblyCI;
-	PipelineCI.pTessellationState = NULL;
-	PipelineCI.pViewportState = &ViewportState;
-	PipelineCI.pRasterizationState = &RasterizationStateCI;
-	PipelineCI.pMultisampleState = &MultisampleStateCI;
-	PipelineCI.pDepthStencilState = &DepthStensilStateCI;
-	PipelineCI.pColorBlendState = &ColorBlendStateCI;
-	PipelineCI.pDynamicState = &PipelineDynamicStateCI;
-	PipelineCI.layout = VkPipelineLayouts[0];
-	PipelineCI.renderPass = VkRenderPasses[0];
-	PipelineCI.subpass = 0;
-	PipelineCI.basePipelineHandle = 0;
-	PipelineCI.basePipelineIndex = 0;
+	//NOTE(Kyryl): they are all on graphics queue currently
+	//If we need compute queue explicitly then make separate VkComputeCommandPools
+	for(i = 0; i<NUM_COMMAND_POOLS; i++)
+	{
+		VK_CHECK(vkCreateCommandPool(LogicalDevice, &CommandPoolCI, VkAllocators, &VkCommandPools[i]));
+	}
 
-//TEMPLATE
+	//VkCommandBuffers holds the staging buffers, frames record from VkFramePools.
+	VkCommandBufferAllocateInfo CommandBufferAI;
+	CommandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	CommandBufferAI.pNext = NULL;
+	CommandBufferAI.commandPool = VkCommandPools[0];
+	CommandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	CommandBufferAI.commandBufferCount = NUM_COMMAND_BUFFERS;
+	VK_CHECK(vkAllocateCommandBuffers(LogicalDevice, &CommandBufferAI, &VkCommandBuffers[0]));
 
-	//These asserts tell you what is what.
-	ASSERT(VkShaderModules[0], "Failed to load Basic Vertex Shader.");
-	ASSERT(VkShaderModules[1], "Failed to load Basic Fragment Shader.");
-	ASSERT(VkShaderModules[2], "Failed to load Sampler Fragment Shader.");
-	ASSERT(VkShaderModules[3], "Failed to load Lightning Fragment Shader.");
+	//One transient pool per frame slot and thread, primaries are allocated on demand.
+	CommandPoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	CommandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	CommandBufferAI.commandBufferCount = 1;
+	for(i = 0; i < NUM_FENCES; i++)
+	{
+		for(u32 j = 0; j < NUM_RECORD_THREADS; j++)
+		{
+			VK_CHECK(vkCreateCommandPool(LogicalDevice, &CommandPoolCI, VkAllocators, &VkFramePools[i][j]));
+			CommandBufferAI.commandPool = VkFramePools[i][j];
+			VK_CHECK(vkAllocateCommandBuffers(LogicalDevice, &CommandBufferAI, &VkSecondaryCommandBuffers[i][j]));
+		}
+	}
 
-	//basic pipeline
-	ShaderStageCI[0].module = VkShaderModules[0];
-	ShaderStageCI[1].module = VkShaderModules[1];
-	PipelineCI.stageCount = 2;
-	PipelineCI.layout = VkPipelineLayouts[0];
-	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[0]));
 
-	//line draw pipeline
-	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
-	RasterizationStateCI.polygonMode = VK_POLYGON_MODE_LINE;
-	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[1]));
+	//MEMORY
+	Trace("Reached target: Memory Init");
+	vkGetPhysicalDeviceMemoryProperties(GpuDevice, &DeviceMemoryProperties);
 
-	//sampler pipeline
-	InputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	RasterizationStateCI.polygonMode = VK_POLYGON_MODE_FILL;
-	ShaderStageCI[0].module = VkShaderModules[0];
-	ShaderStageCI[1].module = VkShaderModules[2];
-	PipelineCI.layout = VkPipelineLayouts[1];
-	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[2]));
+	VertexBuffers[0].Size = 20480;
+	VertexBuffers[0].Data = VkHostMalloc(VertexBuffers[0].Size, &VertexBuffers[0].Buffer, &VertexBuffers[0].DeviceMemory, 
+	(VkBufferUsageFlagBits)(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT));
+	//Note(Kyryl): vertex buffers require no alignment, vertex pulling reads floats.
+	ZInitZone(VertexBuffers[0].Data, VertexBuffers[0].Size, 4, 1);
+	Mainzone[1]->Buffer = VertexBuffers[0].Buffer;
+	ZSetZoneGrowth(1, ZONE_GROW_BUFFER, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
-	//alpha blend texture pipeline
-	ShaderStageCI[0].module = VkShaderModules[0];
-	ShaderStageCI[1].module = VkShaderModules[2];
-	PipelineCI.layout = VkPipelineLayouts[1];
-	ColorBlendAttachment.blendEnable = VK_TRUE;
-	DepthStensilStateCI.depthTestEnable = VK_FALSE; //disable depth so 2d images only.
-	DepthStensilStateCI.depthWriteEnable = VK_FALSE;
-	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[3]));
+	IndexBuffers[0].Size = 20480;
+	IndexBuffers[0].Data = VkHostMalloc(IndexBuffers[0].Size, &IndexBuffers[0].Buffer, &IndexBuffers[0].DeviceMemory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	// Align to 4 bytes because we allocate both uint16 and uint32
+	// index buffers and alignment must match index size, see AcquireEntity.
+	ZInitZone(IndexBuffers[0].Data, IndexBuffers[0].Size, 4, 2);
+	Mainzone[2]->Buffer = IndexBuffers[0].Buffer;
+	ZSetZoneGrowth(2, ZONE_GROW_BUFFER, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
-	//lightning pipeline
-	ShaderStageCI[0].module = VkShaderModules[0];
-	ShaderStageCI[1].module = VkShaderModules[3];
-	PipelineCI.layout = VkPipelineLayouts[2];
-	VK_CHECK(vkCreateGraphicsPipelines(LogicalDevice, PipelineCache, 1, &PipelineCI, 0, &VkPipelines[4]));
+	UniformBuffers[0].Size = 20480;
+	UniformBuffers[0].Data = VkHostMalloc(UniformBuffers[0].Size, &UniformBuffers[0].Buffer, &UniformBuffers[0].DeviceMemory, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+	// Align to 32 bytes, min spec requirement. Stays fixed, the uniform
+	// descriptor sets point at this one buffer.
+	ZInitZone(UniformBuffers[0].Data, UniformBuffers[0].Size, 
+	DeviceProperties.limits.minUniformBufferOffsetAlignment, 3);
+	Mainzone[3]->Buffer = UniformBuffers[0].Buffer;
 
-	return;
-}
+	IndirectBuffers[0].Size = 65536;
+	IndirectBuffers[0].Data = VkHostMalloc(IndirectBuffers[0].Size, &IndirectBuffers[0].Buffer, &IndirectBuffers[0].DeviceMemory, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	// Draw commands and counts are u32s.
+	ZInitZone(IndirectBuffers[0].Data, IndirectBuffers[0].Size, 4, 4);
+	Mainzone[4]->Buffer = IndirectBuffers[0].Buffer;
+	ZSetZoneGrowth(4, ZONE_GROW_BUFFER, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
 
+	//STAGING BUFFERS
+	ASSERT(NUM_STAGING_BUFFERS < NUM_FENCES - SwchImageCount, "Increase NUM_FENCES");
+	ASSERT(NUM_STAGING_BUFFERS <= NUM_COMMAND_BUFFERS, "Increase NUM_COMMAND_BUFFERS");
+	for(i = 0; i < NUM_STAGING_BUFFERS; i++)
+	{
+		//Is not managed by SGM because it does not need to be.
+		//Memory is freed on buffer reset, so no need to do any explicit management.
+		StagingBuffers[i].Size = 16777216; //4096 * 4096
+		StagingBuffers[i].Data = VkHostMalloc(StagingBuffers[i].Size, &StagingBuffers[i].Buffer, &StagingBuffers[i].DeviceMemory,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-#ifdef TINYENGINE_DEBUG
+		//Dont't mix render sync and staging.
+		//You could, but why if you can just have them separate, less complex IMO.
+		StagingBuffers[i].CommandBuffer = VkCommandBuffers[i];
+		StagingBuffers[i].Fence = VkFences[SwchImageCount+i];
 
-VkBool32 VKAPI_CALL DebugReportCallback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objectType, u64 object, size_t location, s32 messageCode, const char* pLayerPrefix, const char* pMessage, void* pUserData)
-{
-	// This silences warnings like "For optimal performance image layout should be VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL instead of GENERAL."
-	// We'll assume other performance warnings are also not useful.
-	if (flags & VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT)
-		return VK_FALSE;
+		//Set into recording state
+		VkCommandBufferBeginInfo CommandBufferBI;
+		CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		CommandBufferBI.pNext = NULL;
+		CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; 
+		CommandBufferBI.pInheritanceInfo = NULL;
 
-	const char* type =
-	    (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
-	    ? "ERROR"
-	    : (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
-	    ? "WARNING"
-	    : "INFO";
+		VK_CHECK(vkBeginCommandBuffer(StagingBuffers[i].CommandBuffer, &CommandBufferBI));
+		VK_CHECK(vkResetFences(LogicalDevice, 1, &StagingBuffers[i].Fence));
+	}
+	//STAGING BUFFERS
 
-	char message[4096];
-	stbsp_sprintf(message, "%s: %s\n", type, pMessage);
 
-	Fatal("%s", message);
+	//End MEMORY
+
+	//SAMPLERS
+	VkSamplerCreateInfo SamplerCI;
+	SamplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	SamplerCI.pNext = NULL;
+	SamplerCI.flags = 0;
+	SamplerCI.magFilter = VK_FILTER_NEAREST;
+	SamplerCI.minFilter = VK_FILTER_NEAREST;
+	SamplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	SamplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	SamplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	SamplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	SamplerCI.mipLodBias = 0.0f;
+	SamplerCI.anisotropyEnable = 0;
+	SamplerCI.maxAnisotropy = 1.0f;
+	SamplerCI.compareEnable = 0;
+	SamplerCI.compareOp = 0;
+	SamplerCI.minLod = 0.0f;
+	SamplerCI.maxLod = 0.0f;
+	SamplerCI.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	SamplerCI.unnormalizedCoordinates = VK_FALSE;
 
-	if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT)
-		Info("Validation error encountered!");
+	VK_CHECK(vkCreateSampler(LogicalDevice, &SamplerCI, NULL, &PointSampler));
+	//SAMPLERS
 
-	if(flags & VK_DEBUG_REPORT_WARNING_BIT_EXT)
-		return VK_FALSE;
+	//DESCRIPTOR SETS
+	//NOTE(Kyryl): 
+	//This is a very commonly used objects and through this we can access resources like
+	//UBOs texture samplers and much more! Think of descriptor set a pointer object.
+	VkDescriptorPoolSize PoolSize[3];
+	PoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	PoolSize[0].descriptorCount = 32;
+	PoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	PoolSize[1].descriptorCount = 2048;
+	PoolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	PoolSize[2].descriptorCount = 32;
 
+	VkDescriptorPoolCreateInfo DescriptorPoolCI;
+	DescriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	DescriptorPoolCI.pNext = NULL;
+	DescriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	DescriptorPoolCI.maxSets = 2112; //2048 + 32 + 32
+	DescriptorPoolCI.poolSizeCount = ArrayCount(PoolSize);
+	DescriptorPoolCI.pPoolSizes = PoolSize;
+	VK_CHECK(vkCreateDescriptorPool(LogicalDevice, &DescriptorPoolCI, VkAllocators, &DescriptorPool));
 
-	ASSERT(0,"");
-	return VK_FALSE;
-}
+	//NOTE(Kyryl):
+	//There are many ways to do this and lay out the objects. 
+	//Through experience I think this is the most flexible way.
+	//This covers a lot of need cases, but if more needed, always add here.
 
-b32 CheckValidationLayerSupport(const char** DebugLayers, s32 ReqCount)
-{
-	u32 LayerCount;
-	vkEnumerateInstanceLayerProperties(&LayerCount, NULL);
+	//Vubo = vertex uniform buffer object
+	VkDescriptorSetLayoutBinding VuboSLB;
+	VuboSLB.binding = 0;
+	VuboSLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	VuboSLB.descriptorCount = 1;
+	VuboSLB.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	VuboSLB.pImmutableSamplers = NULL;
 
-	VkLayerProperties AvailableLayers[LayerCount];
-	vkEnumerateInstanceLayerProperties(&LayerCount, &AvailableLayers[0]);
+	//Fubo = fragment uniform buffer object
+	VkDescriptorSetLayoutBinding FuboSLB;
+	FuboSLB.binding = 0;
+	FuboSLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	FuboSLB.descriptorCount = 1;
+	FuboSLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	FuboSLB.pImmutableSamplers = NULL;
 
-	for(s32 i = 0; i<ReqCount; i++)
-	{
-		b32 LayerFound = false;
-		for (u32 z = 0; z<LayerCount; z++)
-		{
-			if (strcmp(DebugLayers[i], (char*) &AvailableLayers[z]) == 0)
-			{
-				LayerFound = true;
-				break;
-			}
-		}
-		if (!LayerFound)
-		{
-			return false;
-		}
-	}
-	return true;
-}
+	//Fso = fragment sampler object
+	VkDescriptorSetLayoutBinding FsoSLB;
+	FsoSLB.binding = 0;
+	FsoSLB.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	FsoSLB.descriptorCount = 1;
+	FsoSLB.pImmutableSamplers = NULL;
+	FsoSLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-void RegisterDebugCallback()
-{
-	if(vkCreateDebugReportCallbackEXT)
+	//Geo = vertex pulling storage buffers, zone then ring
+	VkDescriptorSetLayoutBinding GeoSLB[2];
+	for(i = 0; i < 2; i++)
 	{
-		VkDebugReportCallbackCreateInfoEXT DebugReportCallbackCI;
-		DebugReportCallbackCI.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-		DebugReportCallbackCI.pNext = NULL;
-		DebugReportCallbackCI.flags = VK_DEBUG_REPORT_WARNING_BIT_EXT |
-			VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
-			VK_DEBUG_REPORT_ERROR_BIT_EXT;
-		DebugReportCallbackCI.pfnCallback = DebugReportCallback;
-		DebugReportCallbackCI.pUserData = NULL;
-
-		VK_CHECK(vkCreateDebugReportCallbackEXT(Instance, &DebugReportCallbackCI, 0, &VulkanDebugCallback));
+		GeoSLB[i].binding = i;
+		GeoSLB[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		GeoSLB[i].descriptorCount = 1;
+		GeoSLB[i].pImmutableSamplers = NULL;
+		GeoSLB[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 	}
-}
-
-#endif
-
-void RebuildRenderer()
-{
-	u32 i;
-	VK_CHECK(vkDeviceWaitIdle(LogicalDevice));
-
-	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GpuDevice, VkSurface, &SurfaceCapabilities));
-	SwchImageSize = SurfaceCapabilities.currentExtent;
 
-	if(SwchImageSize.width == 0 || SwchImageSize.height == 0)
-	{
-		return; //if window is minimized.
-	}
+	VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCI;
+	DescriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	DescriptorSetLayoutCI.pNext = NULL;
+	DescriptorSetLayoutCI.flags = 0;
+	DescriptorSetLayoutCI.bindingCount = 1;
 
-	VkSwapchains[1] = VkSwapchains[0];
-	VkSwapchains[0] = VK_NULL_HANDLE;
+	DescriptorSetLayoutCI.pBindings = &VuboSLB;
+	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &VertUniformDescriptorSetLayout));
+	DescriptorSetLayoutCI.pBindings = &FuboSLB;
+	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &FragUniformDescriptorSetLayout));
+	DescriptorSetLayoutCI.pBindings = &FsoSLB;
+	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &FragSamplerDescriptorSetLayout));
+	DescriptorSetLayoutCI.bindingCount = ArrayCount(GeoSLB);
+	DescriptorSetLayoutCI.pBindings = GeoSLB;
+	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &GeometryDescriptorSetLayout));
 
-    	CreateSwapchain(&VkSwapchains[0], &VkSwapchains[1]);
+	//Allocate and write descriptor sets. 
 
-	u32 ImageCount = 0;
-	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, NULL));
-	ASSERT(ImageCount, "Failed to get swapchain image count.");
+	VkDescriptorSetAllocateInfo DescriptorSetAI;
+	DescriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	DescriptorSetAI.pNext = NULL;
+	DescriptorSetAI.descriptorPool = DescriptorPool;
+	DescriptorSetAI.descriptorSetCount = 1;
 
-	ASSERT(VkSwchImages, "Swapchain images unallocated.");
+	DescriptorSetAI.pSetLayouts = &VertUniformDescriptorSetLayout;
+	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &VertUniformDescriptorSet);
 
-	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, &VkSwchImages[0]));
+	DescriptorSetAI.pSetLayouts = &FragUniformDescriptorSetLayout;
+	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &FragUniformDescriptorSet);
 
-	//Delete incompatible objects.
-	for(i = 0; i<SwchImageCount; i++)
-	{
-		vkDestroyImageView(LogicalDevice, VkSwchImageViews[i], VkAllocators);
-	}
+	DescriptorSetAI.pSetLayouts = &FragSamplerDescriptorSetLayout;
+	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &FragSamplerDescriptorSet);
 
-	CreateSwapchainImageViews();
+	VkDescriptorBufferInfo DescriptorBI;
+	DescriptorBI.offset = 0;
+	DescriptorBI.range = MAX_UNIFORM_ALLOC;
 
-	for(i = 0; i < SwchImageCount; i++)
-	{
-		vkDestroyFramebuffer(LogicalDevice, VkFramebuffers[i], VkAllocators);
-	}
+	VkWriteDescriptorSet WriteDS;
+	WriteDS.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	WriteDS.pNext = NULL;
+	WriteDS.dstBinding = 0;
+	WriteDS.dstArrayElement = 0;
+	WriteDS.descriptorCount = 1;
+	WriteDS.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	WriteDS.pImageInfo = NULL;
+	WriteDS.pBufferInfo = &DescriptorBI;
+	WriteDS.pTexelBufferView = NULL;
 
-	CreateDepthBuffer();
-	CreateSwchFrameBuffers();
+	DescriptorBI.buffer = UniformBuffers[0].Buffer;
+	WriteDS.dstSet = VertUniformDescriptorSet;
+	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
 
-}
+	DescriptorBI.buffer = UniformBuffers[0].Buffer;
+	WriteDS.dstSet = FragUniformDescriptorSet;
+	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
 
-void DeInitVulkan()
-{
-	u32 i;
-	VK_CHECK(vkDeviceWaitIdle(LogicalDevice));
-#ifdef TINYENGINE_DEBUG
-	vkDestroyQueryPool(LogicalDevice, QueryPool, VkAllocators);
-	if(VulkanDebugCallback != VK_NULL_HANDLE)
-	{
-		vkDestroyDebugReportCallbackEXT(Instance, VulkanDebugCallback, VkAllocators);
-	}
-#endif
-	vkFreeCommandBuffers(LogicalDevice, VkCommandPools[0], NUM_COMMAND_BUFFERS, &VkCommandBuffers[0]);
-	DestroyDepthBuffer();
-	for(i = 0; i<SwchImageCount; i++)
-	{
-		vkDestroyImageView(LogicalDevice, VkSwchImageViews[i], VkAllocators);
-	}
-	for(i = 0; i < SwchImageCount; i++)
-	{
-		vkDestroyFramebuffer(LogicalDevice, VkFramebuffers[i], VkAllocators);
-	}
-	for(i = 0; VertexBuffers[i].Buffer != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyBuffer(LogicalDevice, VertexBuffers[i].Buffer, VkAllocators);
-		vkFreeMemory(LogicalDevice, VertexBuffers[i].DeviceMemory, VkAllocators);
-	}
-	for(i = 0; UniformBuffers[i].Buffer != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyBuffer(LogicalDevice, UniformBuffers[i].Buffer, VkAllocators);
-		vkFreeMemory(LogicalDevice, UniformBuffers[i].DeviceMemory, VkAllocators);
-	}
-	for(i = 0; IndexBuffers[i].Buffer != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyBuffer(LogicalDevice, IndexBuffers[i].Buffer, VkAllocators);
-		vkFreeMemory(LogicalDevice, IndexBuffers[i].DeviceMemory, VkAllocators);
-	}
-	for(i = 0; i < NUM_STAGING_BUFFERS; i++)
-	{
-		vkDestroyBuffer(LogicalDevice, StagingBuffers[i].Buffer, VkAllocators);
-		vkFreeMemory(LogicalDevice, StagingBuffers[i].DeviceMemory, VkAllocators);
-	}
-	for(i = 0; i < NUM_COMMAND_POOLS; i++)
-	{
-		vkDestroyCommandPool(LogicalDevice, VkCommandPools[i], VkAllocators);
-	}
-	for(i = 0; i < TextureCount; i++)
-	{
-		vkFreeMemory(LogicalDevice, TexturePool[i].DeviceMemory, VkAllocators);
-		vkDestroyImage(LogicalDevice, TexturePool[i].Image, VkAllocators);
-		vkDestroyImageView(LogicalDevice, TexturePool[i].ImageView, VkAllocators);
-	}
-	for(i = 0; i < NUM_SEMAPHORES; i++)
-	{
-		vkDestroySemaphore(LogicalDevice, VkWaitSemaphores[i], VkAllocators);
-		vkDestroySemaphore(LogicalDevice, VkSignalSemaphores[i], VkAllocators);
-	}
-	for(i = 0; i < NUM_FENCES; i++)
-	{
-		vkDestroyFence(LogicalDevice, VkFences[i], VkAllocators);
-	}
-	for(i = 0; VkShaderModules[i] != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyShaderModule(LogicalDevice, VkShaderModules[i], VkAllocators);
-	}
-	for(i = 0; VkPipelines[i] != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyPipeline(LogicalDevice, VkPipelines[i], VkAllocators);
-	}
-	for(i = 0; VkPipelineLayouts[i] != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyPipelineLayout(LogicalDevice, VkPipelineLayouts[i], VkAllocators);
-	}
-	for(i = 0; VkRenderPasses[i] != VK_NULL_HANDLE; i++)
-	{
-		vkDestroyRenderPass(LogicalDevice, VkRenderPasses[i], VkAllocators);
-	}
-	for(i = 0; DeviceHeapCount; i++)
-	{
-		VkDeviceFree(i, DeviceHeaps[i].DeviceMemory);
-	}
+	GenerateColorPalette();
+	PixelTexture.Data = NULL; //SampleTexture(SwchImageSize.width, SwchImageSize.height);
+	PixelTexture.Width = SwchImageSize.width;
+	PixelTexture.Height = SwchImageSize.height;
+	PixelTexture.ImageType = VK_IMAGE_TYPE_2D;
+	PixelTexture.ImageViewType = VK_IMAGE_VIEW_TYPE_2D;
+	PixelTexture.Format = VK_FORMAT_R8G8B8A8_UNORM;
+	PixelTexture.Usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
-	vkDestroyDescriptorPool(LogicalDevice, DescriptorPool, VkAllocators);
-	vkDestroyDescriptorSetLayout(LogicalDevice, VertUniformDescriptorSetLayout, VkAllocators);
-	vkDestroyDescriptorSetLayout(LogicalDevice, FragUniformDescriptorSetLayout, VkAllocators);
-	vkDestroyDescriptorSetLayout(LogicalDevice, FragSamplerDescriptorSetLayout, VkAllocators);
-	vkDestroySampler(LogicalDevice, PointSampler, VkAllocators);
-	vkDestroySwapchainKHR(LogicalDevice, VkSwapchains[0], VkAllocators);
-	vkDestroySurfaceKHR(Instance, VkSurface, VkAllocators);
-	vkDestroyDevice(LogicalDevice, VkAllocators);
-	vkDestroyInstance(Instance, VkAllocators);
-}
+	CreateHostTexture(&PixelTexture);
+	//CreateTexture(&PixelTexture);
 
-b32 InitVulkan(PFN_vkGetInstanceProcAddr *GetProcAddr, u32 ReqExCount, const char **RequiredExtensions)
-{
-	u32 i;
+	VkDescriptorImageInfo DescriptorII;
+	DescriptorII.sampler = PointSampler;
+	DescriptorII.imageView = PixelTexture.ImageView; 
+	DescriptorII.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	if(!GetProcAddr || !RequiredExtensions || !ReqExCount)
-	{
-		return false;
-	}
-	vkGetInstanceProcAddr = *GetProcAddr;
+	WriteDS.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	WriteDS.pBufferInfo = NULL; //this is not a uniform buffer. 
+	WriteDS.pImageInfo = &DescriptorII;
+	WriteDS.dstSet = FragSamplerDescriptorSet;
+	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
 
-	#define GLOBAL_LEVEL_VULKAN_FUNCTION( name )				\
-    	name = (PFN_##name) (vkGetInstanceProcAddr(NULL, #name));	\
-    	if(name == NULL)							\
-      	{									\
-		Fatal("Could not load global Vulkan function: %s", #name);	\
-		return false;							\
-      	}else								\
-      	{Info("Loaded global Vulkan function: %s", #name);}	\
+	//UploadTexture(&PixelTexture);
 
-	#define TINY_VULKAN_UPDATE
-	#include "tiny_vulkan.h"
+	//End DESCRIPTOR SETS
 
-	u32 ExtensionCount;
-	VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &ExtensionCount, NULL));
-	VkExtensionProperties InstanceExtensions[ExtensionCount];
-	VK_CHECK(vkEnumerateInstanceExtensionProperties(NULL, &ExtensionCount, &InstanceExtensions[0]));
+	//DEPTH BUFFER
 
-	for(u32 c = 0; c < ReqExCount; c++)
+	// Find depth format
+	VkFormatProperties FormatProperties;
+	vkGetPhysicalDeviceFormatProperties(GpuDevice, VK_FORMAT_X8_D24_UNORM_PACK32, &FormatProperties);
+	b32 X8_d24_support = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+	vkGetPhysicalDeviceFormatProperties(GpuDevice, VK_FORMAT_D32_SFLOAT, &FormatProperties);
+	b32 D32_support = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+
+	DepthFormat = VK_FORMAT_D16_UNORM;
+	if (X8_d24_support)
 	{
-		for(i = 0; i<ExtensionCount; i++)
-		{
-			if(strstr((char*)&InstanceExtensions[i], RequiredExtensions[c]))
-			{
-				Info("Using instance extension: %s ", RequiredExtensions[c]);
-				goto _continue;
-			}
-		}
-		Debug("Available Extensions: ");
-		for(i = 0; i<ExtensionCount; i++)
-		{
-			Debug("%s", (char*)&InstanceExtensions[i]);
-		}
-		Fatal("Extension %s  is not supported!", RequiredExtensions[c]);
-		return false;
-_continue:;
+		Trace("Using X8_D24 depth buffer format");
+		DepthFormat = VK_FORMAT_X8_D24_UNORM_PACK32;
 	}
-
-	VkApplicationInfo AppI =
+	else if(D32_support)
 	{
-		VK_STRUCTURE_TYPE_APPLICATION_INFO,
-		NULL,
-		"TinyEngine",
-		VK_MAKE_VERSION(1,0,0),
-		"TinyEngine",
-		VK_MAKE_VERSION(1,0,0),
-		VK_MAKE_VERSION(1,0,0)
-	};
+		Trace("Using D32 depth buffer format");
+		DepthFormat = VK_FORMAT_D32_SFLOAT;
+	}
 
-	VkInstanceCreateInfo InstanceCI;
-	InstanceCI.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	InstanceCI.pNext = NULL;
-	InstanceCI.flags = 0;
-	InstanceCI.pApplicationInfo = &AppI;
-	InstanceCI.enabledLayerCount = 0;
-	InstanceCI.ppEnabledLayerNames = NULL;
-	InstanceCI.enabledExtensionCount = ReqExCount;
-	InstanceCI.ppEnabledExtensionNames = &RequiredExtensions[0];
+	CreateDepthBuffer();
 
-#ifdef TINYENGINE_DEBUG
-	const char* DebugLayers[] =
-	{
-		"VK_LAYER_KHRONOS_validation"
-	};
-	if(!CheckValidationLayerSupport(DebugLayers, ArrayCount(DebugLayers)))
+	//End DEPTH BUFFER
+
+	//OTHER FEATURES
+	b32 BlitSupport = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) != 0;
+	if(!BlitSupport)
 	{
-		Warn("Debug Layers are not found! ");
+		Fatal("Device does not support VK_FORMAT_FEATURE_BLIT_SRC_BIT.");
+		abort();
 	}
-	else
+	BlitSupport = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
+	if(!BlitSupport)
 	{
-		InstanceCI.enabledLayerCount = ArrayCount(DebugLayers);
-		InstanceCI.ppEnabledLayerNames = DebugLayers;
+		Fatal("Device does not support VK_FORMAT_FEATURE_BLIT_DST_BIT.");
+		abort();
 	}
-#endif
+	//End OTHER FEATURES
+
+	//Renderpass
+	VkAttachmentDescription Attachments[2];
+	Attachments[0].flags = VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT;
+	Attachments[0].format = SwchImageFormat;
+	Attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	Attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	Attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	Attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	Attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	Attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+	Attachments[1].flags = VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT;
+	Attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	Attachments[1].format = DepthFormat;
+	Attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	Attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	Attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	Attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	Attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	Attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-	//define custom vulkan allocators
-	//allocators = NULL;
-	if(VkAllocators)
-	{
-		void *VkMemory = Tiny_Malloc(8000000); //8MB
-		ZInitZone(VkMemory, 8000000, 8, 0);
-		VkAllocators->pUserData = NULL;
-		VkAllocators->pfnAllocation = (PFN_vkAllocationFunction)VkAlloc;
-		VkAllocators->pfnReallocation = (PFN_vkReallocationFunction)VkRealloc;
-		VkAllocators->pfnFree = (PFN_vkFreeFunction)VkFree;
-		VkAllocators->pfnInternalAllocation = NULL;
-		VkAllocators->pfnInternalFree = NULL;
-	}
-	VK_CHECK(vkCreateInstance(&InstanceCI, VkAllocators, &Instance));
+	VkAttachmentReference colorAttachment;
+	colorAttachment.attachment = 0;
+	colorAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depthAttachment;
+	depthAttachment.attachment = 1;
+	depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-	#define INSTANCE_LEVEL_VULKAN_FUNCTION( name )				\
-    	name = (PFN_##name) (vkGetInstanceProcAddr(Instance, #name));	\
-    	if(name == NULL)							\
-      	{									\
-		Fatal("Could not load instance Vulkan function: %s", #name);	\
-		return false;							\
-      	}else								\
-      	{Info("Loaded instance Vulkan function: %s", #name);}	\
+	VkSubpassDescription Subpass[1];
+	Subpass[0].flags = 0;
+	Subpass[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	Subpass[0].inputAttachmentCount = 0;
+	Subpass[0].pInputAttachments = NULL;
+	Subpass[0].colorAttachmentCount = 1;
+	Subpass[0].pColorAttachments = &colorAttachment;
+	Subpass[0].pResolveAttachments = NULL;
+	Subpass[0].pDepthStencilAttachment = &depthAttachment;
+	Subpass[0].preserveAttachmentCount = 0;
+	Subpass[0].pPreserveAttachments = NULL;
 
-	#define TINY_VULKAN_UPDATE
-	#include "tiny_vulkan.h"
+	VkRenderPassCreateInfo RenderPassCI;
+	RenderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	RenderPassCI.pNext = NULL;
+	RenderPassCI.flags = 0;
+	RenderPassCI.attachmentCount = 2;
+	RenderPassCI.pAttachments = Attachments;
+	RenderPassCI.subpassCount = 1;
+	RenderPassCI.pSubpasses = &Subpass[0];
+	RenderPassCI.dependencyCount = 0;
+	RenderPassCI.pDependencies = NULL;
 
-	//(Kyryl): For what it takes, do not touch this code !
-	//C preprocessor is an evil thing!
-	#define INSTANCE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( name, extension ) \
-	for(i = 0; i<ReqExCount; i++) {				\
-		if( strstr(RequiredExtensions[i], extension) ) { \
-			name = (PFN_##name)vkGetInstanceProcAddr( Instance, #name );	\
-			if( name == NULL ){						\
-				Warn("Could not load instance-level Vulkan function named: %s", #name);  \
-				return false;                                                        \
-			}else                                                                       \
-			{Info("Loaded function from extension: %s", #name);}		\
-		}\
-	}  
-	#define TINY_VULKAN_UPDATE
-	#include "tiny_vulkan.h"
+	VK_CHECK(vkCreateRenderPass(LogicalDevice, &RenderPassCI, 0, &VkRenderPasses[0]));
 
-#ifdef TINYENGINE_DEBUG
-	RegisterDebugCallback();
+	CreateSwchFrameBuffers();
+
+	//End Renderpass
+
+	//SHADERS & PIPELINE
+
+	//TODO:Implement pipeline cache.
+
+#ifdef HEX_SHADERS
+#include "Vbasic.h"
+#include "Fbasic.h"
+#include "Fsampler2D.h"
+#include "Flightning.h"
+#include "Vinstanced.h"
+#include "Vpulled.h"
+	LoadHexShader(Vbasic, ArrayCount(Vbasic)*sizeof(u32));
+	LoadHexShader(Fbasic, ArrayCount(Fbasic)*sizeof(u32));
+	LoadHexShader(Fsampler2D, ArrayCount(Fsampler2D)*sizeof(u32));
+	LoadHexShader(Flightning, ArrayCount(Flightning)*sizeof(u32));
+	LoadHexShader(Vinstanced, ArrayCount(Vinstanced)*sizeof(u32));
+	LoadHexShader(Vpulled, ArrayCount(Vpulled)*sizeof(u32));
+#else
+	LoadShader("../src/shaders/Vbasic.spv");
+	LoadShader("../src/shaders/Fbasic.spv");
+	LoadShader("../src/shaders/Fsampler2D.spv");
+	LoadShader("../src/shaders/Flightning.spv");
+	LoadShader("../src/shaders/Vinstanced.spv");
+	LoadShader("../src/shaders/Vpulled.spv");
 #endif
 
-	u32 DeviceCount = 0;
-	VK_CHECK(vkEnumeratePhysicalDevices(Instance, &DeviceCount, NULL));
-	ASSERT(DeviceCount, "No Gpus enumerated");
+	//NOTE(Kyryl): Every layout declares the same push constant range, so
+	//pushed values survive pipeline switches, see BindDrawItem.
+	VkPushConstantRange PushConstantRange;
+	PushConstantRange.stageFlags = PUSH_CONSTANT_STAGES;
+	PushConstantRange.offset = 0;
+	PushConstantRange.size = MAX_PUSH_CONSTANTS;
 
-	VkPhysicalDevice Devices[DeviceCount];
-	VK_CHECK(vkEnumeratePhysicalDevices(Instance, &DeviceCount, &Devices[0]));
-	
-	u32 DeviceExtensionCount = 0;
-	GpuDevice = VK_NULL_HANDLE;
-	for(i = 0; i<DeviceCount; i++)
+	//Basic
+	VkPipelineLayoutCreateInfo PipelineLayoutCI;
+	PipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	PipelineLayoutCI.pNext = NULL;
+	PipelineLayoutCI.flags = 0;
+	PipelineLayoutCI.setLayoutCount = 0;
+	PipelineLayoutCI.pSetLayouts = NULL;
+	PipelineLayoutCI.pushConstantRangeCount = 1;
+	PipelineLayoutCI.pPushConstantRanges = &PushConstantRange;
+	VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[0]));
+
+	//Sampler
+	{
+		VkDescriptorSetLayout SetLayouts[] = {VertUniformDescriptorSetLayout, FragUniformDescriptorSetLayout, FragSamplerDescriptorSetLayout};
+		PipelineLayoutCI.setLayoutCount = ArrayCount(SetLayouts);
+		PipelineLayoutCI.pSetLayouts = SetLayouts;
+		VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[1]));
+	}
+	//Lightning, push constants only
+	PipelineLayoutCI.setLayoutCount = 0;
+	PipelineLayoutCI.pSetLayouts = NULL;
+	VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[2]));
+	//Pulled, the sampler layout's sets plus the geometry at set 3
 	{
-		VK_CHECK(vkEnumerateDeviceExtensionProperties(Devices[i], NULL, &DeviceExtensionCount, NULL));
-
-		VkExtensionProperties ExtensionProperties[DeviceExtensionCount];
-
-		VK_CHECK(vkEnumerateDeviceExtensionProperties(Devices[i], NULL, &DeviceExtensionCount, &ExtensionProperties[0]));
+		VkDescriptorSetLayout SetLayouts[] = {VertUniformDescriptorSetLayout, FragUniformDescriptorSetLayout, FragSamplerDescriptorSetLayout, GeometryDescriptorSetLayout};
+		PipelineLayoutCI.setLayoutCount = ArrayCount(SetLayouts);
+		PipelineLayoutCI.pSetLayouts = SetLayouts;
+		VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[PULLED_LAYOUT]));
+	}
+	CreateShaderPipelines(); //does them all at once.
 
-		vkGetPhysicalDeviceFeatures(Devices[i], &DeviceFeatures);
-		vkGetPhysicalDeviceProperties(Devices[i], &DeviceProperties);
+	//End SHADERS & PIPELINE
 
-		if(DeviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU && DeviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-		{
-			continue;
-		}
-		else
-		{
-			//Found a Gpu
-			u32 Size = (sizeof(VkExtensionProperties)  *DeviceExtensionCount);
-			VkDeviceExtensionProperties = (VkExtensionProperties*) Tiny_Malloc(Size);
-			memcpy(VkDeviceExtensionProperties, ExtensionProperties, Size);
-			DeviceExtPropCount = DeviceExtensionCount;
-			GpuDevice = Devices[i];
+	//End RENDER RESOURCES
 
-			Trace("Using Device: %s", DeviceProperties.deviceName);
-			break;
-		}
+	Trace("Reached target: (Init) Final Step");
 
-	}
-	ASSERT(GpuDevice, "Found no matching GpuDevice!");
+	//POST INIT
+	//(Kyryl): Prepares vulkan objects used at real time rendering.
+	PostInit();
 
-	//Surface 
-	//Is created via platform layer callback.
-	SurfaceCallback(&VkSurface); 
+	//End POST INIT
+	return true;
 
-	u32 ModesCount = 0;
-	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(GpuDevice, VkSurface, &ModesCount, NULL));
-	ASSERT(ModesCount, "Failed to enumerate presentation modes!");
+}
 
-	VkPresentModeKHR PresentModes[ModesCount];
-	VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(GpuDevice, VkSurface, &ModesCount, &PresentModes[0]));
+void PostInit()
+{
+	//Sanity checks
+	MAX_FRAMES_IN_FLIGHT = SwchImageCount - 1;
+	FrameSlotCount = MAX_FRAMES_IN_FLIGHT;
+	ASSERT(MAX_FRAMES_IN_FLIGHT < NUM_SEMAPHORES, "MAX_FRAMES_IN_FLIGHT > NUM_SEMAPHORES");
+	ASSERT(MAX_FRAMES_IN_FLIGHT < NUM_FENCES, "MAX_FRAMES_IN_FLIGHT > NUM_FENCES");
 
-	//TODO(Kyryl): This is important, need a proper fallback if not listed.
-	PresentationMode = VK_PRESENT_MODE_FIFO_KHR;
-	//PresentationMode = VK_PRESENT_MODE_MAILBOX_KHR;
-	for(i = 0; i<ModesCount; i++)
+	//SPRITE STREAM
+	SpriteVertexBuffer.Size = NUM_SPRITE_QUADS * 4 * sizeof(vertex_t) * MAX_FRAMES_IN_FLIGHT;
+	SpriteVertexBuffer.Data = VkHostMalloc(SpriteVertexBuffer.Size, &SpriteVertexBuffer.Buffer, &SpriteVertexBuffer.DeviceMemory, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	SpriteIndexBuffer.Size = NUM_SPRITE_QUADS * 6 * sizeof(u16);
+	SpriteIndexBuffer.Data = VkHostMalloc(SpriteIndexBuffer.Size, &SpriteIndexBuffer.Buffer, &SpriteIndexBuffer.DeviceMemory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	u16 *QuadIndices = (u16*) SpriteIndexBuffer.Data;
+	for(u32 i = 0; i < NUM_SPRITE_QUADS; i++)
 	{
-		if(PresentModes[i]==PresentationMode)
-		{
-			break;
-		}
+		QuadIndices[i*6+0] = i*4+0;
+		QuadIndices[i*6+1] = i*4+1;
+		QuadIndices[i*6+2] = i*4+2;
+		QuadIndices[i*6+3] = i*4+2;
+		QuadIndices[i*6+4] = i*4+3;
+		QuadIndices[i*6+5] = i*4+0;
 	}
-	ASSERT(i != ModesCount, "Presentation mode is not supported!");
 
-	//NOTE(Kyryl): This is necessary for swapchain resize.
-	VK_CHECK(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(GpuDevice, VkSurface, &SurfaceCapabilities));
-	SwchImageSize = SurfaceCapabilities.currentExtent;
-	//End Surface
+	//FRAME RING
+	FrameRing.Size = FRAME_RING_SIZE * MAX_FRAMES_IN_FLIGHT;
+	FrameRing.Data = VkHostMalloc(FrameRing.Size, &FrameRing.Buffer, &FrameRing.DeviceMemory, 
+	(VkBufferUsageFlagBits)(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT));
+	FrameRingUsed = 0;
 
-	//Vulkan Queue init. 
-	u32 QFamiliesCount;
-	vkGetPhysicalDeviceQueueFamilyProperties(GpuDevice, &QFamiliesCount, NULL);
-	ASSERT(QFamiliesCount, "Could not enumerate family queues!");
+	//VERTEX PULLING
+	VkDescriptorSetAllocateInfo DescriptorSetAI;
+	DescriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	DescriptorSetAI.pNext = NULL;
+	DescriptorSetAI.descriptorPool = DescriptorPool;
+	DescriptorSetAI.descriptorSetCount = 1;
+	DescriptorSetAI.pSetLayouts = &GeometryDescriptorSetLayout;
+	VK_CHECK(vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &GeometryDescriptorSet));
 
-	VkQueueFamilyProperties QueueFamilies[QFamiliesCount];
-	vkGetPhysicalDeviceQueueFamilyProperties(GpuDevice, &QFamiliesCount, &QueueFamilies[0]);
+	VkDescriptorBufferInfo DescriptorBI[2];
+	DescriptorBI[0].buffer = VertexBuffers[0].Buffer;
+	DescriptorBI[0].offset = 0;
+	DescriptorBI[0].range = VK_WHOLE_SIZE;
+	DescriptorBI[1].buffer = FrameRing.Buffer;
+	DescriptorBI[1].offset = 0;
+	DescriptorBI[1].range = VK_WHOLE_SIZE;
 
-	//(Kyryl): Find a graphics Queue.
-	//In case we require move than 1 queue, just copy paste this code with different flags.
-	for(i = 0; i<QFamiliesCount; ++i)
+	VkWriteDescriptorSet WriteDS;
+	WriteDS.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	WriteDS.pNext = NULL;
+	WriteDS.dstSet = GeometryDescriptorSet;
+	WriteDS.dstBinding = 0;
+	WriteDS.dstArrayElement = 0;
+	WriteDS.descriptorCount = 1;
+	WriteDS.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	WriteDS.pImageInfo = NULL;
+	WriteDS.pBufferInfo = &DescriptorBI[0];
+	WriteDS.pTexelBufferView = NULL;
+	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
+	WriteDS.dstBinding = 1;
+	WriteDS.pBufferInfo = &DescriptorBI[1];
+	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
+
+	CurrentFrame = 0;
+	FrameCount = 0;
+
+	for(u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		if(QueueFamilies[i].queueCount > 0 && (QueueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == VK_QUEUE_GRAPHICS_BIT)
-		{
-			break;
-		}
+		VkPipelineSF[i] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 	}
-	ASSERT(i != QFamiliesCount, "Graphics Queue not found.");
-	QueueIndex[0] = i;
-	QueuePriority[0] = 1.0f;
+	ColorValue.float32[0] = 0;
+	ColorValue.float32[1] = 0;
+	ColorValue.float32[2] = 0;
+	ColorValue.float32[3] = 1;
+	VkClearValues[0].color = ColorValue;
+	VkClearValues[1].depthStencil.depth = 1.0f;
+	VkClearValues[1].depthStencil.stencil = 0;
 
-	VkBool32 PresentationSupport = VK_FALSE;
-	VK_CHECK(vkGetPhysicalDeviceSurfaceSupportKHR(GpuDevice, i, VkSurface, &PresentationSupport));
-	ASSERT(PresentationSupport, "Presentation not supported on Queue index %d", i);
-	QueueIndex[0] = i;
+	ImageSubResourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	ImageSubResourceRange.baseMipLevel = 0;
+	ImageSubResourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	ImageSubResourceRange.baseArrayLayer = 0;
+	ImageSubResourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
 
+	SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	SubmitInfo.pNext = NULL;
+	SubmitInfo.pWaitSemaphores = &VkSignalSemaphores[0];
+	SubmitInfo.pCommandBuffers = &VkFrameCommandBuffers[0][0];
+	SubmitInfo.pSignalSemaphores = &VkWaitSemaphores[0];
+	SubmitInfo.waitSemaphoreCount = 1;
+	SubmitInfo.commandBufferCount = 1;
+	SubmitInfo.signalSemaphoreCount = 1;
+	SubmitInfo.pWaitDstStageMask = &VkPipelineSF[0];
 
-	//LogicalDevice
-	//The reason it's named like this is because we can derive multiple of these 
-	//objects from single GpuDevice. Probably the most used object in Vulkan.
+	PresentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	PresentInfo.pNext = NULL;
+	PresentInfo.waitSemaphoreCount = 1;
+	PresentInfo.swapchainCount = 1;
+	PresentInfo.pResults = NULL;
+	PresentInfo.pSwapchains = &VkSwapchains[0];
+	PresentInfo.pImageIndices = &ImageIndexes[0];
+	PresentInfo.pWaitSemaphores = &VkWaitSemaphores[0];
 
-	const char *DeviceExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-	for(u32 c = 0; c < ArrayCount(DeviceExtensions); c++)
-	{
-		for(i = 0; i < DeviceExtPropCount; i++)
-		{
-			if(strstr(DeviceExtensions[c], (char*)&VkDeviceExtensionProperties[i]))
-			{
-				Info("Using device extension: %s ", DeviceExtensions[c]);
-				goto __continue;
-			}
-		}
-		Debug("Available Extensions: ");
-		for(i = 0; i < DeviceExtPropCount; i++)
-		{
-			Debug("%s", (char*)&VkDeviceExtensionProperties[i]);
-		}
-		Fatal("Extension %s is not supported by physical device!", DeviceExtensions[c]);
-		return false;
-__continue:;
-	}
+#ifdef TINYENGINE_DEBUG
+	//query pool;
+	VkQueryPoolCreateInfo QueryPoolCI;
+	QueryPoolCI.pNext = NULL;
+	QueryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	QueryPoolCI.flags = 0;
+	QueryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	QueryPoolCI.queryCount = 128;
+	QueryPoolCI.pipelineStatistics = 0;
+	VK_CHECK(vkCreateQueryPool(LogicalDevice, &QueryPoolCI, VkAllocators, &QueryPool));
+#endif
 
-	VkDeviceQueueCreateInfo QueueCI[NUM_QUEUES];
-	for(i = 0; i<NUM_QUEUES; i++)
-	{
-		QueueCI[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		QueueCI[i].pNext = NULL;
-		QueueCI[i].flags = 0;
-		QueueCI[i].queueFamilyIndex = QueueIndex[i];
-		QueueCI[i].queueCount = 1;
-		QueueCI[i].pQueuePriorities = &QueuePriority[i];
-	}
+}
 
-	VkDeviceCreateInfo DeviceCI;
-	DeviceCI.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	DeviceCI.pNext = NULL;
-	DeviceCI.flags = 0;
-	DeviceCI.queueCreateInfoCount = NUM_QUEUES;
-	DeviceCI.pQueueCreateInfos = &QueueCI[0];
-	DeviceCI.enabledLayerCount = 0;
-	DeviceCI.ppEnabledLayerNames = NULL;
-	DeviceCI.enabledExtensionCount = ArrayCount(DeviceExtensions);
-	DeviceCI.ppEnabledExtensionNames = &DeviceExtensions[0];
-	DeviceCI.pEnabledFeatures = &DeviceFeatures;
-	VK_CHECK(vkCreateDevice(GpuDevice, &DeviceCI, VkAllocators, &LogicalDevice));
+//NOTE(Kyryl): 
+//Currently not used for anything but you can
+//use this to blit to the screen or vise versa, aka screenshot.
+void BlitSurface()
+{
 
-	//End LogicalDevice
+	VkImageMemoryBarrier MemBarrier;
+	MemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	MemBarrier.pNext = NULL;
+	MemBarrier.srcAccessMask = 0;
+	MemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	MemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	MemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	MemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	MemBarrier.image = VkSwchImages[ImageIndexes[CurrentFrame]];
+	MemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	MemBarrier.subresourceRange.baseMipLevel = 0;
+	MemBarrier.subresourceRange.levelCount = 1;
+	MemBarrier.subresourceRange.baseArrayLayer = 0;
+	MemBarrier.subresourceRange.layerCount = 1;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
 
-	// Load core Vulkan API device-level functions
-#define DEVICE_LEVEL_VULKAN_FUNCTION( name )				\
-	name = (PFN_##name)vkGetDeviceProcAddr( LogicalDevice, #name );	\
-	if( name == NULL ) {						\
-		Warn("Could not load device-level Vulkan function named: %s",#name); \
-		return false;							\
-	}else	{								\
-		Info("Loaded device-level function: %s",#name);} \
+	MemBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	MemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	MemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	MemBarrier.image = PixelTexture.Image;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
 
-#define TINY_VULKAN_UPDATE
-#include "tiny_vulkan.h"
+	VkImageBlit imageBlitRegion;
+	imageBlitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBlitRegion.srcSubresource.mipLevel = 0;
+	imageBlitRegion.srcSubresource.baseArrayLayer = 0;
+	imageBlitRegion.srcSubresource.layerCount = 1;
+	imageBlitRegion.srcOffsets[0].x = 0;
+	imageBlitRegion.srcOffsets[0].y = 0;
+	imageBlitRegion.srcOffsets[0].z = 0;
+	imageBlitRegion.srcOffsets[1].x = PixelTexture.Width;
+	imageBlitRegion.srcOffsets[1].y = PixelTexture.Height;
+	imageBlitRegion.srcOffsets[1].z = 1;
+	imageBlitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageBlitRegion.dstSubresource.mipLevel = 0;
+	imageBlitRegion.dstSubresource.baseArrayLayer = 0;
+	imageBlitRegion.dstSubresource.layerCount = 1;
+	imageBlitRegion.dstOffsets[0].x = 0;
+	imageBlitRegion.dstOffsets[0].y = 0;
+	imageBlitRegion.dstOffsets[0].z = 0;
+	imageBlitRegion.dstOffsets[1].x = SwchImageSize.width;
+	imageBlitRegion.dstOffsets[1].y = SwchImageSize.height;
+	imageBlitRegion.dstOffsets[1].z = 1;
 
-	// Load device-level functions from enabled extensions
-#define DEVICE_LEVEL_VULKAN_FUNCTION_FROM_EXTENSION( name, extension )	\
-	for(i = 0; i<ArrayCount(DeviceExtensions); i++) {				\
-		if( strstr(DeviceExtensions[i], extension ) ) { \
-			name = (PFN_##name)vkGetDeviceProcAddr( LogicalDevice, #name );	\
-			if( name == NULL ) {						\
-				Warn("Could not load device-level Vulkan function from extension: %s", #name); \
-				return false;							\
-			}else{								\
-				Info("Loaded device-level function from extension: %s", #name);}	\
-		}									\
-	}
+	vkCmdBlitImage
+		(CommandBuffer,
+		 PixelTexture.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		 VkSwchImages[ImageIndexes[CurrentFrame]], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		 1,
+		 &imageBlitRegion,
+		 VK_FILTER_LINEAR);
 
-#define TINY_VULKAN_UPDATE
-#include "tiny_vulkan.h"
+	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	MemBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
 
-	vkGetDeviceQueue(LogicalDevice, QueueIndex[0], 0, &VkQueues[0]); //Graphics queue.
-	//End Vulkan Queue
+	MemBarrier.image = VkSwchImages[ImageIndexes[CurrentFrame]];
+	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	MemBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
+}
+
+//Fps of 0 uncaps, MaxQueued of 0 allows all frames in flight.
+void VkSetFramePacing(f64 TargetFps, u32 MaxQueued)
+{
+	TargetFrameTime = TargetFps > 0 ? 1.0 / TargetFps : 0;
+	MaxQueuedFrames = MaxQueued;
+	NextFrameTime = Tiny_GetTime() + TargetFrameTime;
+}
 
-	//Swapchain
-	SwchImageCount = SurfaceCapabilities.minImageCount + 1;
-	if(SurfaceCapabilities.maxImageCount > 0 && SwchImageCount > SurfaceCapabilities.maxImageCount)
+void PaceFrame()
+{
+	//Latency limiter, wait until the gpu is at most MaxQueuedFrames behind.
+	u32 Queued = MaxQueuedFrames ? Min(MaxQueuedFrames, MAX_FRAMES_IN_FLIGHT) : MAX_FRAMES_IN_FLIGHT;
+	if(Queued < MAX_FRAMES_IN_FLIGHT && FrameCount >= Queued)
 	{
-		SwchImageCount = SurfaceCapabilities.maxImageCount;
+		VkWaitValue(VkFrameValues[(FrameCount - Queued) % MAX_FRAMES_IN_FLIGHT]);
 	}
-	SwchImageCount += 1;
-
-	VkSwchImageViews = (VkImageView*) Tiny_Malloc(sizeof(VkImageView) * SwchImageCount);
 
-	VkImageUsageFlags TmpImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	SwchImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |  VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-	SwchImageUsage &= SurfaceCapabilities.supportedUsageFlags;
-	ASSERT(TmpImageUsage == SwchImageUsage, "Swapchain images do not support Color | Transfer Attachments");
+	FrameSlack = 0;
+	if(TargetFrameTime <= 0)
+	{
+		return;
+	}
 
-	SwchTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-	if(!(SurfaceCapabilities.supportedTransforms & SwchTransform))
+	f64 Now = Tiny_GetTime();
+	if(Now >= NextFrameTime)
 	{
-		SwchTransform = SurfaceCapabilities.currentTransform;
+		//Late, do not try to catch up with a burst of frames.
+		NextFrameTime = Now + TargetFrameTime;
+		FrameSlackAvg = FrameSlackAvg * 0.95;
+		return;
 	}
 
-	// Enumerate supported swapchain image formats.
-	//NOTE(Kyryl): This is default cofig we are seaching for.
-	u32 FormatCount = 0;
-	VkSurfaceFormatKHR SurfaceFormat;
-	SurfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
-	SurfaceFormat.colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+	FrameSlack = NextFrameTime - Now;
+	Tiny_Sleep(FrameSlack - PacerSpinTime);
+	while(Tiny_GetTime() < NextFrameTime){/*spin*/};
 
-	VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(GpuDevice, VkSurface, &FormatCount, NULL));
-	ASSERT(FormatCount, "Failed to enumerate swapchain image formats.");
+	NextFrameTime += TargetFrameTime;
+	FrameSlackAvg = FrameSlackAvg * 0.95 + FrameSlack * 1000 * 0.05;
+}
 
-	VkSurfaceFormatKHR SurfaceFormats[FormatCount];
-	VK_CHECK(vkGetPhysicalDeviceSurfaceFormatsKHR(GpuDevice, VkSurface, &FormatCount, &SurfaceFormats[0]));
+//Cmd just began, nothing is bound.
+void ResetBindCache(u32 ThreadIndex, VkCommandBuffer Cmd)
+{
+	memset(&BindCaches[ThreadIndex], 0, sizeof(bind_cache_t));
+	BindCaches[ThreadIndex].Cmd = Cmd;
+}
 
-	// Select surface format
-	if(FormatCount == 1 && SurfaceFormats[0].format == VK_FORMAT_UNDEFINED)
+//NOTE(Kyryl): Primary buffer from the slot's pool, in recording state. Submitted
+//with the frame in hand out order, the first one is the frame's own. End them
+//with vkEndCommandBuffer before VkEndRendering. Main thread only.
+VkCommandBuffer VkAllocFrameCommandBuffer()
+{
+	u32 Used = FrameCommandBuffersUsed;
+	ASSERT(Used < NUM_FRAME_COMMAND_BUFFERS, "Increase NUM_FRAME_COMMAND_BUFFERS");
+	if(Used == FrameCommandBufferCounts[CurrentFrame])
 	{
-		SwchImageFormat = SurfaceFormat.format;
-		SwchImageColorSpace = SurfaceFormat.colorSpace;
-		goto out;
+		//Grows once, pool reset keeps it for the next round of this slot.
+		VkCommandBufferAllocateInfo CommandBufferAI;
+		CommandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		CommandBufferAI.pNext = NULL;
+		CommandBufferAI.commandPool = VkFramePools[CurrentFrame][0];
+		CommandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		CommandBufferAI.commandBufferCount = 1;
+		VK_CHECK(vkAllocateCommandBuffers(LogicalDevice, &CommandBufferAI, &VkFrameCommandBuffers[CurrentFrame][Used]));
+		FrameCommandBufferCounts[CurrentFrame]++;
 	}
-	else
-	{
-		for(i = 0; i<FormatCount; i++)
-		{
-			if(SurfaceFormat.format == SurfaceFormats[i].format && SurfaceFormat.colorSpace == SurfaceFormats[i].colorSpace)
-			{
-				SwchImageFormat = SurfaceFormat.format;
-				SwchImageColorSpace = SurfaceFormat.colorSpace;
-				goto out;
-			}
-		}
+	VkCommandBuffer Buffer = VkFrameCommandBuffers[CurrentFrame][Used];
+	FrameCommandBuffersUsed++;
 
-		for(i = 0; i<FormatCount; i++)
-		{
-			if( (SurfaceFormat.format == SurfaceFormats[i].format) )
-			{
-				SwchImageFormat = SurfaceFormat.format;
-				SwchImageColorSpace = SurfaceFormats[i].colorSpace;
-				Warn("Combination of format and colorspace is not supported. Selecting other colorspace.");
-				goto out;
-			}
-		}
-	}
-	SwchImageFormat = SurfaceFormats[0].format;
-	SwchImageColorSpace = SurfaceFormats[0].colorSpace;
-	Warn("Surface format is not supported. Selecting available format - colorspace combination." );
-out:;
+	VkCommandBufferBeginInfo CommandBufferBI;
+	CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	CommandBufferBI.pNext = NULL;
+	CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	CommandBufferBI.pInheritanceInfo = NULL;
 
-    	CreateSwapchain(&VkSwapchains[0], &VkSwapchains[1]);
+	VK_CHECK(vkBeginCommandBuffer(Buffer, &CommandBufferBI));
+	return Buffer;
+}
 
-	//Swapchain Images, required for rendering.
-	//They are treated as special an unique.
-	u32 ImageCount = 0;
-	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, NULL));
-	ASSERT(ImageCount, "Failed to get swapchain image count.");
+//Count = 0 goes back to inline recording. Only between frames.
+void VkSetRecordThreads(u32 Count)
+{
+	ASSERT(!FrameRecording, "VkSetRecordThreads: called inside a frame");
+	ASSERT(Count <= NUM_RECORD_THREADS, "Increase NUM_RECORD_THREADS");
+	RecordThreadCount = Count;
+}
 
-	VkSwchImages = (VkImage*) Tiny_Malloc(sizeof(VkImage) * ImageCount);
+//NOTE(Kyryl): Call from the recording thread after VkBeginRendering and pass
+//the returned buffer to VkCmdDraw*. Slices execute in ThreadIndex order.
+VkCommandBuffer VkBeginThreadRecording(u32 ThreadIndex)
+{
+	ASSERT(ThreadIndex < RecordThreadCount, "VkBeginThreadRecording: thread %d out of range", ThreadIndex);
+	VkCommandBuffer Secondary = VkSecondaryCommandBuffers[CurrentFrame][ThreadIndex];
+
+	VkCommandBufferInheritanceInfo InheritanceInfo;
+	InheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	InheritanceInfo.pNext = NULL;
+	InheritanceInfo.renderPass = VkRenderPasses[0];
+	InheritanceInfo.subpass = 0;
+	InheritanceInfo.framebuffer = VkFramebuffers[ImageIndexes[CurrentFrame]];
+	InheritanceInfo.occlusionQueryEnable = VK_FALSE;
+	InheritanceInfo.queryFlags = 0;
+	InheritanceInfo.pipelineStatistics = 0;
 
-	VK_CHECK(vkGetSwapchainImagesKHR(LogicalDevice, VkSwapchains[0], &ImageCount, &VkSwchImages[0]));
+	VkCommandBufferBeginInfo CommandBufferBI;
+	CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	CommandBufferBI.pNext = NULL;
+	CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	CommandBufferBI.pInheritanceInfo = &InheritanceInfo;
 
-	CreateSwapchainImageViews();
+	VK_CHECK(vkBeginCommandBuffer(Secondary, &CommandBufferBI));
 
-	//End Swapchain
+	//Dynamic state is not inherited.
+	VkRect2D RenderArea;
+	RenderArea.offset.x = 0;
+	RenderArea.offset.y = 0;
+	RenderArea.extent = SwchImageSize;
 
-	//RENDER RESOURCES
-	VkSemaphoreCreateInfo SemaphoreCI;
-	SemaphoreCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	SemaphoreCI.pNext = NULL;
-	SemaphoreCI.flags = 0;
+	VkViewport Viewport;
+	Viewport.x = 0;
+	Viewport.y = 0;
+	Viewport.width = SwchImageSize.width;
+	Viewport.height = SwchImageSize.height;
+	Viewport.minDepth = 0;
+	Viewport.maxDepth = 1;
 
-	for(i = 0; i < NUM_SEMAPHORES; i++)
-	{
-		VK_CHECK(vkCreateSemaphore(LogicalDevice, &SemaphoreCI, VkAllocators, &VkWaitSemaphores[i]));
-		VK_CHECK(vkCreateSemaphore(LogicalDevice, &SemaphoreCI, VkAllocators, &VkSignalSemaphores[i]));
-	}
+	vkCmdSetViewport(Secondary, 0, 1, &Viewport);
+	vkCmdSetScissor(Secondary, 0, 1, &RenderArea);
+	ResetBindCache(ThreadIndex, Secondary);
+	return Secondary;
+}
 
-	VkFenceCreateInfo FenceCI;
-	FenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	FenceCI.pNext = NULL;
-	FenceCI.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+void VkEndThreadRecording(u32 ThreadIndex)
+{
+	VK_CHECK(vkEndCommandBuffer(VkSecondaryCommandBuffers[CurrentFrame][ThreadIndex]));
+	SecondaryRecorded[ThreadIndex] = true;
+}
 
-	for(i = 0; i < NUM_FENCES; i++)
+void BeginFrame()
+{
+	VkResult result;
+
+	PaceFrame();
+
+	//NOTE(Kyryl): Only the slot we are about to reuse has to be retired,
+	//the other MAX_FRAMES_IN_FLIGHT-1 frames keep running on the gpu
+	//while we record this one.
+	f64 WaitBegin = Tiny_GetTime();
+	if(UseTimelineSemaphores)
 	{
-		VK_CHECK(vkCreateFence(LogicalDevice, &FenceCI, VkAllocators, &VkFences[i]));
+		VkWaitValue(VkFrameValues[CurrentFrame]);
+	}
+	else
+	{
+		VK_CHECK(vkWaitForFences(LogicalDevice, 1, &VkFences[CurrentFrame], VK_TRUE, UINT64_MAX));
+		CompletedValue = Max(CompletedValue, VkFrameValues[CurrentFrame]);
 	}
+	FrameWaitAvg = FrameWaitAvg * 0.95 + (Tiny_GetTime() - WaitBegin) * 1000 * 0.05;
 
-	//NOTE(Kyryl): We can have 1 command pool and many buffers
-	//or command pool for every command buffer. 
-	//I will make command pool for every buffer in case of future multithreading.
-	VkCommandPoolCreateInfo CommandPoolCI;
-	CommandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	CommandPoolCI.pNext = NULL;
-	CommandPoolCI.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	CommandPoolCI.queueFamilyIndex = QueueIndex[0]; //graphics queue.
+#ifdef TINYENGINE_DEBUG
+	if(FrameCount >= MAX_FRAMES_IN_FLIGHT)
+	{
+		//Slot has been submitted before, its timestamps are ready now.
+		u64 QueryResults[2];
+		VK_CHECK(vkGetQueryPoolResults(LogicalDevice, QueryPool, CurrentFrame*2, ArrayCount(QueryResults),
+					sizeof(QueryResults), QueryResults, sizeof(QueryResults[0]), VK_QUERY_RESULT_64_BIT));
 
-	//NOTE(Kyryl): they are all on graphics queue currently
-	//If we need compute queue explicitly then make separate VkComputeCommandPools
-	for(i = 0; i<NUM_COMMAND_POOLS; i++)
+		f64 FrameGpuBegin = (f64)QueryResults[0] * DeviceProperties.limits.timestampPeriod * 1e-6;
+		f64 FrameGpuEnd = (f64)QueryResults[1] * DeviceProperties.limits.timestampPeriod * 1e-6;
+		FrameGpuAvg = FrameGpuAvg * 0.95 + (FrameGpuEnd - FrameGpuBegin) * 0.05;
+	}
+#endif
+
+	f64 AcquireBegin = Tiny_GetTime();
+	u32 Rebuilds = SwapchainRebuilds;
+	//Flag first, its acquire makes the time it was raised with visible.
+	b32 Dirty = __atomic_load_n(&SwapchainDirty, __ATOMIC_ACQUIRE);
+	f64 DirtyTime;
+	__atomic_load(&SwapchainDirtyTime, &DirtyTime, __ATOMIC_RELAXED);
+	if(Dirty && AcquireBegin - DirtyTime >= ResizeDebounceTime)
 	{
-		VK_CHECK(vkCreateCommandPool(LogicalDevice, &CommandPoolCI, VkAllocators, &VkCommandPools[i]));
+		RebuildRenderer();
 	}
 
-	//Very basic setup. VkCommandBuffers holds only primary buffers.
-	VkCommandBufferAllocateInfo CommandBufferAI;
-	CommandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	CommandBufferAI.pNext = NULL;
-	CommandBufferAI.commandPool = VkCommandPools[0];
-	CommandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	CommandBufferAI.commandBufferCount = NUM_COMMAND_BUFFERS;
-	VK_CHECK(vkAllocateCommandBuffers(LogicalDevice, &CommandBufferAI, &VkCommandBuffers[0]));
+	//tell hardware to not wait more than 1 second.
+wait:
+	result = vkAcquireNextImageKHR(LogicalDevice, VkSwapchains[0], 1000000000, VkSignalSemaphores[CurrentFrame], VK_NULL_HANDLE, &ImageIndexes[CurrentFrame]);
+	switch( result )
+	{
+	case VK_SUCCESS:
+		break;
+	case VK_SUBOPTIMAL_KHR:
+		//Still presentable, rebuild once the resize settles.
+		if(!__atomic_load_n(&SwapchainDirty, __ATOMIC_ACQUIRE))
+		{
+			Info("VkBeginRendering: VK_SUBOPTIMAL_KHR");
+			VkRequestSwapchainRebuild();
+		}
+		break;
+	case VK_TIMEOUT:
+		Info("VK_TIMEOUT");
+		goto wait;
+	case VK_ERROR_OUT_OF_DATE_KHR:
+		Info("VkBeginRendering: VK_ERROR_OUT_OF_DATE_KHR");
+		//Nothing of this frame is recorded yet and the slot fence
+		//is still signaled, so just rebuild and try again.
+		RebuildRenderer();
+		goto wait;
+	default:
+		VK_CHECK(result);
+		return;
+	}
 
-	ASSERT(NUM_COMMAND_BUFFERS > SwchImageCount+1, "More command buffers needed, increase NUM_COMMAND_BUFFERS");
-	CommandBuffer = VkCommandBuffers[0];
+	if(Rebuilds != SwapchainRebuilds)
+	{
+		f64 RebuildTime = Tiny_GetTime() - AcquireBegin;
+		RebuildTimeMax = Max(RebuildTimeMax, RebuildTime);
+		if(RebuildTime > StallThreshold)
+		{
+			StalledFrames++;
+		}
+	}
 
+	CollectDeferredFrees(false);
+	FrameRecording = true;
+	DeferredFrameFirst = DeferredHead;
 
-	//MEMORY
-	Trace("Reached target: Memory Init");
-	vkGetPhysicalDeviceMemoryProperties(GpuDevice, &DeviceMemoryProperties);
+	//Only reset once we know this slot will be submitted.
+	if(!UseTimelineSemaphores)
+	{
+		VK_CHECK(vkResetFences(LogicalDevice, 1, &VkFences[CurrentFrame]));
+	}
 
-	VertexBuffers[0].Size = 20480;
-	VertexBuffers[0].Data = VkHostMalloc(VertexBuffers[0].Size, &VertexBuffers[0].Buffer, &VertexBuffers[0].DeviceMemory, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-	//Note(Kyryl): vertex buffers require no alignment.
-	ZInitZone(VertexBuffers[0].Data, VertexBuffers[0].Size, 1, 1);
+	while(SubmitStagingBuffer()){/*nothing*/};
 
-	IndexBuffers[0].Size = 20480;
-	IndexBuffers[0].Data = VkHostMalloc(IndexBuffers[0].Size, &IndexBuffers[0].Buffer, &IndexBuffers[0].DeviceMemory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-	// Align to 4 bytes because we allocate both uint16 and uint32
-	// index buffers and alignment must match index size
-	ZInitZone(IndexBuffers[0].Data, IndexBuffers[0].Size, 4, 2);
+	//Fence passed, nothing in this slot's pools is pending anymore.
+	u32 PoolCount = Max(RecordThreadCount, 1);
+	for(u32 i = 0; i < PoolCount; i++)
+	{
+		VK_CHECK(vkResetCommandPool(LogicalDevice, VkFramePools[CurrentFrame][i], 0));
+		SecondaryRecorded[i] = false;
+	}
+	FrameCommandBuffersUsed = 0;
+	SpriteStreamUsed = 0;
+	SpriteDraws = SpriteFrameDraws;
+	SpriteQuads = SpriteFrameQuads;
+	SpriteFrameDraws = 0;
+	SpriteFrameQuads = 0;
+	EntityUploadBytes = EntityFrameBytes;
+	EntityFrameBytes = 0;
+	FrameRingBytes = FrameRingUsed;
+	FrameRingOverflows = FrameRingMisses;
+	FrameRingUsed = 0;
+	FrameRingMisses = 0;
+
+	CommandBuffer = VkAllocFrameCommandBuffer();
+	ResetBindCache(0, CommandBuffer);
 
-	UniformBuffers[0].Size = 20480;
-	UniformBuffers[0].Data = VkHostMalloc(UniformBuffers[0].Size, &UniformBuffers[0].Buffer, &UniformBuffers[0].DeviceMemory, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-	// Align to 32 bytes, min spec requirement.
-	ZInitZone(UniformBuffers[0].Data, UniformBuffers[0].Size, 
-	DeviceProperties.limits.minUniformBufferOffsetAlignment, 3);
+	UpdateHostTextures();
 
-	//STAGING BUFFERS
-	ASSERT(NUM_STAGING_BUFFERS < NUM_FENCES - SwchImageCount, "Increase NUM_FENCES");
-	ASSERT(NUM_STAGING_BUFFERS < NUM_COMMAND_BUFFERS - SwchImageCount, "Increase NUM_COMMAND_BUFFERS");
-	for(i = 0; i < NUM_STAGING_BUFFERS; i++)
-	{
-		//Is not managed by SGM because it does not need to be.
-		//Memory is freed on buffer reset, so no need to do any explicit management.
-		StagingBuffers[i].Size = 16777216; //4096 * 4096
-		StagingBuffers[i].Data = VkHostMalloc(StagingBuffers[i].Size, &StagingBuffers[i].Buffer, &StagingBuffers[i].DeviceMemory,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+#ifdef TINYENGINE_DEBUG
+	//2 timestamps per frame slot.
+	vkCmdResetQueryPool(CommandBuffer, QueryPool, CurrentFrame*2, 2);
+	vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool, CurrentFrame*2);
+#endif
 
-		//Dont't mix render sync and staging.
-		//You could, but why if you can just have them separate, less complex IMO.
-		StagingBuffers[i].CommandBuffer = VkCommandBuffers[SwchImageCount+i];
-		StagingBuffers[i].Fence = VkFences[SwchImageCount+i];
+	VkRect2D RenderArea;
+	RenderArea.offset.x = 0;
+	RenderArea.offset.y = 0;
+	RenderArea.extent.width = SwchImageSize.width;
+	RenderArea.extent.height = SwchImageSize.height;
 
-		//Set into recording state
-		VkCommandBufferBeginInfo CommandBufferBI;
-		CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		CommandBufferBI.pNext = NULL;
-		CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; 
-		CommandBufferBI.pInheritanceInfo = NULL;
+	VkRenderPassBeginInfo RenderPassBI;
+	RenderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	RenderPassBI.pNext = NULL;
+	RenderPassBI.renderPass = VkRenderPasses[0];
+	RenderPassBI.framebuffer = VkFramebuffers[ImageIndexes[CurrentFrame]];
+	RenderPassBI.renderArea = RenderArea;
+	RenderPassBI.clearValueCount = 2;
+	RenderPassBI.pClearValues = VkClearValues;
 
-		VK_CHECK(vkBeginCommandBuffer(StagingBuffers[i].CommandBuffer, &CommandBufferBI));
-		VK_CHECK(vkResetFences(LogicalDevice, 1, &StagingBuffers[i].Fence));
+	if(RecordThreadCount)
+	{
+		vkCmdBeginRenderPass(CommandBuffer, &RenderPassBI, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		//Main thread keeps using VkDraw*, it records slice 0.
+		CommandBuffer = VkBeginThreadRecording(0);
+		return;
 	}
-	//STAGING BUFFERS
 
+	vkCmdBeginRenderPass(CommandBuffer, &RenderPassBI, VK_SUBPASS_CONTENTS_INLINE);
 
-	//End MEMORY
-
-	//SAMPLERS
-	VkSamplerCreateInfo SamplerCI;
-	SamplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	SamplerCI.pNext = NULL;
-	SamplerCI.flags = 0;
-	SamplerCI.magFilter = VK_FILTER_NEAREST;
-	SamplerCI.minFilter = VK_FILTER_NEAREST;
-	SamplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
-	SamplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	SamplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	SamplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	SamplerCI.mipLodBias = 0.0f;
-	SamplerCI.anisotropyEnable = 0;
-	SamplerCI.maxAnisotropy = 1.0f;
-	SamplerCI.compareEnable = 0;
-	SamplerCI.compareOp = 0;
-	SamplerCI.minLod = 0.0f;
-	SamplerCI.maxLod = 0.0f;
-	SamplerCI.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
-	SamplerCI.unnormalizedCoordinates = VK_FALSE;
+	VkViewport Viewport;
+	Viewport.x = 0;
+	Viewport.y = 0;
+	Viewport.width = SwchImageSize.width;
+	Viewport.height = SwchImageSize.height;
+	Viewport.minDepth = 0;
+	Viewport.maxDepth = 1;
 
-	VK_CHECK(vkCreateSampler(LogicalDevice, &SamplerCI, NULL, &PointSampler));
-	//SAMPLERS
+	vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
+	vkCmdSetScissor(CommandBuffer, 0, 1, &RenderArea);
+}
 
-	//DESCRIPTOR SETS
-	//NOTE(Kyryl): 
-	//This is a very commonly used objects and through this we can access resources like
-	//UBOs texture samplers and much more! Think of descriptor set a pointer object.
-	VkDescriptorPoolSize PoolSize[2];
-	PoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	PoolSize[0].descriptorCount = 32;
-	PoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	PoolSize[1].descriptorCount = 2048;
+void EndFrame()
+{
+	if(RecordThreadCount)
+	{
+		VkEndThreadRecording(0);
+		CommandBuffer = VkFrameCommandBuffers[CurrentFrame][0];
 
-	VkDescriptorPoolCreateInfo DescriptorPoolCI;
-	DescriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	DescriptorPoolCI.pNext = NULL;
-	DescriptorPoolCI.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-	DescriptorPoolCI.maxSets = 2080; //2048 + 32
-	DescriptorPoolCI.poolSizeCount = 2;
-	DescriptorPoolCI.pPoolSizes = PoolSize;
-	VK_CHECK(vkCreateDescriptorPool(LogicalDevice, &DescriptorPoolCI, VkAllocators, &DescriptorPool));
+		//Workers must have called VkEndThreadRecording by now.
+		u32 SecondaryCount = 0;
+		VkCommandBuffer Secondaries[NUM_RECORD_THREADS];
+		for(u32 i = 0; i < RecordThreadCount; i++)
+		{
+			if(SecondaryRecorded[i])
+			{
+				Secondaries[SecondaryCount++] = VkSecondaryCommandBuffers[CurrentFrame][i];
+			}
+		}
+		vkCmdExecuteCommands(CommandBuffer, SecondaryCount, Secondaries);
+	}
+	else
+	{
+		FlushDrawBucket(CommandBuffer);
+	}
+	vkCmdEndRenderPass(CommandBuffer);
 
-	//NOTE(Kyryl):
-	//There are many ways to do this and lay out the objects. 
-	//Through experience I think this is the most flexible way.
-	//This covers a lot of need cases, but if more needed, always add here.
+	FrameBindsIssued = 0;
+	FrameBindsSkipped = 0;
+	for(u32 i = 0; i < Max(RecordThreadCount, 1); i++)
+	{
+		FrameBindsIssued += BindCaches[i].BindsIssued;
+		FrameBindsSkipped += BindCaches[i].BindsSkipped;
+	}
 
-	//Vubo = vertex uniform buffer object
-	VkDescriptorSetLayoutBinding VuboSLB;
-	VuboSLB.binding = 0;
-	VuboSLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	VuboSLB.descriptorCount = 1;
-	VuboSLB.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	VuboSLB.pImmutableSamplers = NULL;
+#ifdef TINYENGINE_DEBUG
+	vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool, CurrentFrame*2+1);
+#endif
+	VK_CHECK(vkEndCommandBuffer(CommandBuffer));
 
-	//Fubo = fragment uniform buffer object
-	VkDescriptorSetLayoutBinding FuboSLB;
-	FuboSLB.binding = 0;
-	FuboSLB.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	FuboSLB.descriptorCount = 1;
-	FuboSLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	FuboSLB.pImmutableSamplers = NULL;
+	//One submit per frame, fenced by the slot so the next
+	//VkBeginRendering of this slot knows when it may reuse it.
+	SubmitInfo.pWaitSemaphores = &VkSignalSemaphores[CurrentFrame];
+	SubmitInfo.commandBufferCount = FrameCommandBuffersUsed;
+	SubmitInfo.pCommandBuffers = &VkFrameCommandBuffers[CurrentFrame][0];
+	//NOTE(Kyryl): The present wait semaphore is per swapchain image, not
+	//per slot. The slot fence says nothing about the present having
+	//consumed it, reacquiring the image does.
+	SubmitInfo.pSignalSemaphores = &VkWaitSemaphores[ImageIndexes[CurrentFrame]];
+	VkFrameValues[CurrentFrame] = VkSubmitTimeline(&SubmitInfo, VkFences[CurrentFrame]);
+	FrameRecording = false;
+	StampDeferredFrees(VkFrameValues[CurrentFrame]);
+
+	PresentInfo.pImageIndices = &ImageIndexes[CurrentFrame];
+	PresentInfo.pWaitSemaphores = &VkWaitSemaphores[ImageIndexes[CurrentFrame]];
+	VkResult result = vkQueuePresentKHR(VkQueues[0], &PresentInfo);
+
+	FrameCount++;
+	CurrentFrame = FrameCount % MAX_FRAMES_IN_FLIGHT;
 
-	//Fso = fragment sampler object
-	VkDescriptorSetLayoutBinding FsoSLB;
-	FsoSLB.binding = 0;
-	FsoSLB.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	FsoSLB.descriptorCount = 1;
-	FsoSLB.pImmutableSamplers = NULL;
-	FsoSLB.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+#ifdef TINYENGINE_DEBUG
+	f64 FrameCpuEnd = Tiny_GetTime() * 1000;
+	FrameCpuAvg = FrameCpuAvg * 0.95 + (FrameCpuEnd - (HighTime*1000)) * 0.05;
+	HighTime = Tiny_GetTime();
+
+	//TODO put this somewhere else
+	//p("cpu: %.2f ms; gpu: %.2f ms; wait: %.2f ms; slack: %.2f ms; handoff: %.2f ms", FrameCpuAvg, FrameGpuAvg, FrameWaitAvg, FrameSlackAvg, HandoffLatencyAvg);
+	//p("bucket: %d draws, %d state groups; binds: %d issued, %d skipped", DrawBucketDraws, DrawBucketGroups, FrameBindsIssued, FrameBindsSkipped);
+	//p("flush: %.3f ms; indirect: %d draws in %d calls", FlushCpuAvg, IndirectDraws, IndirectCalls);
+	//p("sprites: %d quads in %d draws", SpriteQuads, SpriteDraws);
+	//p("entity uploads: %d bytes", EntityUploadBytes);
+	//p("frame ring: %d bytes, %d overflows", FrameRingBytes, FrameRingOverflows);
+#endif
 
-	VkDescriptorSetLayoutCreateInfo DescriptorSetLayoutCI;
-	DescriptorSetLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	DescriptorSetLayoutCI.pNext = NULL;
-	DescriptorSetLayoutCI.flags = 0;
-	DescriptorSetLayoutCI.bindingCount = 1;
+	switch(result)
+	{
+		case VK_SUCCESS:
+			break;
+		case VK_SUBOPTIMAL_KHR:
+			if(!__atomic_load_n(&SwapchainDirty, __ATOMIC_ACQUIRE))
+			{
+				Info("VkEndRendering: VK_SUBOPTIMAL_KHR");
+				VkRequestSwapchainRebuild();
+			}
+			break;
+		case VK_ERROR_OUT_OF_DATE_KHR:
+			//Next acquire rebuilds it if it is still out of date then.
+			Info("VkEndRendering: VK_ERROR_OUT_OF_DATE_KHR");
+			if(!__atomic_load_n(&SwapchainDirty, __ATOMIC_ACQUIRE))
+			{
+				VkRequestSwapchainRebuild();
+			}
+			break;
+		default:
+			VK_CHECK(result);
+			return;
+	}
+}
 
-	DescriptorSetLayoutCI.pBindings = &VuboSLB;
-	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &VertUniformDescriptorSetLayout));
-	DescriptorSetLayoutCI.pBindings = &FuboSLB;
-	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &FragUniformDescriptorSetLayout));
-	DescriptorSetLayoutCI.pBindings = &FsoSLB;
-	VK_CHECK(vkCreateDescriptorSetLayout(LogicalDevice, &DescriptorSetLayoutCI, VkAllocators, &FragSamplerDescriptorSetLayout));
+//Binds whatever Item needs that Cmd does not have yet, returns the first vertex.
+u32 BindDrawItem(VkCommandBuffer Cmd, draw_item_t *Item)
+{
+	bind_cache_t Untracked;
+	bind_cache_t *Cache = NULL;
+	for(u32 i = 0; i < NUM_RECORD_THREADS; i++)
+	{
+		if(BindCaches[i].Cmd == Cmd)
+		{
+			Cache = &BindCaches[i];
+			break;
+		}
+	}
+	if(!Cache)
+	{
+		//Buffer from VkAllocFrameCommandBuffer, binds everything.
+		memset(&Untracked, 0, sizeof(bind_cache_t));
+		Cache = &Untracked;
+	}
 
-	//Allocate and write descriptor sets. 
+	VkPipeline Pipeline = VkPipelines[Item->Pipeline];
+	if(Cache->Pipeline != Pipeline)
+	{
+		vkCmdBindPipeline(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Pipeline);
+		Cache->Pipeline = Pipeline;
+		Cache->BindsIssued++;
+	}
+	else
+	{
+		Cache->BindsSkipped++;
+	}
 
-	VkDescriptorSetAllocateInfo DescriptorSetAI;
-	DescriptorSetAI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	DescriptorSetAI.pNext = NULL;
-	DescriptorSetAI.descriptorPool = DescriptorPool;
-	DescriptorSetAI.descriptorSetCount = 1;
+	if(Item->DescriptorSet != VK_NULL_HANDLE)
+	{
+		VkPipelineLayout Layout = VkPipelineLayouts[Item->Layout];
+		if(Cache->Layout != Layout || Cache->DescriptorSet != Item->DescriptorSet || Cache->DynamicOffset != Item->DynamicOffset)
+		{
+			vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, Layout, Item->FirstSet, 1,
+					&Item->DescriptorSet, Item->DynamicOffsetCount, &Item->DynamicOffset);
+			//Other layouts have no set 3, do not count on it surviving.
+			Cache->GeometryBound = Cache->GeometryBound && Item->Layout == PULLED_LAYOUT;
+			Cache->Layout = Layout;
+			Cache->DescriptorSet = Item->DescriptorSet;
+			Cache->DynamicOffset = Item->DynamicOffset;
+			Cache->BindsIssued++;
+		}
+		else
+		{
+			Cache->BindsSkipped++;
+		}
+	}
 
-	DescriptorSetAI.pSetLayouts = &VertUniformDescriptorSetLayout;
-	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &VertUniformDescriptorSet);
+	if(Item->Layout == PULLED_LAYOUT)
+	{
+		if(!Cache->GeometryBound)
+		{
+			vkCmdBindDescriptorSets(Cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelineLayouts[PULLED_LAYOUT], 3, 1,
+					&GeometryDescriptorSet, 0, NULL);
+			Cache->GeometryBound = true;
+			Cache->BindsIssued++;
+		}
+		else
+		{
+			Cache->BindsSkipped++;
+		}
+	}
 
-	DescriptorSetAI.pSetLayouts = &FragUniformDescriptorSetLayout;
-	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &FragUniformDescriptorSet);
+	if(Item->PushSize)
+	{
+		if(Cache->PushSize != Item->PushSize || memcmp(Cache->Push, Item->Push, Item->PushSize))
+		{
+			vkCmdPushConstants(Cmd, VkPipelineLayouts[Item->Layout], PUSH_CONSTANT_STAGES, 0, Item->PushSize, Item->Push);
+			Cache->PushSize = Item->PushSize;
+			memcpy(Cache->Push, Item->Push, Item->PushSize);
+			Cache->BindsIssued++;
+		}
+		else
+		{
+			Cache->BindsSkipped++;
+		}
+	}
 
-	DescriptorSetAI.pSetLayouts = &FragSamplerDescriptorSetLayout;
-	vkAllocateDescriptorSets(LogicalDevice, &DescriptorSetAI, &FragSamplerDescriptorSet);
+	//NOTE(Kyryl): Zone blocks are not vertex aligned. The binding keeps the
+	//remainder and vertexOffset adds the whole vertices, so entities only
+	//rebind when the remainder differs.
+	VkDeviceSize VertexBase = Item->VOffset % Item->VertexStride;
+	u32 FirstVertex = (u32)(Item->VOffset / Item->VertexStride);
+	if(Item->VertexBuffer == VK_NULL_HANDLE)
+	{
+		//Pulled, nothing to bind.
+	}
+	else if(Cache->VertexBuffer != Item->VertexBuffer || Cache->VertexBase != VertexBase)
+	{
+		vkCmdBindVertexBuffers(Cmd, 0, 1, &Item->VertexBuffer, &VertexBase);
+		Cache->VertexBuffer = Item->VertexBuffer;
+		Cache->VertexBase = VertexBase;
+		Cache->BindsIssued++;
+	}
+	else
+	{
+		Cache->BindsSkipped++;
+	}
 
-	VkDescriptorBufferInfo DescriptorBI;
-	DescriptorBI.offset = 0;
-	DescriptorBI.range = MAX_UNIFORM_ALLOC;
+	if(Item->InstanceCount)
+	{
+		if(Cache->InstanceBuffer != Item->InstanceBuffer || Cache->InstanceBase != Item->InstOffset)
+		{
+			vkCmdBindVertexBuffers(Cmd, 1, 1, &Item->InstanceBuffer, &Item->InstOffset);
+			Cache->InstanceBuffer = Item->InstanceBuffer;
+			Cache->InstanceBase = Item->InstOffset;
+			Cache->BindsIssued++;
+		}
+		else
+		{
+			Cache->BindsSkipped++;
+		}
+	}
 
-	VkWriteDescriptorSet WriteDS;
-	WriteDS.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	WriteDS.pNext = NULL;
-	WriteDS.dstBinding = 0;
-	WriteDS.dstArrayElement = 0;
-	WriteDS.descriptorCount = 1;
-	WriteDS.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	WriteDS.pImageInfo = NULL;
-	WriteDS.pBufferInfo = &DescriptorBI;
-	WriteDS.pTexelBufferView = NULL;
+	if(Item->IndexCount)
+	{
+		if(Cache->IndexBuffer != Item->IndexBuffer || Cache->IndexSize != Item->IndexSize)
+		{
+			VkIndexType IndexType = Item->IndexSize == sizeof(u16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+			vkCmdBindIndexBuffer(Cmd, Item->IndexBuffer, 0, IndexType);
+			Cache->IndexBuffer = Item->IndexBuffer;
+			Cache->IndexSize = Item->IndexSize;
+			Cache->BindsIssued++;
+		}
+		else
+		{
+			Cache->BindsSkipped++;
+		}
+	}
+	return FirstVertex;
+}
 
-	DescriptorBI.buffer = UniformBuffers[0].Buffer;
-	WriteDS.dstSet = VertUniformDescriptorSet;
-	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
+void EmitDrawItem(VkCommandBuffer Cmd, draw_item_t *Item)
+{
+	u32 FirstVertex = BindDrawItem(Cmd, Item);
+	u32 InstanceCount = Item->InstanceCount ? Item->InstanceCount : 1;
+	if(Item->IndexCount)
+	{
+		vkCmdDrawIndexed(Cmd, Item->IndexCount, InstanceCount, (u32)(Item->IOffset / Item->IndexSize), (s32)FirstVertex, Item->FirstInstance);
+	}
+	else
+	{
+		vkCmdDraw(Cmd, Item->VertexCount, InstanceCount, FirstVertex, Item->FirstInstance);
+	}
+}
 
-	DescriptorBI.buffer = UniformBuffers[0].Buffer;
-	WriteDS.dstSet = FragUniformDescriptorSet;
-	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
+//Compact per bucket id of a handle, ids past Limit - 1 share the last one.
+u32 BucketId(bucket_ids_t *Table, u64 Handle, u32 Limit)
+{
+	if(!Handle)
+	{
+		return 0;
+	}
+	u32 Slot = (u32)((Handle * 0x9E3779B97F4A7C15ull) >> 32) & (NUM_BUCKET_ID_SLOTS - 1);
+	while(Table->Handles[Slot])
+	{
+		if(Table->Handles[Slot] == Handle)
+		{
+			return Table->Ids[Slot];
+		}
+		Slot = (Slot + 1) & (NUM_BUCKET_ID_SLOTS - 1);
+	}
+	if(Table->Count + 1 >= Limit)
+	{
+		return Limit - 1;
+	}
+	Table->Handles[Slot] = Handle;
+	Table->Ids[Slot] = ++Table->Count;
+	return Table->Count;
+}
 
-	GenerateColorPalette();
-	PixelTexture.Data = NULL; //SampleTexture(SwchImageSize.width, SwchImageSize.height);
-	PixelTexture.Width = SwchImageSize.width;
-	PixelTexture.Height = SwchImageSize.height;
-	PixelTexture.ImageType = VK_IMAGE_TYPE_2D;
-	PixelTexture.ImageViewType = VK_IMAGE_VIEW_TYPE_2D;
-	PixelTexture.Format = VK_FORMAT_R8G8B8A8_UNORM;
-	PixelTexture.Usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+//Records right away unless the bucket is on, worker slices never sort.
+void SubmitDrawItem(VkCommandBuffer Cmd, draw_item_t *Item)
+{
+	if(!DrawSorting || RecordThreadCount)
+	{
+		EmitDrawItem(Cmd, Item);
+		return;
+	}
 
-	CreateHostTexture(&PixelTexture);
-	//CreateTexture(&PixelTexture);
+	ASSERT(DrawItemCount < NUM_BUCKET_DRAWS, "Draw bucket full, increase NUM_BUCKET_DRAWS");
+	u32 Sequence = DrawItemCount;
+	u64 Key;
+	if(Item->Blend)
+	{
+		Key = (u64)DRAW_PASS_BLEND << 60 | Sequence;
+	}
+	else
+	{
+		u64 SetId = BucketId(&BucketSetIds, (u64)(uintptr_t)Item->DescriptorSet, NUM_SET_IDS);
+		u64 BufferId = BucketId(&BucketBufferIds, (u64)(uintptr_t)Item->VertexBuffer, NUM_BUFFER_IDS);
+		Key = (u64)DRAW_PASS_OPAQUE << 60 |
+			(u64)(Item->Pipeline & 0xFF) << 52 |
+			SetId << 44 |
+			BufferId << 38 |
+			(u64)(Item->VOffset % Item->VertexStride) << 32 |
+			(u64)(DrawSortDepth & 0x3FFFF) << 14 |
+			Sequence;
+	}
+	DrawItems[DrawItemCount] = *Item;
+	DrawKeys[0][DrawItemCount].Key = Key;
+	DrawKeys[0][DrawItemCount].Index = DrawItemCount;
+	DrawItemCount++;
+}
 
-	VkDescriptorImageInfo DescriptorII;
-	DescriptorII.sampler = PointSampler;
-	DescriptorII.imageView = PixelTexture.ImageView; 
-	DescriptorII.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+//LSD radix sort by byte, passes where every key has the same digit are skipped.
+draw_key_t *SortDrawKeys(u32 Count)
+{
+	draw_key_t *Src = DrawKeys[0];
+	draw_key_t *Dst = DrawKeys[1];
+	for(u32 Shift = 0; Shift < 64; Shift += 8)
+	{
+		u32 Offsets[256] = {0};
+		for(u32 i = 0; i < Count; i++)
+		{
+			Offsets[(Src[i].Key >> Shift) & 0xFF]++;
+		}
+		if(Offsets[(Src[0].Key >> Shift) & 0xFF] == Count)
+		{
+			continue;
+		}
 
-	WriteDS.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	WriteDS.pBufferInfo = NULL; //this is not a uniform buffer. 
-	WriteDS.pImageInfo = &DescriptorII;
-	WriteDS.dstSet = FragSamplerDescriptorSet;
-	vkUpdateDescriptorSets(LogicalDevice, 1, &WriteDS, 0, NULL);
+		u32 Sum = 0;
+		for(u32 i = 0; i < 256; i++)
+		{
+			u32 Digits = Offsets[i];
+			Offsets[i] = Sum;
+			Sum += Digits;
+		}
+		for(u32 i = 0; i < Count; i++)
+		{
+			Dst[Offsets[(Src[i].Key >> Shift) & 0xFF]++] = Src[i];
+		}
 
-	//UploadTexture(&PixelTexture);
+		draw_key_t *Swap = Src;
+		Src = Dst;
+		Dst = Swap;
+	}
+	return Src;
+}
 
-	//End DESCRIPTOR SETS
+//Indexed, non instanced draws with the same binds can share one indirect call.
+//Pulled draws carry their source in FirstInstance, the indirect command may
+//only hold a nonzero one with drawIndirectFirstInstance (enabled with the
+//rest of DeviceFeatures), otherwise those are drawn directly.
+b32 CanMergeIndirect(draw_item_t *A, draw_item_t *B)
+{
+	return B->IndexCount && !B->InstanceCount &&
+		(DeviceFeatures.drawIndirectFirstInstance || (!A->FirstInstance && !B->FirstInstance)) &&
+		A->Pipeline == B->Pipeline &&
+		A->Layout == B->Layout &&
+		A->DescriptorSet == B->DescriptorSet &&
+		A->DynamicOffset == B->DynamicOffset &&
+		A->VertexBuffer == B->VertexBuffer &&
+		A->IndexBuffer == B->IndexBuffer &&
+		A->IndexSize == B->IndexSize &&
+		A->PushSize == B->PushSize &&
+		!memcmp(A->Push, B->Push, A->PushSize) &&
+		A->VertexStride == B->VertexStride &&
+		A->VOffset % A->VertexStride == B->VOffset % B->VertexStride;
+}
 
-	//DEPTH BUFFER
+//NOTE(Kyryl): One indirect zone block per flush holds every run, the draw
+//counts first and the commands after them, sized for DrawItemCount so the
+//runs always fit. It is taken on the first run and deferred once at the end
+//of the flush, the frame that reads it retires before the block is reused.
+//With VK_KHR_draw_indirect_count the counts are read from the block, a
+//culling pass can later write them on the gpu instead.
+typedef struct indirect_block_t
+{
+	u8 *Block; //zone 4, NULL until the first run
+	u32 CommandsOffset; //bytes, past the counts
+	u32 Commands; //written so far
+	u32 Runs;
+	b32 Failed; //zone full, every run is drawn directly
+} indirect_block_t;
+
+//False if the zone is full, the caller then draws the run directly.
+b32 EmitIndirectRun(VkCommandBuffer Cmd, draw_key_t *Keys, u32 Count, indirect_block_t *Indirect)
+{
+	if(!Indirect->Block && !Indirect->Failed)
+	{
+		Indirect->CommandsOffset = (DrawItemCount * sizeof(u32) + 15) & ~15;
+		u32 Size = Indirect->CommandsOffset + DrawItemCount * sizeof(VkDrawIndexedIndirectCommand);
+		Tiny_Lock(&ZoneLock);
+		Indirect->Block = (u8*) ZMalloc(Size, 4);
+		Tiny_Unlock(&ZoneLock);
+		Indirect->Failed = !Indirect->Block;
+	}
+	if(!Indirect->Block)
+	{
+		return false;
+	}
 
-	// Find depth format
-	VkFormatProperties FormatProperties;
-	vkGetPhysicalDeviceFormatProperties(GpuDevice, VK_FORMAT_X8_D24_UNORM_PACK32, &FormatProperties);
-	b32 X8_d24_support = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
-	vkGetPhysicalDeviceFormatProperties(GpuDevice, VK_FORMAT_D32_SFLOAT, &FormatProperties);
-	b32 D32_support = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) != 0;
+	draw_item_t *First = &DrawItems[Keys[0].Index];
+	BindDrawItem(Cmd, First);
 
-	DepthFormat = VK_FORMAT_D16_UNORM;
-	if (X8_d24_support)
+	u32 CommandsOffset = Indirect->CommandsOffset + Indirect->Commands * sizeof(VkDrawIndexedIndirectCommand);
+	u32 CountOffset = Indirect->Runs * sizeof(u32);
+	VkDrawIndexedIndirectCommand *Commands = (VkDrawIndexedIndirectCommand*)(Indirect->Block + CommandsOffset);
+	for(u32 i = 0; i < Count; i++)
+	{
+		draw_item_t *Item = &DrawItems[Keys[i].Index];
+		Commands[i].indexCount = Item->IndexCount;
+		Commands[i].instanceCount = 1;
+		Commands[i].firstIndex = (u32)(Item->IOffset / Item->IndexSize);
+		Commands[i].vertexOffset = (s32)(Item->VOffset / Item->VertexStride);
+		Commands[i].firstInstance = Item->FirstInstance;
+	}
+	*(u32*)(Indirect->Block + CountOffset) = Count;
+
+	VkDeviceSize Offset;
+	VkBuffer Buffer = ZBuffer(Indirect->Block, 4, &Offset);
+	if(UseDrawIndirectCount)
 	{
-		Trace("Using X8_D24 depth buffer format");
-		DepthFormat = VK_FORMAT_X8_D24_UNORM_PACK32;
+		vkCmdDrawIndexedIndirectCountKHR(Cmd, Buffer, Offset + CommandsOffset,
+				Buffer, Offset + CountOffset, Count, sizeof(VkDrawIndexedIndirectCommand));
 	}
-	else if(D32_support)
+	else
 	{
-		Trace("Using D32 depth buffer format");
-		DepthFormat = VK_FORMAT_D32_SFLOAT;
+		vkCmdDrawIndexedIndirect(Cmd, Buffer, Offset + CommandsOffset, Count, sizeof(VkDrawIndexedIndirectCommand));
 	}
 
-	CreateDepthBuffer();
+	Indirect->Commands += Count;
+	Indirect->Runs++;
+	IndirectDraws += Count;
+	IndirectCalls++;
+	return true;
+}
 
-	//End DEPTH BUFFER
+void FlushDrawBucket(VkCommandBuffer Cmd)
+{
+	DrawBucketDraws = DrawItemCount;
+	DrawBucketGroups = 0;
+	IndirectDraws = 0;
+	IndirectCalls = 0;
+	if(!DrawItemCount)
+	{
+		return;
+	}
+#ifdef TINYENGINE_DEBUG
+	f64 FlushBegin = Tiny_GetTime();
+#endif
 
-	//OTHER FEATURES
-	b32 BlitSupport = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) != 0;
-	if(!BlitSupport)
+	draw_key_t *Keys = SortDrawKeys(DrawItemCount);
+	indirect_block_t Indirect;
+	memset(&Indirect, 0, sizeof(Indirect));
+	draw_item_t *Prev = NULL;
+	u32 i = 0;
+	while(i < DrawItemCount)
 	{
-		Fatal("Device does not support VK_FORMAT_FEATURE_BLIT_SRC_BIT.");
-		abort();
+		draw_item_t *Item = &DrawItems[Keys[i].Index];
+		if(!Prev || Prev->Pipeline != Item->Pipeline || Prev->DescriptorSet != Item->DescriptorSet)
+		{
+			DrawBucketGroups++;
+		}
+
+		u32 Run = 1;
+		if(DrawIndirect && Item->IndexCount && !Item->InstanceCount)
+		{
+			while(i + Run < DrawItemCount && Run < IndirectRunMax &&
+					CanMergeIndirect(Item, &DrawItems[Keys[i + Run].Index]))
+			{
+				Run++;
+			}
+		}
+
+		if(Run == 1 || !EmitIndirectRun(Cmd, &Keys[i], Run, &Indirect))
+		{
+			for(u32 j = 0; j < Run; j++)
+			{
+				EmitDrawItem(Cmd, &DrawItems[Keys[i + j].Index]);
+			}
+		}
+		Prev = &DrawItems[Keys[i + Run - 1].Index];
+		i += Run;
 	}
-	BlitSupport = (FormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
-	if(!BlitSupport)
+	if(Indirect.Block)
 	{
-		Fatal("Device does not support VK_FORMAT_FEATURE_BLIT_DST_BIT.");
-		abort();
+		Tiny_Lock(&ZoneLock);
+		ZDeferFree(Indirect.Block, 4);
+		Tiny_Unlock(&ZoneLock);
 	}
-	//End OTHER FEATURES
-
-	//Renderpass
-	VkAttachmentDescription Attachments[2];
-	Attachments[0].flags = VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT;
-	Attachments[0].format = SwchImageFormat;
-	Attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-	Attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	Attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	Attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	Attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	Attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	Attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	DrawItemCount = 0;
+	memset(&BucketSetIds, 0, sizeof(bucket_ids_t));
+	memset(&BucketBufferIds, 0, sizeof(bucket_ids_t));
 
-	Attachments[1].flags = VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT;
-	Attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-	Attachments[1].format = DepthFormat;
-	Attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	Attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	Attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	Attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	Attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	Attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+#ifdef TINYENGINE_DEBUG
+	FlushCpuAvg = FlushCpuAvg * 0.95 + (Tiny_GetTime() - FlushBegin) * 1000 * 0.05;
+#endif
+}
 
-	VkAttachmentReference colorAttachment;
-	colorAttachment.attachment = 0;
-	colorAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+//Only between frames. Opaque draws must not depend on submission order.
+void VkSetDrawSorting(b32 Enable)
+{
+	ASSERT(!FrameRecording, "VkSetDrawSorting: called inside a frame");
+	DrawSorting = Enable;
+}
 
-	VkAttachmentReference depthAttachment;
-	depthAttachment.attachment = 1;
-	depthAttachment.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+//Any time, decided per draw, see PULLED_PIPELINE.
+void VkSetVertexPulling(b32 Enable)
+{
+	UseVertexPulling = Enable;
+}
 
-	VkSubpassDescription Subpass[1];
-	Subpass[0].flags = 0;
-	Subpass[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	Subpass[0].inputAttachmentCount = 0;
-	Subpass[0].pInputAttachments = NULL;
-	Subpass[0].colorAttachmentCount = 1;
-	Subpass[0].pColorAttachments = &colorAttachment;
-	Subpass[0].pResolveAttachments = NULL;
-	Subpass[0].pDepthStencilAttachment = &depthAttachment;
-	Subpass[0].preserveAttachmentCount = 0;
-	Subpass[0].pPreserveAttachments = NULL;
+//Only has an effect on the sorted bucket, see VkSetDrawSorting.
+void VkSetDrawIndirect(b32 Enable)
+{
+	ASSERT(!FrameRecording, "VkSetDrawIndirect: called inside a frame");
+	if(Enable && !DeviceFeatures.multiDrawIndirect)
+	{
+		Warn("VkSetDrawIndirect: multiDrawIndirect not supported, drawing directly.");
+		Enable = false;
+	}
+	IndirectRunMax = Min(DeviceProperties.limits.maxDrawIndirectCount, 4096);
+	DrawIndirect = Enable;
+}
 
-	VkRenderPassCreateInfo RenderPassCI;
-	RenderPassCI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	RenderPassCI.pNext = NULL;
-	RenderPassCI.flags = 0;
-	RenderPassCI.attachmentCount = 2;
-	RenderPassCI.pAttachments = Attachments;
-	RenderPassCI.subpassCount = 1;
-	RenderPassCI.pSubpasses = &Subpass[0];
-	RenderPassCI.dependencyCount = 0;
-	RenderPassCI.pDependencies = NULL;
+#ifdef TINYENGINE_DEBUG
+#define BUCKET_BENCH_DRAWS 10000
+#define BUCKET_BENCH_ROUNDS 20
 
-	VK_CHECK(vkCreateRenderPass(LogicalDevice, &RenderPassCI, 0, &VkRenderPasses[0]));
+//Indexed quads over the first zone pages, mostly opaque with a blended tail.
+//Never submitted, the offsets only have to stay inside the buffers.
+void FillBenchDrawItem(draw_item_t *Item, u32 *Seed)
+{
+	*Seed = *Seed * 1664525 + 1013904223;
+	u32 Pick = (*Seed >> 24) % 8;
+	Item->Pipeline = Pick < 4 ? 0 : Pick < 7 ? 2 : 3;
+	Item->Layout = Item->Pipeline ? 1 : 0;
+	Item->FirstSet = Item->Pipeline ? 2 : 0;
+	Item->DescriptorSet = Item->Pipeline ? FragSamplerDescriptorSet : VK_NULL_HANDLE;
+	Item->DynamicOffsetCount = 0;
+	Item->DynamicOffset = 0;
+	Item->Blend = Item->Pipeline == 3;
+	Item->VertexBuffer = VertexBuffers[0].Buffer;
+	Item->IndexBuffer = IndexBuffers[0].Buffer;
+	Item->VOffset = ((*Seed >> 4) % 128) * sizeof(vertex_t);
+	Item->IOffset = ((*Seed >> 12) % 256) * 6 * sizeof(u16);
+	Item->VertexCount = 4;
+	Item->IndexCount = 6;
+	Item->IndexSize = sizeof(u16);
+	Item->VertexStride = sizeof(vertex_t);
+	Item->FirstInstance = 0;
+	Item->InstanceBuffer = VK_NULL_HANDLE;
+	Item->InstOffset = 0;
+	Item->InstanceCount = 0;
+	Item->PushSize = 0;
+	DrawSortDepth = *Seed & 0x3FFFF;
+}
 
-	CreateSwchFrameBuffers();
+//Primary buffer of its own in the render pass, tracked by bind cache 0. The
+//caller ends it with EndBenchRecording, it is never submitted.
+VkCommandBuffer BeginBenchRecording(VkCommandPool Pool)
+{
+	VkCommandBufferAllocateInfo CommandBufferAI;
+	CommandBufferAI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	CommandBufferAI.pNext = NULL;
+	CommandBufferAI.commandPool = Pool;
+	CommandBufferAI.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	CommandBufferAI.commandBufferCount = 1;
+	VkCommandBuffer Cmd;
+	VK_CHECK(vkAllocateCommandBuffers(LogicalDevice, &CommandBufferAI, &Cmd));
 
-	//End Renderpass
+	VkCommandBufferBeginInfo CommandBufferBI;
+	CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	CommandBufferBI.pNext = NULL;
+	CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	CommandBufferBI.pInheritanceInfo = NULL;
+	VK_CHECK(vkBeginCommandBuffer(Cmd, &CommandBufferBI));
 
-	//SHADERS & PIPELINE
+	VkRect2D RenderArea;
+	RenderArea.offset.x = 0;
+	RenderArea.offset.y = 0;
+	RenderArea.extent = SwchImageSize;
 
-	//TODO:Implement pipeline cache.
+	VkRenderPassBeginInfo RenderPassBI;
+	RenderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	RenderPassBI.pNext = NULL;
+	RenderPassBI.renderPass = VkRenderPasses[0];
+	RenderPassBI.framebuffer = VkFramebuffers[0];
+	RenderPassBI.renderArea = RenderArea;
+	RenderPassBI.clearValueCount = 2;
+	RenderPassBI.pClearValues = VkClearValues;
+	vkCmdBeginRenderPass(Cmd, &RenderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+	ResetBindCache(0, Cmd);
+	return Cmd;
+}
 
-#ifdef HEX_SHADERS
-#include "Vbasic.h"
-#include "Fbasic.h"
-#include "Fsampler2D.h"
-#include "Flightning.h"
-	LoadHexShader(Vbasic, ArrayCount(Vbasic)*sizeof(u32));
-	LoadHexShader(Fbasic, ArrayCount(Fbasic)*sizeof(u32));
-	LoadHexShader(Fsampler2D, ArrayCount(Fsampler2D)*sizeof(u32));
-	LoadHexShader(Flightning, ArrayCount(Flightning)*sizeof(u32));
-#else
-	LoadShader("../src/shaders/Vbasic.spv");
-	LoadShader("../src/shaders/Fbasic.spv");
-	LoadShader("../src/shaders/Fsampler2D.spv");
-	LoadShader("../src/shaders/Flightning.spv");
-#endif
+void EndBenchRecording(VkCommandPool Pool, VkCommandBuffer Cmd)
+{
+	vkCmdEndRenderPass(Cmd);
+	VK_CHECK(vkEndCommandBuffer(Cmd));
+	vkFreeCommandBuffers(LogicalDevice, Pool, 1, &Cmd);
+}
 
-	//Basic
-	VkPipelineLayoutCreateInfo PipelineLayoutCI;
-	PipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	PipelineLayoutCI.pNext = NULL;
-	PipelineLayoutCI.flags = 0;
-	PipelineLayoutCI.setLayoutCount = 0;
-	PipelineLayoutCI.pSetLayouts = NULL;
-	PipelineLayoutCI.pushConstantRangeCount = 0;
-	PipelineLayoutCI.pPushConstantRanges = NULL;
-	VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[0]));
+VkCommandPool CreateBenchPool()
+{
+	VkCommandPoolCreateInfo CommandPoolCI;
+	CommandPoolCI.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	CommandPoolCI.pNext = NULL;
+	CommandPoolCI.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	CommandPoolCI.queueFamilyIndex = QueueIndex[0];
+	VkCommandPool Pool;
+	VK_CHECK(vkCreateCommandPool(LogicalDevice, &CommandPoolCI, VkAllocators, &Pool));
+	return Pool;
+}
 
-	//Sampler
-	{
-		VkDescriptorSetLayout SetLayouts[] = {VertUniformDescriptorSetLayout, FragUniformDescriptorSetLayout, FragSamplerDescriptorSetLayout};
-		PipelineLayoutCI.setLayoutCount = ArrayCount(SetLayouts);
-		PipelineLayoutCI.pSetLayouts = SetLayouts;
-		VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[1]));
-	}
-	//Lightning
+//Same sorted bucket recorded with indirect runs off and on, between frames.
+void DrawIndirectBenchmark()
+{
+	ASSERT(!FrameRecording, "DrawIndirectBenchmark: called inside a frame");
+	b32 OldSorting = DrawSorting;
+	b32 OldIndirect = DrawIndirect;
+	u32 OldThreads = RecordThreadCount;
+	DrawSorting = true;
+	RecordThreadCount = 0;
+	VkCommandPool Pool = CreateBenchPool();
+
+	for(u32 Mode = 0; Mode < 2; Mode++)
 	{
-		VkDescriptorSetLayout SetLayouts[] = {FragUniformDescriptorSetLayout};
-		PipelineLayoutCI.setLayoutCount = ArrayCount(SetLayouts);
-		PipelineLayoutCI.pSetLayouts = SetLayouts;
-		VK_CHECK(vkCreatePipelineLayout(LogicalDevice, &PipelineLayoutCI, VkAllocators, &VkPipelineLayouts[2]));
+		VkSetDrawIndirect(Mode == 1);
+		if(Mode == 1 && !DrawIndirect)
+		{
+			break;
+		}
+		f64 Best = 1e9;
+		for(u32 Round = 0; Round < BUCKET_BENCH_ROUNDS; Round++)
+		{
+			VkCommandBuffer Cmd = BeginBenchRecording(Pool);
+			u32 Seed = 1234;
+			f64 Begin = Tiny_GetTime();
+			for(u32 i = 0; i < BUCKET_BENCH_DRAWS; i++)
+			{
+				draw_item_t Item;
+				FillBenchDrawItem(&Item, &Seed);
+				SubmitDrawItem(Cmd, &Item);
+			}
+			FlushDrawBucket(Cmd);
+			Best = Min(Best, Tiny_GetTime() - Begin);
+			EndBenchRecording(Pool, Cmd);
+		}
+		Info("Indirect %s: %d draws recorded in %.3f ms, %d draws in %d indirect calls, binds %d issued %d skipped",
+				Mode ? "on" : "off", BUCKET_BENCH_DRAWS, Best * 1000, IndirectDraws, IndirectCalls,
+				BindCaches[0].BindsIssued, BindCaches[0].BindsSkipped);
 	}
-	CreateShaderPipelines(); //does them all at once.
-
-	//End SHADERS & PIPELINE
-
-	//End RENDER RESOURCES
 
-	Trace("Reached target: (Init) Final Step");
+	vkDestroyCommandPool(LogicalDevice, Pool, VkAllocators);
+	memset(&BindCaches[0], 0, sizeof(bind_cache_t));
+	DrawSorting = OldSorting;
+	DrawIndirect = OldIndirect;
+	RecordThreadCount = OldThreads;
+}
 
-	//POST INIT
-	//(Kyryl): Prepares vulkan objects used at real time rendering.
-	PostInit();
+int CompareDrawKey(const void *A, const void *B)
+{
+	u64 KeyA = ((draw_key_t*)A)->Key;
+	u64 KeyB = ((draw_key_t*)B)->Key;
+	return KeyA < KeyB ? -1 : KeyA > KeyB;
+}
 
-	//End POST INIT
+//Checks the radix sort against qsort, on the keys of the benchmark bucket and
+//on random keys that need every pass.
+b32 VerifyDrawKeySort(draw_key_t *Expected, u32 Count, b32 RandomKeys)
+{
+	if(RandomKeys)
+	{
+		u32 Seed = 4321;
+		for(u32 i = 0; i < Count; i++)
+		{
+			Seed = Seed * 1664525 + 1013904223;
+			u64 High = Seed;
+			Seed = Seed * 1664525 + 1013904223;
+			DrawKeys[0][i].Key = High << 32 | Seed;
+			DrawKeys[0][i].Index = i;
+		}
+	}
+	memcpy(Expected, DrawKeys[0], sizeof(draw_key_t) * Count);
+	qsort(Expected, Count, sizeof(draw_key_t), &CompareDrawKey);
+	draw_key_t *Sorted = SortDrawKeys(Count);
+	for(u32 i = 0; i < Count; i++)
+	{
+		if(Sorted[i].Key != Expected[i].Key)
+		{
+			return false;
+		}
+	}
 	return true;
-
 }
 
-void PostInit()
+//Mixed bucket recorded in submission order and sorted, between frames.
+void DrawSortBenchmark()
 {
-	//Sanity checks
-	MAX_FRAMES_IN_FLIGHT = SwchImageCount - 1;
-	ASSERT(MAX_FRAMES_IN_FLIGHT < NUM_SEMAPHORES, "MAX_FRAMES_IN_FLIGHT > NUM_SEMAPHORES");
-	ASSERT(MAX_FRAMES_IN_FLIGHT < NUM_FENCES, "MAX_FRAMES_IN_FLIGHT > NUM_FENCES");
-
-	CurrentFrame = 0;
-
-	for(u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	static draw_key_t Expected[BUCKET_BENCH_DRAWS];
+	ASSERT(!FrameRecording, "DrawSortBenchmark: called inside a frame");
+	b32 OldSorting = DrawSorting;
+	b32 OldIndirect = DrawIndirect;
+	u32 OldThreads = RecordThreadCount;
+	DrawIndirect = false;
+	RecordThreadCount = 0;
+	VkCommandPool Pool = CreateBenchPool();
+
+	for(u32 Mode = 0; Mode < 2; Mode++)
 	{
-		VkPipelineSF[i] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		DrawSorting = Mode == 1;
+		f64 Best = 1e9;
+		u32 Groups = 0;
+		for(u32 Round = 0; Round < BUCKET_BENCH_ROUNDS; Round++)
+		{
+			VkCommandBuffer Cmd = BeginBenchRecording(Pool);
+			u32 Seed = 1234;
+			u32 PrevPipeline = ~0u;
+			VkDescriptorSet PrevSet = VK_NULL_HANDLE;
+			Groups = 0;
+			f64 Begin = Tiny_GetTime();
+			for(u32 i = 0; i < BUCKET_BENCH_DRAWS; i++)
+			{
+				draw_item_t Item;
+				FillBenchDrawItem(&Item, &Seed);
+				if(PrevPipeline != Item.Pipeline || PrevSet != Item.DescriptorSet)
+				{
+					Groups++;
+				}
+				PrevPipeline = Item.Pipeline;
+				PrevSet = Item.DescriptorSet;
+				SubmitDrawItem(Cmd, &Item);
+			}
+			FlushDrawBucket(Cmd);
+			Best = Min(Best, Tiny_GetTime() - Begin);
+			EndBenchRecording(Pool, Cmd);
+		}
+		if(DrawSorting)
+		{
+			Groups = DrawBucketGroups;
+		}
+		Info("Sorting %s: %d draws recorded in %.3f ms, %d state groups, binds %d issued %d skipped",
+				Mode ? "on" : "off", BUCKET_BENCH_DRAWS, Best * 1000, Groups,
+				BindCaches[0].BindsIssued, BindCaches[0].BindsSkipped);
 	}
-	ColorValue.float32[0] = 0;
-	ColorValue.float32[1] = 0;
-	ColorValue.float32[2] = 0;
-	ColorValue.float32[3] = 1;
-	VkClearValues[0].color = ColorValue;
-	VkClearValues[1].depthStencil.depth = 1.0f;
-	VkClearValues[1].depthStencil.stencil = 0;
-
-	ImageSubResourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	ImageSubResourceRange.baseMipLevel = 0;
-	ImageSubResourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-	ImageSubResourceRange.baseArrayLayer = 0;
-	ImageSubResourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-
-	SubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	SubmitInfo.pNext = NULL;
-	SubmitInfo.pWaitSemaphores = &VkSignalSemaphores[0];
-	SubmitInfo.pCommandBuffers = &VkCommandBuffers[0];
-	SubmitInfo.pSignalSemaphores = &VkWaitSemaphores[0];
-	SubmitInfo.waitSemaphoreCount = MAX_FRAMES_IN_FLIGHT;
-	SubmitInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
-	SubmitInfo.signalSemaphoreCount = MAX_FRAMES_IN_FLIGHT;
-	SubmitInfo.pWaitDstStageMask = &VkPipelineSF[0];
 
-	PresentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	PresentInfo.pNext = NULL;
-	PresentInfo.waitSemaphoreCount = 1;
-	PresentInfo.swapchainCount = 1;
-	PresentInfo.pResults = NULL;
-	PresentInfo.pSwapchains = &VkSwapchains[0];
-	PresentInfo.pImageIndices = &ImageIndexes[0];
-	PresentInfo.pWaitSemaphores = &VkWaitSemaphores[0];
+	//Fills the keys without recording, the bucket is dropped afterwards.
+	DrawSorting = true;
+	u32 Seed = 1234;
+	for(u32 i = 0; i < BUCKET_BENCH_DRAWS; i++)
+	{
+		draw_item_t Item;
+		FillBenchDrawItem(&Item, &Seed);
+		SubmitDrawItem(VK_NULL_HANDLE, &Item);
+	}
+	b32 BucketSorted = VerifyDrawKeySort(Expected, BUCKET_BENCH_DRAWS, false);
+	b32 RandomSorted = VerifyDrawKeySort(Expected, BUCKET_BENCH_DRAWS, true);
+	DrawItemCount = 0;
+	memset(&BucketSetIds, 0, sizeof(bucket_ids_t));
+	memset(&BucketBufferIds, 0, sizeof(bucket_ids_t));
+	if(BucketSorted && RandomSorted)
+	{
+		Info("SortDrawKeys matches qsort");
+	}
+	else
+	{
+		Error("SortDrawKeys differs from qsort: bucket keys %s, random keys %s",
+				BucketSorted ? "ok" : "wrong", RandomSorted ? "ok" : "wrong");
+	}
 
-#ifdef TINYENGINE_DEBUG
-	//query pool;
-	VkQueryPoolCreateInfo QueryPoolCI;
-	QueryPoolCI.pNext = NULL;
-	QueryPoolCI.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-	QueryPoolCI.flags = 0;
-	QueryPoolCI.queryType = VK_QUERY_TYPE_TIMESTAMP;
-	QueryPoolCI.queryCount = 128;
-	QueryPoolCI.pipelineStatistics = 0;
-	VK_CHECK(vkCreateQueryPool(LogicalDevice, &QueryPoolCI, VkAllocators, &QueryPool));
+	vkDestroyCommandPool(LogicalDevice, Pool, VkAllocators);
+	memset(&BindCaches[0], 0, sizeof(bind_cache_t));
+	DrawSorting = OldSorting;
+	DrawIndirect = OldIndirect;
+	RecordThreadCount = OldThreads;
+}
 #endif
 
+//NOTE(Kyryl): Shared by the VkCmdDraw* functions, call with ZoneLock held.
+//Blocks are allocated on the entity's first draw and released once Tag is 2,
+//false means the entity was just released and there is nothing to draw.
+b32 AcquireEntity(vk_entity_t *Id, u32 VertexCount, u32 IndexCount, b32 *Fresh)
+{
+	*Fresh = false;
+	if(Id->Tag == 2)
+	{
+		ZDeferFree(Id->Vbuf, 1);
+		ZDeferFree(Id->Ibuf, 2);
+		Id->Vbuf = NULL;
+		Id->Ibuf = NULL;
+		for(u32 i = 0; i < MAX_FRAME_SLOTS; i++)
+		{
+			entity_slot_t *Slot = &Id->Slots[i];
+			ZDeferFree(Slot->Vbuf, 1);
+			ZDeferFree(Slot->Ibuf, 2);
+			ZDeferFree(Slot->Instbuf, 1);
+			memset(Slot, 0, sizeof(entity_slot_t));
+		}
+		if(Id->StaticBuffer)
+		{
+			VkDeferDestroyBuffer(Id->StaticBuffer);
+			VkDeferFreeMemory(Id->StaticMemory);
+			Id->StaticBuffer = VK_NULL_HANDLE;
+			Id->StaticMemory = VK_NULL_HANDLE;
+		}
+		return false;
+	}
+
+	if(!Id->Tag)
+	{
+		//Any index into the mesh fits 16 bits, store them narrow.
+		Id->IndexSize = VertexCount <= 65536 ? sizeof(u16) : sizeof(u32);
+		if(Id->Mode == ENTITY_STATIC)
+		{
+			Id->Vbuf = (u8*) ZMalloc(VertexStrides[Id->Format] * VertexCount, 1);	
+		}
+		if(Id->Mode != ENTITY_DYNAMIC)
+		{
+			Id->Ibuf = IndexCount ? (u8*) ZMalloc(Id->IndexSize * IndexCount, 2) : NULL;
+		}
+		Id->Tag = true;
+		*Fresh = true;
+	}
+	if(!Id->StaticBuffer && Id->Mode != ENTITY_DYNAMIC)
+	{
+		ASSERT(Id->Mode != ENTITY_STATIC || Id->Vbuf, "Invalid vertex pointer.");
+		ASSERT(!IndexCount || Id->Ibuf, "Invalid index pointer.");
+		if(Id->Vbuf)
+		{
+			ZMark(Id->Vbuf, 1, ZTAG_ENTITY);
+		}
+		if(Id->Ibuf)
+		{
+			ZMark(Id->Ibuf, 2, ZTAG_ENTITY);
+		}
+	}
+	return true;
 }
 
-//NOTE(Kyryl): 
-//Currently not used for anything but you can
-//use this to blit to the screen or vise versa, aka screenshot.
-void BlitSurface()
+//Call with ZoneLock held. Only grows, the block it replaces may still be
+//read by a draw recorded earlier in this frame. True when Block is new.
+b32 GrowSlotBlock(u8 **Block, u32 *Capacity, u32 Size, u8 Zoneid)
 {
+	b32 Moved = !*Block || Size > *Capacity;
+	if(Moved)
+	{
+		ZDeferFree(*Block, Zoneid);
+		*Block = (u8*) ZMalloc(Size, Zoneid);
+		*Capacity = Size;
+	}
+	if(*Block)
+	{
+		ZMark(*Block, Zoneid, ZTAG_ENTITY);
+	}
+	return Moved;
+}
 
-	VkImageMemoryBarrier MemBarrier;
-	MemBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	MemBarrier.pNext = NULL;
-	MemBarrier.srcAccessMask = 0;
-	MemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	MemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	MemBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	MemBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	MemBarrier.image = VkSwchImages[ImageIndexes[CurrentFrame]];
-	MemBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	MemBarrier.subresourceRange.baseMipLevel = 0;
-	MemBarrier.subresourceRange.levelCount = 1;
-	MemBarrier.subresourceRange.baseArrayLayer = 0;
-	MemBarrier.subresourceRange.layerCount = 1;
-	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
+//Any thread. Align needs not be ^2, vertices align to their stride so
+//ring draws share a vertex base and merge in indirect runs.
+u8 *FrameRingAlloc(u32 Size, u32 Align, VkDeviceSize *Offset)
+{
+	VkDeviceSize Base = (VkDeviceSize)CurrentFrame * FRAME_RING_SIZE;
+	u32 Used = __atomic_load_n(&FrameRingUsed, __ATOMIC_RELAXED);
+	u32 Begin;
+	do
+	{
+		Begin = (u32)((Base + Used + Align - 1) / Align * Align - Base);
+		if(Begin + Size > FRAME_RING_SIZE)
+		{
+			__atomic_add_fetch(&FrameRingMisses, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+	} while(!__atomic_compare_exchange_n(&FrameRingUsed, &Used, Begin + Size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	*Offset = Base + Begin;
+	return (u8*) FrameRing.Data + Base + Begin;
+}
 
-	MemBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	MemBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	MemBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	MemBarrier.image = PixelTexture.Image;
-	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
+//Flushes values below half range to 0 and overflows to infinity.
+u16 F32ToF16(f32 Value)
+{
+	u32 Bits;
+	memcpy(&Bits, &Value, sizeof(Bits));
+	u32 Sign = (Bits >> 16) & 0x8000;
+	s32 Exponent = (s32)((Bits >> 23) & 0xFF) - 127 + 15;
+	u32 Mantissa = Bits & 0x7FFFFF;
+	if(Exponent <= 0)
+	{
+		return (u16) Sign;
+	}
+	if(Exponent >= 31)
+	{
+		return (u16)(Sign | 0x7C00);
+	}
+	//Rounding may carry into the exponent, which is still the right value.
+	return (u16)((Sign | Exponent << 10 | Mantissa >> 13) + ((Mantissa >> 12) & 1));
+}
 
-	VkImageBlit imageBlitRegion;
-	imageBlitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageBlitRegion.srcSubresource.mipLevel = 0;
-	imageBlitRegion.srcSubresource.baseArrayLayer = 0;
-	imageBlitRegion.srcSubresource.layerCount = 1;
-	imageBlitRegion.srcOffsets[0].x = 0;
-	imageBlitRegion.srcOffsets[0].y = 0;
-	imageBlitRegion.srcOffsets[0].z = 0;
-	imageBlitRegion.srcOffsets[1].x = PixelTexture.Width;
-	imageBlitRegion.srcOffsets[1].y = PixelTexture.Height;
-	imageBlitRegion.srcOffsets[1].z = 1;
-	imageBlitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageBlitRegion.dstSubresource.mipLevel = 0;
-	imageBlitRegion.dstSubresource.baseArrayLayer = 0;
-	imageBlitRegion.dstSubresource.layerCount = 1;
-	imageBlitRegion.dstOffsets[0].x = 0;
-	imageBlitRegion.dstOffsets[0].y = 0;
-	imageBlitRegion.dstOffsets[0].z = 0;
-	imageBlitRegion.dstOffsets[1].x = SwchImageSize.width;
-	imageBlitRegion.dstOffsets[1].y = SwchImageSize.height;
-	imageBlitRegion.dstOffsets[1].z = 1;
+u16 F32ToUnorm16(f32 Value)
+{
+	return (u16)(Min(Max(Value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+}
 
-	vkCmdBlitImage
-		(CommandBuffer,
-		 PixelTexture.Image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		 VkSwchImages[ImageIndexes[CurrentFrame]], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		 1,
-		 &imageBlitRegion,
-		 VK_FILTER_LINEAR);
+u8 F32ToUnorm8(f32 Value)
+{
+	return (u8)(Min(Max(Value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
 
-	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-	MemBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
+//Converts Count vertex_t into Format's layout, Dst holds VertexStrides[Format] * Count.
+void VkPackVertices(void *Dst, u32 Format, vertex_t *Src, u32 Count)
+{
+	u32 i;
+	if(Format == VERTEX_PACKED)
+	{
+		vertex_packed_t *Packed = (vertex_packed_t*) Dst;
+		for(i = 0; i < Count; i++)
+		{
+			Packed[i].Xyz[0] = F32ToF16(Src[i].Xyz[0]);
+			Packed[i].Xyz[1] = F32ToF16(Src[i].Xyz[1]);
+			Packed[i].Xyz[2] = F32ToF16(Src[i].Xyz[2]);
+			Packed[i].Xyz[3] = 0;
+			Packed[i].UVs[0] = F32ToUnorm16(Src[i].UVs[0]);
+			Packed[i].UVs[1] = F32ToUnorm16(Src[i].UVs[1]);
+			Packed[i].Color[0] = F32ToUnorm8(Src[i].Normals[0]);
+			Packed[i].Color[1] = F32ToUnorm8(Src[i].Normals[1]);
+			Packed[i].Color[2] = F32ToUnorm8(Src[i].Normals[2]);
+			Packed[i].Color[3] = 255; //vertex_t never fed alpha either
+		}
+	}
+	else if(Format == VERTEX_PACKED_2D)
+	{
+		vertex_packed2d_t *Packed = (vertex_packed2d_t*) Dst;
+		for(i = 0; i < Count; i++)
+		{
+			Packed[i].Xy[0] = F32ToF16(Src[i].Xyz[0]);
+			Packed[i].Xy[1] = F32ToF16(Src[i].Xyz[1]);
+			Packed[i].UVs[0] = F32ToUnorm16(Src[i].UVs[0]);
+			Packed[i].UVs[1] = F32ToUnorm16(Src[i].UVs[1]);
+			Packed[i].Color[0] = F32ToUnorm8(Src[i].Normals[0]);
+			Packed[i].Color[1] = F32ToUnorm8(Src[i].Normals[1]);
+			Packed[i].Color[2] = F32ToUnorm8(Src[i].Normals[2]);
+			Packed[i].Color[3] = 255;
+		}
+	}
+	else
+	{
+		memcpy(Dst, Src, Count * sizeof(vertex_t));
+	}
+}
 
-	MemBarrier.image = VkSwchImages[ImageIndexes[CurrentFrame]];
-	MemBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	MemBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-	vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &MemBarrier);
+//Narrows or widens on the way, the values must fit DstSize.
+void CopyIndices(void *Dst, u32 DstSize, void *Src, u32 SrcSize, u32 Count)
+{
+	if(DstSize == SrcSize)
+	{
+		memcpy(Dst, Src, Count * DstSize);
+	}
+	else if(DstSize == sizeof(u16))
+	{
+		u16 *Narrow = (u16*) Dst;
+		u32 *Wide = (u32*) Src;
+		for(u32 i = 0; i < Count; i++)
+		{
+			Narrow[i] = (u16) Wide[i];
+		}
+	}
+	else
+	{
+		u32 *Wide = (u32*) Dst;
+		u16 *Narrow = (u16*) Src;
+		for(u32 i = 0; i < Count; i++)
+		{
+			Wide[i] = Narrow[i];
+		}
+	}
 }
 
-void VkBeginRendering()
+//Copies what the entity's mode asks for, see ENTITY_*.
+//IndexSize is the caller's index type, the entity may store another.
+void UploadEntity(vk_entity_t *Id, b32 Fresh, vertex_t *Vertices, u32 VertexCount, void *Indices, u32 IndexSize, u32 IndexCount)
 {
-	VkResult result;
+	Id->InRing = false;
+	if(Id->StaticBuffer || (!Fresh && Id->Mode == ENTITY_STATIC))
+	{
+		return;
+	}
 
-	//tell hardware to not wait more than 1 second.
-wait:
-	result = vkAcquireNextImageKHR(LogicalDevice, VkSwapchains[0], 1000000000, VkSignalSemaphores[CurrentFrame], VK_NULL_HANDLE, &ImageIndexes[CurrentFrame]);
-	switch( result )
+	u32 Stride = VertexStrides[Id->Format];
+	if(Id->Mode == ENTITY_DYNAMIC)
 	{
-	case VK_SUCCESS:
-		break;
-	case VK_SUBOPTIMAL_KHR:
-		Info("VkBeginRendering: VK_SUBOPTIMAL_KHR");
-		break;
-	case VK_TIMEOUT:
-		Info("VK_TIMEOUT");
-		goto wait;
-	case VK_ERROR_OUT_OF_DATE_KHR:
-		Info("VkBeginRendering: VK_ERROR_OUT_OF_DATE_KHR");
-		if(CurrentFrame != 0)
-		{
-			//cut end the frame cycle
-			vkResetFences(LogicalDevice, 1, &VkFences[0]);
-			SubmitInfo.waitSemaphoreCount = CurrentFrame;
-			SubmitInfo.commandBufferCount = CurrentFrame;
-			SubmitInfo.signalSemaphoreCount = CurrentFrame;
-			VK_CHECK(vkQueueSubmit(VkQueues[0], 1, &SubmitInfo, VkFences[0]));
-			vkWaitForFences(LogicalDevice, 1, &VkFences[0], VK_TRUE, UINT64_MAX);
-			for(u32 i = 0; i < CurrentFrame; i++)
+		ASSERT(!VertexCount || Vertices, "UploadEntity: NULL vertices for a non static entity.");
+		u32 VSize = (Stride * VertexCount + 3) & ~3;
+		u8 *Block = FrameRingAlloc(VSize + IndexCount * Id->IndexSize, Stride, &Id->RingOffset);
+		if(Block)
+		{
+			VkPackVertices(Block, Id->Format, Vertices, VertexCount);
+			if(IndexCount)
 			{
-				PresentInfo.pImageIndices = &ImageIndexes[i];
-				PresentInfo.pWaitSemaphores = &VkWaitSemaphores[i];
-				vkQueuePresentKHR(VkQueues[0], &PresentInfo);
+				CopyIndices(Block + VSize, Id->IndexSize, Indices, IndexSize, IndexCount);
 			}
+			Id->RingIOffset = Id->RingOffset + VSize;
+			Id->InRing = true;
+			__atomic_add_fetch(&EntityFrameBytes, VertexCount * Stride + IndexCount * Id->IndexSize, __ATOMIC_RELAXED);
+			return;
+		}
 
-			SubmitInfo.waitSemaphoreCount = MAX_FRAMES_IN_FLIGHT;
-			SubmitInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
-			SubmitInfo.signalSemaphoreCount = MAX_FRAMES_IN_FLIGHT;
-			CurrentFrame = 0;
+		//NOTE(Kyryl): Ring is full, this frame goes to the slot's own zone
+		//blocks. They are kept for the next overflow of this slot, nonzero
+		//FrameRingOverflows means FRAME_RING_SIZE is too small.
+		entity_slot_t *Slot = &Id->Slots[CurrentFrame];
+		Tiny_Lock(&ZoneLock);
+		GrowSlotBlock(&Slot->Vbuf, &Slot->VCapacity, Stride * VertexCount, 1);
+		if(IndexCount)
+		{
+			GrowSlotBlock(&Slot->Ibuf, &Slot->ICapacity, Id->IndexSize * IndexCount, 2);
 		}
-		RebuildRenderer();
-		goto wait;
-	default:
-		VK_CHECK(result);
+		Tiny_Unlock(&ZoneLock);
+		ASSERT(Slot->Vbuf, "Invalid vertex pointer.");
+		ASSERT(!IndexCount || Slot->Ibuf, "Invalid index pointer.");
+		VkPackVertices(Slot->Vbuf, Id->Format, Vertices, VertexCount);
+		if(IndexCount)
+		{
+			CopyIndices(Slot->Ibuf, Id->IndexSize, Indices, IndexSize, IndexCount);
+		}
+		__atomic_add_fetch(&EntityFrameBytes, VertexCount * Stride + IndexCount * Id->IndexSize, __ATOMIC_RELAXED);
 		return;
 	}
 
-	while(SubmitStagingBuffer()){/*nothing*/};
+	if(Id->Mode == ENTITY_RANGED)
+	{
+		u32 First = 0;
+		u32 Count = VertexCount;
+		if(!Fresh)
+		{
+			if(ReplayPacket)
+			{
+				First = ReplayPacket->DirtyFirst;
+				Count = ReplayPacket->DirtyCount;
+			}
+			else
+			{
+				First = Id->DirtyFirst;
+				Count = Id->DirtyCount;
+				Id->DirtyCount = 0;
+			}
+			ASSERT(First + Count <= VertexCount, "UploadEntity: dirty range out of bounds.");
+		}
+
+		//NOTE(Kyryl): Frames in flight read the other slots' copies, so the
+		//range is only written into this slot's copy and stays pending on
+		//the rest until their slot comes around. Vertices is the whole mesh.
+		if(Count)
+		{
+			for(u32 i = 0; i < MAX_FRAME_SLOTS; i++)
+			{
+				entity_slot_t *Other = &Id->Slots[i];
+				b32 Pending = Other->DirtyEnd != Other->DirtyFirst;
+				Other->DirtyFirst = Pending ? Min(Other->DirtyFirst, First) : First;
+				Other->DirtyEnd = Pending ? Max(Other->DirtyEnd, First + Count) : First + Count;
+			}
+		}
+		entity_slot_t *Slot = &Id->Slots[CurrentFrame];
+		Tiny_Lock(&ZoneLock);
+		if(GrowSlotBlock(&Slot->Vbuf, &Slot->VCapacity, Stride * VertexCount, 1))
+		{
+			Slot->DirtyFirst = 0;
+			Slot->DirtyEnd = VertexCount;
+		}
+		Tiny_Unlock(&ZoneLock);
+		ASSERT(Slot->Vbuf, "Invalid vertex pointer.");
+
+		Count = Slot->DirtyEnd - Slot->DirtyFirst;
+		ASSERT(!Count || Vertices, "UploadEntity: NULL vertices for a non static entity.");
+		VkPackVertices(Slot->Vbuf + Slot->DirtyFirst * Stride, Id->Format, &Vertices[Slot->DirtyFirst], Count);
+		Slot->DirtyFirst = 0;
+		Slot->DirtyEnd = 0;
+		//Indices are written once, nothing reads them before this frame.
+		IndexCount = Fresh ? IndexCount : 0;
+		if(IndexCount)
+		{
+			CopyIndices(Id->Ibuf, Id->IndexSize, Indices, IndexSize, IndexCount);
+		}
+		__atomic_add_fetch(&EntityFrameBytes, Count * Stride + IndexCount * Id->IndexSize, __ATOMIC_RELAXED);
+		return;
+	}
 
-	CommandBuffer = VkCommandBuffers[CurrentFrame];
+	//First draw of a static entity, nothing reads its blocks yet.
+	ASSERT(!VertexCount || Vertices, "UploadEntity: NULL vertices for a non static entity.");
+	VkPackVertices(Id->Vbuf, Id->Format, Vertices, VertexCount);
+	if(IndexCount)
+	{
+		CopyIndices(Id->Ibuf, Id->IndexSize, Indices, IndexSize, IndexCount);
+	}
+	__atomic_add_fetch(&EntityFrameBytes, VertexCount * Stride + IndexCount * Id->IndexSize, __ATOMIC_RELAXED);
+}
 
-	VkCommandBufferBeginInfo CommandBufferBI;
-	CommandBufferBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	CommandBufferBI.pNext = NULL;
-	CommandBufferBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; 
-	CommandBufferBI.pInheritanceInfo = NULL;
+//Points Item at wherever the entity's mesh lives.
+void SetEntityBuffers(vk_entity_t *Id, draw_item_t *Item)
+{
+	Item->IndexSize = Id->IndexSize;
+	Item->VertexStride = VertexStrides[Id->Format];
+	Item->FirstInstance = 0;
+	if(Id->StaticBuffer)
+	{
+		Item->VertexBuffer = Id->StaticBuffer;
+		Item->IndexBuffer = Id->StaticBuffer;
+		Item->VOffset = 0;
+		Item->IOffset = Id->StaticIOffset;
+		return;
+	}
+	if(Id->InRing)
+	{
+		Item->VertexBuffer = FrameRing.Buffer;
+		Item->IndexBuffer = FrameRing.Buffer;
+		Item->VOffset = Id->RingOffset;
+		Item->IOffset = Id->RingIOffset;
+	}
+	else
+	{
+		//Ranged entities and dynamic ones the ring could not take draw this slot's copy.
+		u8 *Vbuf = Id->Mode == ENTITY_STATIC ? Id->Vbuf : Id->Slots[CurrentFrame].Vbuf;
+		u8 *Ibuf = Id->Mode == ENTITY_DYNAMIC ? Id->Slots[CurrentFrame].Ibuf : Id->Ibuf;
+		Item->VertexBuffer = ZBuffer(Vbuf, 1, &Item->VOffset);
+		Item->IndexBuffer = Ibuf ? ZBuffer(Ibuf, 2, &Item->IOffset) : IndexBuffers[0].Buffer;
+		if(!Ibuf)
+		{
+			Item->IOffset = 0;
+		}
+	}
 
-	VK_CHECK(vkBeginCommandBuffer(CommandBuffer, &CommandBufferBI));
+	//The geometry set only sees the first zone 1 page and the ring.
+	b32 Pullable = Id->InRing || Item->VertexBuffer == VertexBuffers[0].Buffer;
+	if(UseVertexPulling && Pullable && Id->Format == VERTEX_FLOAT && Item->Pipeline < NUM_VERTEX_PIPELINES)
+	{
+		//Whole vertices stay in VOffset for vertexOffset, the remainder
+		//moves into firstInstance so every pulled draw looks alike.
+		u32 Remainder = (u32)(Item->VOffset % Item->VertexStride);
+		Item->FirstInstance = Remainder / sizeof(f32) | (Id->InRing ? PULLED_RING_BIT : 0);
+		Item->VOffset -= Remainder;
+		Item->VertexBuffer = VK_NULL_HANDLE;
+		Item->Pipeline = PULLED_PIPELINE(Item->Pipeline);
+		Item->Layout = PULLED_LAYOUT;
+	}
+}
 
-	UpdateHostTextures();
+//Only before the entity's first draw.
+void VkSetEntityMode(vk_entity_t *Id, u32 Mode)
+{
+	ASSERT(!Id->Tag, "VkSetEntityMode: entity already in use");
+	Id->Mode = Mode;
+}
 
-#ifdef TINYENGINE_DEBUG
-	vkCmdResetQueryPool(CommandBuffer, QueryPool, 0, 128);
-	vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool, 0);
-#endif
+//Only before the entity's first draw or VkUploadStaticEntity. Not for
+//instanced draws, their pipelines take vertex_t.
+void VkSetEntityFormat(vk_entity_t *Id, u32 Format)
+{
+	ASSERT(!Id->Tag, "VkSetEntityFormat: entity already in use");
+	ASSERT(Format < NUM_VERTEX_FORMATS, "VkSetEntityFormat: unknown format %d", Format);
+	Id->Format = Format;
+}
 
-	VkRect2D RenderArea;
-	RenderArea.offset.x = 0;
-	RenderArea.offset.y = 0;
-	RenderArea.extent.width = SwchImageSize.width;
-	RenderArea.extent.height = SwchImageSize.height;
+//ENTITY_RANGED only. The next draw copies these vertices and nothing else,
+//a draw without a range copies nothing.
+void VkSetEntityDirty(vk_entity_t *Id, u32 FirstVertex, u32 VertexCount)
+{
+	ASSERT(Id->Mode == ENTITY_RANGED, "VkSetEntityDirty: entity is not ENTITY_RANGED");
+	if(Id->DirtyCount)
+	{
+		//Merge with a range no draw has consumed yet.
+		u32 End = Max(Id->DirtyFirst + Id->DirtyCount, FirstVertex + VertexCount);
+		Id->DirtyFirst = Min(Id->DirtyFirst, FirstVertex);
+		Id->DirtyCount = End - Id->DirtyFirst;
+		return;
+	}
+	Id->DirtyFirst = FirstVertex;
+	Id->DirtyCount = VertexCount;
+}
 
-	VkRenderPassBeginInfo RenderPassBI;
-	RenderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	RenderPassBI.pNext = NULL;
-	RenderPassBI.renderPass = VkRenderPasses[0];
-	RenderPassBI.framebuffer = VkFramebuffers[ImageIndexes[CurrentFrame]];
-	RenderPassBI.renderArea = RenderArea;
-	RenderPassBI.clearValueCount = 2;
-	RenderPassBI.pClearValues = VkClearValues;
+//NOTE(Kyryl): Copies the mesh once into its own device local buffer through
+//the staging buffers, the copy lands with the next frame's staging submit.
+//Instead of VkSetEntityMode, the entity is ENTITY_STATIC from here on.
+void VkUploadStaticEntity(vk_entity_t *Id, vertex_t *Vertices, u32 VertexCount, u32 *Indices, u32 IndexCount)
+{
+	ASSERT(!Id->Tag, "VkUploadStaticEntity: entity already in use");
+	Id->IndexSize = VertexCount <= 65536 ? sizeof(u16) : sizeof(u32);
+	VkDeviceSize VSize = VertexStrides[Id->Format] * VertexCount;
+	VkDeviceSize IOffset = (VSize + (sizeof(u32)-1)) & -sizeof(u32);
+	VkDeviceSize Size = IOffset + Id->IndexSize * IndexCount;
 
-	vkCmdBeginRenderPass(CommandBuffer, &RenderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+	VkBufferCreateInfo BufferCI;
+	BufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	BufferCI.pNext = NULL;
+	BufferCI.flags = 0;
+	BufferCI.size = Size;
+	BufferCI.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	BufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	BufferCI.queueFamilyIndexCount = 0;
+	BufferCI.pQueueFamilyIndices = NULL;
+	VK_CHECK(vkCreateBuffer(LogicalDevice, &BufferCI, VkAllocators, &Id->StaticBuffer));
 
-	VkViewport Viewport;
-	Viewport.x = 0;
-	Viewport.y = 0;
-	Viewport.width = SwchImageSize.width;
-	Viewport.height = SwchImageSize.height;
-	Viewport.minDepth = 0;
-	Viewport.maxDepth = 1;
+	VkMemoryRequirements MemoryRequirements;
+	vkGetBufferMemoryRequirements(LogicalDevice, Id->StaticBuffer, &MemoryRequirements);
+
+	VkMemoryAllocateInfo MemoryAI;
+	MemoryAI.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	MemoryAI.pNext = NULL;
+	MemoryAI.allocationSize = MemoryRequirements.size;
+	MemoryAI.memoryTypeIndex = MemoryTypeFromProperties(MemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+	VK_CHECK(vkAllocateMemory(LogicalDevice, &MemoryAI, VkAllocators, &Id->StaticMemory));
+	VK_CHECK(vkBindBufferMemory(LogicalDevice, Id->StaticBuffer, Id->StaticMemory, 0));
+
+	staging_t *StagingBuffer = &StagingBuffers[StagingIndex];
+	VkDeviceSize Offset;
+	u8 *Transfer = StagingDigress(Size, StagingIndex, &Offset);
+	VkPackVertices(Transfer, Id->Format, Vertices, VertexCount);
+	CopyIndices(Transfer + IOffset, Id->IndexSize, Indices, sizeof(u32), IndexCount);
+
+	VkBufferCopy BufferC;
+	BufferC.srcOffset = Offset;
+	BufferC.dstOffset = 0;
+	BufferC.size = Size;
+	vkCmdCopyBuffer(StagingBuffer->CommandBuffer, StagingBuffer->Buffer, Id->StaticBuffer, 1, &BufferC);
+	StagingBuffer->Pending = true;
 
-	vkCmdSetViewport(CommandBuffer, 0, 1, &Viewport);
-	vkCmdSetScissor(CommandBuffer, 0, 1, &RenderArea);
+	Id->StaticIOffset = IOffset;
+	Id->Vbuf = NULL;
+	Id->Ibuf = NULL;
+	Id->Mode = ENTITY_STATIC;
+	Id->Tag = true;
 }
 
-void VkEndRendering()
+//Block of whoever records into Cmd, the bind caches are per recording thread.
+draw_constants_t *PendingDrawConstants(VkCommandBuffer Cmd)
 {
-	vkCmdEndRenderPass(CommandBuffer);
+	for(u32 i = 0; i < NUM_RECORD_THREADS; i++)
+	{
+		if(BindCaches[i].Cmd == Cmd)
+		{
+			return &BindCaches[i].Constants;
+		}
+	}
+	return &FrameBufferConstants;
+}
 
-#ifdef TINYENGINE_DEBUG
-	vkCmdWriteTimestamp(CommandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, QueryPool, 1);
-#endif
-	VK_CHECK(vkEndCommandBuffer(CommandBuffer));
+//NOTE(Kyryl): Push constant block for the next VkCmdDraw* into Cmd only, up to
+//MAX_PUSH_CONSTANTS bytes visible to the vertex and fragment stages at offset 0.
+//Call after VkBeginRendering or VkBeginThreadRecording, they drop what is
+//pending. Sprites are batched across calls and ignore it, lightnings use the
+//block for their own parameters. The data is copied.
+void VkCmdSetDrawConstants(VkCommandBuffer Cmd, void *Data, u32 Size)
+{
+	ASSERT(Size <= MAX_PUSH_CONSTANTS && (Size & 3) == 0, "VkCmdSetDrawConstants: %d bytes, must be a multiple of 4 up to %d", Size, MAX_PUSH_CONSTANTS);
+	draw_constants_t *Constants = PendingDrawConstants(Cmd);
+	memcpy(Constants->Data, Data, Size);
+	Constants->Size = Size;
+}
 
-	if(CurrentFrame != MAX_FRAMES_IN_FLIGHT-1)
+//Same for the next VkDraw*, the render thread gets it through the packet.
+void VkSetDrawConstants(void *Data, u32 Size)
+{
+	if(UseRenderThread)
 	{
-		CurrentFrame = (CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		ASSERT(Size <= MAX_PUSH_CONSTANTS && (Size & 3) == 0, "VkSetDrawConstants: %d bytes, must be a multiple of 4 up to %d", Size, MAX_PUSH_CONSTANTS);
+		memcpy(PacketConstants.Data, Data, Size);
+		PacketConstants.Size = Size;
 		return;
 	}
-	vkResetFences(LogicalDevice, 1, &VkFences[0]);
-	VK_CHECK(vkQueueSubmit(VkQueues[0], 1, &SubmitInfo, VkFences[0]));
-	vkWaitForFences(LogicalDevice, 1, &VkFences[0], VK_TRUE, UINT64_MAX);
+	VkCmdSetDrawConstants(CommandBuffer, Data, Size);
+}
 
-	b32 Dated = false;
-	for(u32 i = 0; i < CurrentFrame+1; i++)
+//Render thread takes the block recorded in the packet, everyone else the one
+//pending on Cmd.
+void TakeDrawConstants(VkCommandBuffer Cmd, draw_item_t *Item)
+{
+	if(ReplayPacket)
 	{
-		PresentInfo.pImageIndices = &ImageIndexes[i];
-		PresentInfo.pWaitSemaphores = &VkWaitSemaphores[i];
-		VkResult result = vkQueuePresentKHR(VkQueues[0], &PresentInfo);
-		switch(result)
-		{
-			case VK_SUCCESS:
-				break;
-			case VK_ERROR_OUT_OF_DATE_KHR:
-				Info("VkEndRendering: VK_ERROR_OUT_OF_DATE_KHR");
-				Dated = true;
-				break;
-			default:
-				VK_CHECK(result);
-				return;
-		}
-#ifdef TINYENGINE_DEBUG
-		u64 QueryResults[2];
-		VK_CHECK(vkGetQueryPoolResults(LogicalDevice, QueryPool, 0, ArrayCount(QueryResults),
-					sizeof(QueryResults), QueryResults, sizeof(QueryResults[0]), VK_QUERY_RESULT_64_BIT));
-
-		f64 FrameGpuBegin = (f64)QueryResults[0] * DeviceProperties.limits.timestampPeriod * 1e-6;
-		f64 FrameGpuEnd = (f64)QueryResults[1] * DeviceProperties.limits.timestampPeriod * 1e-6;
-		f64 FrameCpuEnd = Tiny_GetTime() * 1000;
-
-		FrameCpuAvg = FrameCpuAvg * 0.95 + (FrameCpuEnd - (HighTime*1000)) * 0.05;
-		FrameGpuAvg = FrameGpuAvg * 0.95 + (FrameGpuEnd - FrameGpuBegin) * 0.05;
-		HighTime = Tiny_GetTime();
-
-		//TODO put this somewhere else
-		//p("cpu: %.2f ms; gpu: %.2f ms; ", FrameCpuAvg, FrameGpuAvg);
-#endif
+		Item->PushSize = ReplayPacket->PushSize;
+		memcpy(Item->Push, ReplayPush, Item->PushSize);
 	}
-	if(Dated)
+	else
 	{
-		RebuildRenderer();
+		draw_constants_t *Constants = PendingDrawConstants(Cmd);
+		Item->PushSize = Constants->Size;
+		memcpy(Item->Push, Constants->Data, Constants->Size);
+		Constants->Size = 0;
 	}
-	CurrentFrame = (CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-	ASSERT(!CurrentFrame, "CurrentFrame != 0");
-	return;
+}
+
+//IndexSize is sizeof(u16) or sizeof(u32), same for the other Cmd* functions.
+void CmdDrawBasic(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, void *IndexBuffer, u32 IndexSize, vk_entity_t *Id)
+{
+	b32 Fresh;
+	Tiny_Lock(&ZoneLock);
+	b32 Live = AcquireEntity(Id, VertexCount, IndexCount, &Fresh);
+	Tiny_Unlock(&ZoneLock);
+	if(!Live)
+	{
+		return;
+	}
+	UploadEntity(Id, Fresh, VertexBuffer, VertexCount, IndexBuffer, IndexSize, IndexCount);
+
+	draw_item_t Item;
+	Item.Pipeline = VERTEX_PIPELINE(0, Id->Format);
+	Item.Layout = 0;
+	Item.FirstSet = 0;
+	Item.DescriptorSet = VK_NULL_HANDLE;
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = false;
+	SetEntityBuffers(Id, &Item);
+	Item.VertexCount = VertexCount;
+	Item.IndexCount = IndexCount;
+	Item.InstanceBuffer = VK_NULL_HANDLE;
+	Item.InstOffset = 0;
+	Item.InstanceCount = 0;
+	TakeDrawConstants(Cmd, &Item);
+	SubmitDrawItem(Cmd, &Item);
+}
+
+void VkCmdDrawBasic(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, vk_entity_t *Id)
+{
+	CmdDrawBasic(Cmd, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), Id);
+}
+
+void VkCmdDrawBasic16(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u16 *IndexBuffer, vk_entity_t *Id)
+{
+	CmdDrawBasic(Cmd, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u16), Id);
 }
 
 void VkDrawBasic(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, vk_entity_t *Id)
 {
-	u32 VSize = sizeof(vertex_t) * VertexCount;
-	u32 ISize = sizeof(u32) * IndexCount;
+	if(PushDrawPacket(PACKET_DRAW_BASIC, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), 0, NULL, false, Id))
+	{
+		return;
+	}
+	VkCmdDrawBasic(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, Id);
+}
 
-	if(!Id->Tag)
+void VkDrawBasic16(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u16 *IndexBuffer, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_BASIC, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u16), 0, NULL, false, Id))
 	{
-		Id->Vbuf = (u8*) ZMalloc(VSize, 1);	
-		Id->Ibuf = (u8*) ZMalloc(ISize, 2);	
-		Id->Tag = true;
+		return;
 	}
-	else
+	VkCmdDrawBasic16(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, Id);
+}
+
+void CmdDrawTextured(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, void *IndexBuffer, u32 IndexSize, b32 Blend, vk_entity_t *Id)
+{
+	b32 Fresh;
+	Tiny_Lock(&ZoneLock);
+	b32 Live = AcquireEntity(Id, VertexCount, IndexCount, &Fresh);
+	Tiny_Unlock(&ZoneLock);
+	if(!Live)
 	{
-		//signal to free resources
-		if(Id->Tag == 2)
-		{
-			ZFree(Id->Vbuf, 1);
-			ZFree(Id->Ibuf, 2);		
-			Id->Vbuf = NULL;
-			Id->Ibuf = NULL;
-			return;
-		}
-		ASSERT(Id->Vbuf, "Invalid vertex pointer.");
-		ASSERT(Id->Ibuf, "Invalid index pointer.");
+		return;
 	}
+	UploadEntity(Id, Fresh, VertexBuffer, VertexCount, IndexBuffer, IndexSize, IndexCount);
+
+	draw_item_t Item;
+	Item.Pipeline = VERTEX_PIPELINE(Blend ? 3 : 2, Id->Format);
+	Item.Layout = 1;
+	Item.FirstSet = 2;
+	Item.DescriptorSet = FragSamplerDescriptorSet;
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = Blend;
+	SetEntityBuffers(Id, &Item);
+	Item.VertexCount = VertexCount;
+	Item.IndexCount = IndexCount;
+	Item.InstanceBuffer = VK_NULL_HANDLE;
+	Item.InstOffset = 0;
+	Item.InstanceCount = 0;
+	TakeDrawConstants(Cmd, &Item);
+	SubmitDrawItem(Cmd, &Item);
+}
 
-	VkDeviceSize VOffset = Id->Vbuf - (u8*) VertexBuffers[0].Data;
-	VkDeviceSize IOffset = Id->Ibuf - (u8*) IndexBuffers[0].Data;
-	memcpy(Id->Vbuf, &VertexBuffer[0], VSize);
-	memcpy(Id->Ibuf, &IndexBuffer[0], ISize);
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffers[0].Buffer, &VOffset);
-	vkCmdBindIndexBuffer(CommandBuffer, IndexBuffers[0].Buffer, IOffset, VK_INDEX_TYPE_UINT32);
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelines[0]);
-	vkCmdDrawIndexed(CommandBuffer, IndexCount, 1, 0, 0, 0);
+void VkCmdDrawTextured(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, b32 Blend, vk_entity_t *Id)
+{
+	CmdDrawTextured(Cmd, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), Blend, Id);
 }
 
-void VkDrawTextured(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, b32 Blend, vk_entity_t *Id)
+void VkCmdDrawTextured16(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u16 *IndexBuffer, b32 Blend, vk_entity_t *Id)
 {
-	u32 VSize = sizeof(vertex_t) * VertexCount;
-	u32 ISize = sizeof(u32) * IndexCount;
+	CmdDrawTextured(Cmd, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u16), Blend, Id);
+}
 
-	if(!Id->Tag)
+void VkDrawTextured(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, b32 Blend, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_TEXTURED, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), 0, NULL, Blend, Id))
 	{
-		Id->Vbuf = (u8*) ZMalloc(VSize, 1);	
-		Id->Ibuf = (u8*) ZMalloc(ISize, 2);	
-		Id->Tag = true;
+		return;
 	}
-	else
+	VkCmdDrawTextured(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, Blend, Id);
+}
+
+void VkDrawTextured16(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u16 *IndexBuffer, b32 Blend, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_TEXTURED, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u16), 0, NULL, Blend, Id))
 	{
-		//signal to free resources
-		if(Id->Tag == 2)
-		{
-			ZFree(Id->Vbuf, 1);
-			ZFree(Id->Ibuf, 2);		
-			Id->Vbuf = NULL;
-			Id->Ibuf = NULL;
-			return;
-		}
-		ASSERT(Id->Vbuf, "Invalid vertex pointer.");
-		ASSERT(Id->Ibuf, "Invalid index pointer.");
+		return;
 	}
-
-
-	VkDeviceSize VOffset = Id->Vbuf - (u8*) VertexBuffers[0].Data;
-	VkDeviceSize IOffset = Id->Ibuf - (u8*) IndexBuffers[0].Data;
-	memcpy(Id->Vbuf, &VertexBuffer[0], VSize);
-	memcpy(Id->Ibuf, &IndexBuffer[0], ISize);
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffers[0].Buffer, &VOffset);
-	vkCmdBindIndexBuffer(CommandBuffer, IndexBuffers[0].Buffer, IOffset, VK_INDEX_TYPE_UINT32);
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelines[Blend ? 3 : 2]);
-	vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelineLayouts[1], 2, 1, &FragSamplerDescriptorSet, 0, NULL);
-	vkCmdDrawIndexed(CommandBuffer, IndexCount, 1, 0, 0, 0);
+	VkCmdDrawTextured16(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, Blend, Id);
 }
 
-void VkDrawLine(u32 VertexCount, vertex_t *VertexBuffer, vk_entity_t *Id)
+void VkCmdDrawLine(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, vk_entity_t *Id)
 {
-	u32 VSize = sizeof(vertex_t) * VertexCount;
-
-	if(!Id->Tag)
+	b32 Fresh;
+	Tiny_Lock(&ZoneLock);
+	b32 Live = AcquireEntity(Id, VertexCount, 0, &Fresh);
+	Tiny_Unlock(&ZoneLock);
+	if(!Live)
 	{
-		Id->Vbuf = (u8*) ZMalloc(VSize, 1);	
-		Id->Tag = true;
+		return;
 	}
-	else
+	UploadEntity(Id, Fresh, VertexBuffer, VertexCount, NULL, sizeof(u32), 0);
+
+	draw_item_t Item;
+	Item.Pipeline = VERTEX_PIPELINE(1, Id->Format);
+	Item.Layout = 0;
+	Item.FirstSet = 0;
+	Item.DescriptorSet = VK_NULL_HANDLE;
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = false;
+	SetEntityBuffers(Id, &Item);
+	Item.VertexCount = VertexCount;
+	Item.IndexCount = 0;
+	Item.InstanceBuffer = VK_NULL_HANDLE;
+	Item.InstOffset = 0;
+	Item.InstanceCount = 0;
+	TakeDrawConstants(Cmd, &Item);
+	SubmitDrawItem(Cmd, &Item);
+}
+
+void VkDrawLine(u32 VertexCount, vertex_t *VertexBuffer, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_LINE, VertexCount, VertexBuffer, 0, NULL, sizeof(u32), 0, NULL, false, Id))
 	{
-		//signal to free resources
-		if(Id->Tag == 2)
-		{
-			ZFree(Id->Vbuf, 1);
-			Id->Vbuf = NULL;
-			return;
-		}
-		ASSERT(Id->Vbuf, "Invalid vertex pointer.");
+		return;
 	}
-	VkDeviceSize VOffset = Id->Vbuf - (u8*) VertexBuffers[0].Data;
-	memcpy(Id->Vbuf, &VertexBuffer[0], VSize);
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffers[0].Buffer, &VOffset);
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelines[1]);
-	vkCmdDraw(CommandBuffer, VertexCount, 1, 0, 0);
+	VkCmdDrawLine(CommandBuffer, VertexCount, VertexBuffer, Id);
 }
 
 void SetPixel32(u32 X, u32 Y, u32 Pixel) 
@@ -3443,50 +7134,475 @@ void DrawPixCircle(s32 CentreX, s32 CentreY, s32 Radius, s32 Color)
 	}
 }
 
+void VkCmdDrawLightnings(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, vk_entity_t *Id)
+{
+	b32 Fresh;
+	Tiny_Lock(&ZoneLock);
+	b32 Live = AcquireEntity(Id, VertexCount, IndexCount, &Fresh);
+	Tiny_Unlock(&ZoneLock);
+	if(!Live)
+	{
+		return;
+	}
+	UploadEntity(Id, Fresh, VertexBuffer, VertexCount, IndexBuffer, sizeof(u32), IndexCount);
+
+	//Pipeline blends, keep it in submission order.
+	draw_item_t Item;
+	Item.Pipeline = VERTEX_PIPELINE(4, Id->Format);
+	Item.Layout = 2;
+	Item.FirstSet = 0;
+	Item.DescriptorSet = VK_NULL_HANDLE;
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = true;
+	SetEntityBuffers(Id, &Item);
+	Item.VertexCount = VertexCount;
+	Item.IndexCount = IndexCount;
+	Item.InstanceBuffer = VK_NULL_HANDLE;
+	Item.InstOffset = 0;
+	Item.InstanceCount = 0;
+
+	//Pending draw constants are dropped, the block holds the lightning parameters.
+	TakeDrawConstants(Cmd, &Item);
+	push_lightning_t *Push = (push_lightning_t*) Item.Push;
+	Push->Resolution[0] = SwchImageSize.width;
+	Push->Resolution[1] = SwchImageSize.height;
+	Push->Time = Tiny_GetTime();
+	Item.PushSize = sizeof(push_lightning_t);
+	SubmitDrawItem(Cmd, &Item);
+}
+
 void VkDrawLightnings(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer, vk_entity_t *Id)
 {
-	u32 VSize = sizeof(vertex_t) * VertexCount;
-	u32 ISize = sizeof(u32) * IndexCount;
+	if(PushDrawPacket(PACKET_DRAW_LIGHTNINGS, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), 0, NULL, false, Id))
+	{
+		return;
+	}
+	VkCmdDrawLightnings(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, Id);
+}
 
-	if(!Id->Tag)
+//NOTE(Kyryl): One mesh drawn InstanceCount times in a single call. The mesh
+//goes through binding 0 like any other draw, instance_t is rewritten every
+//frame into the frame ring, or the slot's Instbuf when the ring is full, and
+//is stepped per instance at binding 1.
+void VkCmdDrawInstanced(VkCommandBuffer Cmd, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer,
+		u32 InstanceCount, instance_t *InstanceBuffer, b32 Textured, b32 Blend, vk_entity_t *Id)
+{
+	ASSERT(Id->Format == VERTEX_FLOAT, "VkCmdDrawInstanced: packed vertex formats are not supported");
+	u32 InstSize = sizeof(instance_t) * InstanceCount;
+
+	b32 Fresh;
+	Tiny_Lock(&ZoneLock);
+	b32 Live = AcquireEntity(Id, VertexCount, IndexCount, &Fresh);
+	Tiny_Unlock(&ZoneLock);
+	if(!Live)
 	{
-		Id->Vbuf = (u8*) ZMalloc(VSize, 1);	
-		Id->Ibuf = (u8*) ZMalloc(ISize, 2);	
-		Id->Ubuf = (u8*) ZMalloc(sizeof(ubo_lightning_t), 3);	
-		Id->Tag = true;
+		return;
+	}
+	UploadEntity(Id, Fresh, VertexBuffer, VertexCount, IndexBuffer, sizeof(u32), IndexCount);
+
+	VkDeviceSize InstOffset;
+	VkBuffer InstBuffer = FrameRing.Buffer;
+	u8 *Instances = FrameRingAlloc(InstSize, sizeof(f32), &InstOffset);
+	if(!Instances)
+	{
+		entity_slot_t *Slot = &Id->Slots[CurrentFrame];
+		Tiny_Lock(&ZoneLock);
+		GrowSlotBlock(&Slot->Instbuf, &Slot->InstCapacity, InstSize, 1);
+		Tiny_Unlock(&ZoneLock);
+		ASSERT(Slot->Instbuf, "Invalid instance pointer.");
+		Instances = Slot->Instbuf;
+		InstBuffer = ZBuffer(Slot->Instbuf, 1, &InstOffset);
+	}
+	memcpy(Instances, &InstanceBuffer[0], InstSize);
+
+	draw_item_t Item;
+	if(Textured)
+	{
+		Item.Pipeline = Blend ? 7 : 6;
+		Item.Layout = 1;
+		Item.FirstSet = 2;
+		Item.DescriptorSet = FragSamplerDescriptorSet;
+	}
+	else
+	{
+		Item.Pipeline = 5;
+		Item.Layout = 0;
+		Item.FirstSet = 0;
+		Item.DescriptorSet = VK_NULL_HANDLE;
+	}
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = Textured && Blend;
+	SetEntityBuffers(Id, &Item);
+	Item.VertexCount = VertexCount;
+	Item.IndexCount = IndexCount;
+	Item.InstanceBuffer = InstBuffer;
+	Item.InstOffset = InstOffset;
+	Item.InstanceCount = InstanceCount;
+	TakeDrawConstants(Cmd, &Item);
+	SubmitDrawItem(Cmd, &Item);
+}
+
+void VkDrawBasicInstanced(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer,
+		u32 InstanceCount, instance_t *InstanceBuffer, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_INSTANCED, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), InstanceCount, InstanceBuffer, false, Id))
+	{
+		return;
+	}
+	VkCmdDrawInstanced(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, InstanceCount, InstanceBuffer, false, false, Id);
+}
+
+void VkDrawTexturedInstanced(u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, u32 *IndexBuffer,
+		u32 InstanceCount, instance_t *InstanceBuffer, b32 Blend, vk_entity_t *Id)
+{
+	if(PushDrawPacket(PACKET_DRAW_INSTANCED_TEXTURED, VertexCount, VertexBuffer, IndexCount, IndexBuffer, sizeof(u32), InstanceCount, InstanceBuffer, Blend, Id))
+	{
+		return;
+	}
+	VkCmdDrawInstanced(CommandBuffer, VertexCount, VertexBuffer, IndexCount, IndexBuffer, InstanceCount, InstanceBuffer, true, Blend, Id);
+}
+
+vertex_t *SpriteStreamRegion()
+{
+	return (vertex_t*) SpriteVertexBuffer.Data + CurrentFrame * NUM_SPRITE_QUADS * 4;
+}
+
+//Vertices already sitting at the stream cursor are not copied again.
+void VkCmdDrawSprites(VkCommandBuffer Cmd, u32 QuadCount, vertex_t *Vertices, VkDescriptorSet Texture, b32 Blend)
+{
+	ASSERT(SpriteStreamUsed + QuadCount <= NUM_SPRITE_QUADS, "Sprite stream full, increase NUM_SPRITE_QUADS");
+	vertex_t *Dst = SpriteStreamRegion() + SpriteStreamUsed * 4;
+	if(Dst != Vertices)
+	{
+		memcpy(Dst, Vertices, QuadCount * 4 * sizeof(vertex_t));
+	}
+
+	draw_item_t Item;
+	Item.Pipeline = Blend ? 3 : 2;
+	Item.Layout = 1;
+	Item.FirstSet = 2;
+	Item.DescriptorSet = Texture;
+	Item.DynamicOffsetCount = 0;
+	Item.DynamicOffset = 0;
+	Item.Blend = Blend;
+	Item.VertexBuffer = SpriteVertexBuffer.Buffer;
+	Item.IndexBuffer = SpriteIndexBuffer.Buffer;
+	Item.VOffset = (u8*)Dst - (u8*)SpriteVertexBuffer.Data;
+	Item.IOffset = 0;
+	Item.VertexCount = QuadCount * 4;
+	Item.IndexCount = QuadCount * 6;
+	Item.IndexSize = sizeof(u16);
+	Item.VertexStride = sizeof(vertex_t);
+	Item.FirstInstance = 0;
+	Item.InstanceBuffer = VK_NULL_HANDLE;
+	Item.InstOffset = 0;
+	Item.InstanceCount = 0;
+	Item.PushSize = 0;
+	SubmitDrawItem(Cmd, &Item);
+
+	SpriteStreamUsed += QuadCount;
+	SpriteFrameDraws++;
+	SpriteFrameQuads += QuadCount;
+}
+
+void VkFlushSprites()
+{
+	if(!SpriteCount)
+	{
+		return;
+	}
+
+	if(UseRenderThread)
+	{
+		PushSpritePacket(SpriteCount, SpriteScratch, SpriteTexture, SpriteBlend);
 	}
 	else
 	{
-		//signal to free resources
-		if(Id->Tag == 2)
+		VkCmdDrawSprites(CommandBuffer, SpriteCount, SpriteStreamRegion() + SpriteStreamUsed * 4, SpriteTexture, SpriteBlend);
+	}
+	SpriteCount = 0;
+}
+
+//NOTE(Kyryl): Same space as the other draws, X Y is the bottom left corner.
+//UVRect is u0 v0 u1 v1 and Color rgb, NULL takes the whole texture and white.
+//Texture is a sampler descriptor set, NULL takes FragSamplerDescriptorSet.
+void VkDrawSprite(f32 X, f32 Y, f32 W, f32 H, f32 *UVRect, f32 *Color, VkDescriptorSet Texture, b32 Blend)
+{
+	static f32 FullRect[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+	static f32 White[3] = {1.0f, 1.0f, 1.0f};
+	if(!Texture)
+	{
+		Texture = FragSamplerDescriptorSet;
+	}
+	if(!UVRect)
+	{
+		UVRect = FullRect;
+	}
+	if(!Color)
+	{
+		Color = White;
+	}
+
+	if(SpriteCount && (SpriteTexture != Texture || SpriteBlend != Blend))
+	{
+		VkFlushSprites();
+	}
+
+	vertex_t *V;
+	if(UseRenderThread)
+	{
+		if(SpriteCount == NUM_SPRITE_QUADS)
 		{
-			ZFree(Id->Vbuf, 1);
-			ZFree(Id->Ibuf, 2);		
-			ZFree(Id->Ubuf, 3);
-			Id->Ubuf = NULL;
-			Id->Vbuf = NULL;
-			Id->Ibuf = NULL;
-			return;
+			VkFlushSprites();
+		}
+		V = SpriteScratch + SpriteCount * 4;
+	}
+	else
+	{
+		ASSERT(SpriteStreamUsed + SpriteCount < NUM_SPRITE_QUADS, "Sprite stream full, increase NUM_SPRITE_QUADS");
+		V = SpriteStreamRegion() + (SpriteStreamUsed + SpriteCount) * 4;
+	}
+	SpriteTexture = Texture;
+	SpriteBlend = Blend;
+	SpriteCount++;
+
+	f32 Xs[4] = {X, X + W, X + W, X};
+	f32 Ys[4] = {Y, Y, Y + H, Y + H};
+	f32 Us[4] = {UVRect[0], UVRect[2], UVRect[2], UVRect[0]};
+	f32 Vs[4] = {UVRect[1], UVRect[1], UVRect[3], UVRect[3]};
+	for(u32 i = 0; i < 4; i++)
+	{
+		V[i].Xyz[0] = Xs[i];
+		V[i].Xyz[1] = Ys[i];
+		V[i].Xyz[2] = 0.0f;
+		V[i].UVs[0] = Us[i];
+		V[i].UVs[1] = Vs[i];
+		V[i].Normals[0] = Color[0];
+		V[i].Normals[1] = Color[1];
+		V[i].Normals[2] = Color[2];
+		V[i].Normals[3] = 1.0f;
+	}
+}
+
+//False when not in render thread mode, the caller records directly.
+b32 PushSpritePacket(u32 QuadCount, vertex_t *Vertices, VkDescriptorSet Texture, b32 Blend)
+{
+	u32 Used = PacketStreams[PacketWriteIndex].Used;
+	if(!PushDrawPacket(PACKET_DRAW_SPRITES, QuadCount * 4, Vertices, 0, NULL, sizeof(u32), 0, NULL, Blend, NULL))
+	{
+		return false;
+	}
+	packet_header_t *Header = (packet_header_t*)(PacketStreams[PacketWriteIndex].Data + Used);
+	draw_packet_t *Packet = (draw_packet_t*)(Header + 1);
+	Packet->DescriptorSet = Texture;
+	return true;
+}
+
+b32 PushDrawPacket(u32 Type, u32 VertexCount, vertex_t *VertexBuffer, u32 IndexCount, void *IndexBuffer, u32 IndexSize, u32 InstanceCount, instance_t *InstanceBuffer, b32 Blend, vk_entity_t *Id)
+{
+	if(!UseRenderThread)
+	{
+		return false;
+	}
+
+	packet_stream_t *Stream = &PacketStreams[PacketWriteIndex];
+	u32 VSize = VertexBuffer ? sizeof(vertex_t) * VertexCount : 0;
+	u32 ISize = IndexBuffer ? (IndexSize * IndexCount + 3) & ~3 : 0; //instances stay 4 byte aligned
+	u32 InstSize = sizeof(instance_t) * InstanceCount;
+	u32 PushSize = Type == PACKET_DRAW_SPRITES ? 0 : PacketConstants.Size;
+	u32 Size = sizeof(packet_header_t) + sizeof(draw_packet_t) + VSize + ISize + InstSize + PushSize;
+	Size = (Size + 7) & ~7;
+	ASSERT(Stream->Used + Size <= RENDER_PACKET_BUFFER_SIZE, "Packet stream full, increase RENDER_PACKET_BUFFER_SIZE");
+
+	packet_header_t *Header = (packet_header_t*)(Stream->Data + Stream->Used);
+	Header->Type = Type;
+	Header->Size = Size;
+	draw_packet_t *Packet = (draw_packet_t*)(Header + 1);
+	Packet->Id = Id;
+	Packet->VertexCount = VertexCount;
+	Packet->IndexCount = IndexCount;
+	Packet->IndexSize = IndexSize;
+	Packet->InstanceCount = InstanceCount;
+	Packet->Blend = Blend;
+	Packet->DescriptorSet = VK_NULL_HANDLE;
+	Packet->HasVertices = VSize != 0;
+	Packet->HasIndices = ISize != 0;
+	Packet->DirtyFirst = 0;
+	Packet->DirtyCount = 0;
+	Packet->PushSize = PushSize;
+	if(Id)
+	{
+		//Render thread must not race the app on the entity's range.
+		Packet->DirtyFirst = Id->DirtyFirst;
+		Packet->DirtyCount = Id->DirtyCount;
+		Id->DirtyCount = 0;
+	}
+	u8 *Payload = (u8*)(Packet + 1);
+	memcpy(Payload, VertexBuffer, VSize);
+	if(ISize)
+	{
+		memcpy(Payload + VSize, IndexBuffer, ISize);
+	}
+	if(InstSize)
+	{
+		memcpy(Payload + VSize + ISize, InstanceBuffer, InstSize);
+	}
+	if(PushSize)
+	{
+		memcpy(Payload + VSize + ISize + InstSize, PacketConstants.Data, PushSize);
+		PacketConstants.Size = 0;
+	}
+	Stream->Used += Size;
+	return true;
+}
+
+void ReplayPackets(packet_stream_t *Stream)
+{
+	u32 Offset = 0;
+	while(Offset < Stream->Used)
+	{
+		packet_header_t *Header = (packet_header_t*)(Stream->Data + Offset);
+		draw_packet_t *Packet = (draw_packet_t*)(Header + 1);
+		vertex_t *Vertices = (vertex_t*)(Packet + 1);
+		u8 *Indices = (u8*)(Vertices + (Packet->HasVertices ? Packet->VertexCount : 0));
+		u32 ISize = Packet->HasIndices ? (Packet->IndexSize * Packet->IndexCount + 3) & ~3 : 0;
+		instance_t *Instances = (instance_t*)(Indices + ISize);
+		ReplayPacket = Packet;
+		ReplayPush = (u32*)(Instances + Packet->InstanceCount);
+		switch(Header->Type)
+		{
+			case PACKET_DRAW_BASIC:
+				CmdDrawBasic(CommandBuffer, Packet->VertexCount, Vertices, Packet->IndexCount, Indices, Packet->IndexSize, Packet->Id);
+				break;
+			case PACKET_DRAW_TEXTURED:
+				CmdDrawTextured(CommandBuffer, Packet->VertexCount, Vertices, Packet->IndexCount, Indices, Packet->IndexSize, Packet->Blend, Packet->Id);
+				break;
+			case PACKET_DRAW_LINE:
+				VkCmdDrawLine(CommandBuffer, Packet->VertexCount, Vertices, Packet->Id);
+				break;
+			case PACKET_DRAW_LIGHTNINGS:
+				VkCmdDrawLightnings(CommandBuffer, Packet->VertexCount, Vertices, Packet->IndexCount, (u32*)Indices, Packet->Id);
+				break;
+			case PACKET_DRAW_INSTANCED:
+			case PACKET_DRAW_INSTANCED_TEXTURED:
+				VkCmdDrawInstanced(CommandBuffer, Packet->VertexCount, Vertices, Packet->IndexCount, (u32*)Indices,
+						Packet->InstanceCount, Instances, Header->Type == PACKET_DRAW_INSTANCED_TEXTURED, Packet->Blend, Packet->Id);
+				break;
+			case PACKET_DRAW_SPRITES:
+				VkCmdDrawSprites(CommandBuffer, Packet->VertexCount / 4, Vertices, Packet->DescriptorSet, Packet->Blend);
+				break;
+			default:
+				ASSERT(0, "ReplayPackets: unknown packet %d", Header->Type);
+		}
+		Offset += Header->Size;
+	}
+	ReplayPacket = NULL;
+	ReplayPush = NULL;
+}
+
+//Spins a little, then naps, platform sleeps are too coarse to start with.
+void WaitPacketFlag(volatile s32 *Flag, s32 Value)
+{
+	u32 Spins = 0;
+	while(__atomic_load_n(Flag, __ATOMIC_ACQUIRE) != Value)
+	{
+		if(++Spins > 1000)
+		{
+			Tiny_Sleep(0.0001);
+		}
+	}
+}
+
+void RenderThread(void *Data)
+{
+	u32 ReadIndex = 0;
+	while(__atomic_load_n(&RenderThreadRunning, __ATOMIC_ACQUIRE))
+	{
+		if(!__atomic_load_n(&PacketReady[ReadIndex], __ATOMIC_ACQUIRE))
+		{
+			Tiny_Sleep(0.0001);
+			continue;
+		}
+
+		packet_stream_t *Stream = &PacketStreams[ReadIndex];
+		HandoffLatencyAvg = HandoffLatencyAvg * 0.95 + (Tiny_GetTime() - Stream->PublishTime) * 1000 * 0.05;
+
+		BeginFrame();
+		ReplayPackets(Stream);
+		EndFrame();
+
+		__atomic_store_n(&PacketReady[ReadIndex], 0, __ATOMIC_RELEASE);
+		ReadIndex ^= 1;
+	}
+	VkHostThreadExit();
+	__atomic_store_n(&RenderThreadAlive, 0, __ATOMIC_RELEASE);
+}
+
+//NOTE(Kyryl): Call between frames on the app thread. From then on only the
+//render thread touches the queue, create textures before or stop it first.
+void VkStartRenderThread()
+{
+	ASSERT(!UseRenderThread, "VkStartRenderThread: already running");
+	for(u32 i = 0; i < 2; i++)
+	{
+		if(!PacketStreams[i].Data)
+		{
+			PacketStreams[i].Data = (u8*) Tiny_Malloc(RENDER_PACKET_BUFFER_SIZE);
 		}
-		ASSERT(Id->Vbuf, "Invalid vertex pointer.");
-		ASSERT(Id->Ibuf, "Invalid index pointer.");
-		ASSERT(Id->Ubuf, "Invalid uniform pointer.");
-	}
-
-	ubo_lightning_t *ptr = (ubo_lightning_t*) Id->Ubuf;
-	ptr->Resolution[0] = SwchImageSize.width;
-	ptr->Resolution[1] = SwchImageSize.height;
-	ptr->Time = Tiny_GetTime();
-	u32 UOffset = Id->Ubuf - (u8*)UniformBuffers[0].Data;
-	VkDeviceSize VOffset = Id->Vbuf - (u8*) VertexBuffers[0].Data;
-	VkDeviceSize IOffset = Id->Ibuf - (u8*) IndexBuffers[0].Data;
-	memcpy(Id->Vbuf, &VertexBuffer[0], VSize);
-	memcpy(Id->Ibuf, &IndexBuffer[0], ISize);
-	vkCmdBindVertexBuffers(CommandBuffer, 0, 1, &VertexBuffers[0].Buffer, &VOffset);
-	vkCmdBindIndexBuffer(CommandBuffer, IndexBuffers[0].Buffer, IOffset, VK_INDEX_TYPE_UINT32);
-	vkCmdBindPipeline(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelines[4]);
-	vkCmdBindDescriptorSets(CommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, VkPipelineLayouts[2], 0, 1, &FragUniformDescriptorSet, 1, &UOffset);
-	vkCmdDrawIndexed(CommandBuffer, IndexCount, 1, 0, 0, 0);
+		PacketStreams[i].Used = 0;
+		PacketReady[i] = 0;
+	}
+	PacketWriteIndex = 0;
+	RenderThreadRunning = true;
+	RenderThreadAlive = true;
+	UseRenderThread = true;
+	ASSERT(Tiny_CreateThread(&RenderThread, NULL), "Failed to start the render thread");
+}
+
+//Replays what was published, then joins. Call before DeInitVulkan.
+void VkStopRenderThread()
+{
+	if(!UseRenderThread)
+	{
+		return;
+	}
+	WaitPacketFlag(&PacketReady[0], 0);
+	WaitPacketFlag(&PacketReady[1], 0);
+	__atomic_store_n(&RenderThreadRunning, 0, __ATOMIC_RELEASE);
+	WaitPacketFlag(&RenderThreadAlive, 0);
+	UseRenderThread = false;
+	Info("Render thread: handoff %.2f ms, app wait %.2f ms", HandoffLatencyAvg, AppWaitAvg);
+}
+
+void VkBeginRendering()
+{
+	if(!UseRenderThread)
+	{
+		BeginFrame();
+		return;
+	}
+
+	//Stream from two frames ago may still be replayed.
+	f64 WaitBegin = Tiny_GetTime();
+	WaitPacketFlag(&PacketReady[PacketWriteIndex], 0);
+	AppWaitAvg = AppWaitAvg * 0.95 + (Tiny_GetTime() - WaitBegin) * 1000 * 0.05;
+	PacketStreams[PacketWriteIndex].Used = 0;
+}
+
+void VkEndRendering()
+{
+	VkFlushSprites();
+	if(!UseRenderThread)
+	{
+		EndFrame();
+		return;
+	}
+
+	PacketStreams[PacketWriteIndex].PublishTime = Tiny_GetTime();
+	__atomic_store_n(&PacketReady[PacketWriteIndex], 1, __ATOMIC_RELEASE);
+	PacketWriteIndex ^= 1;
 }
 
 #endif
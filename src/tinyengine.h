@@ -37,10 +37,37 @@ typedef double f64;
 #define	Max(a, b)(((a) > (b)) ? (a) : (b))
 
 u8 *Tiny_ReadFile(const char *Filename, s32 *Size);
+b32 Tiny_WriteFile(const char *Filename, void *Data, u64 Size);
 void* Tiny_Malloc(u64 Size);
 void Tiny_Free(void *Ptr);
 u64 Tiny_GetTimerValue();
 f64 Tiny_GetTime();
+void Tiny_Sleep(f64 Seconds);
+void Tiny_Lock(volatile s32 *Lock);
+void Tiny_Unlock(volatile s32 *Lock);
+u32 Tiny_GetCoreCount();
+u64 Tiny_GetThreadId(); //never 0
+b32 Tiny_CreateThread(void (*Func)(void *Data), void *Data);
+
+// J O B S ///////////////////////////////////////////////////////////
+
+typedef struct tiny_counter_t
+{
+	volatile s32 Value;
+} tiny_counter_t;
+
+typedef struct tiny_job_t
+{
+	void (*Func)(void *Data, u32 ThreadIndex);
+	void *Data;
+	tiny_counter_t *Counter; //set by Tiny_RunJobs
+} tiny_job_t;
+
+void Tiny_InitJobs(u32 WorkerCount);
+void Tiny_DeInitJobs();
+u32 Tiny_GetJobThreadCount();
+void Tiny_RunJobs(u32 ThreadIndex, tiny_job_t *Jobs, u32 Count, tiny_counter_t *Counter);
+void Tiny_WaitForCounter(u32 ThreadIndex, tiny_counter_t *Counter);
 
 
 #endif // TINYENGINE_H
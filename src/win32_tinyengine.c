@@ -97,6 +97,7 @@ void Pause()
 #endif
 
 #include "tiny_vulkan.h"
+#include "tiny_jobs.h"
 
 static const char *level_names[] =
 {
@@ -220,6 +221,18 @@ u8 *Tiny_ReadFile(const char *Filename, s32 *Size)
 	return Buffer;
 }
 
+b32 Tiny_WriteFile(const char *Filename, void *Data, u64 Size)
+{
+	FILE* File = fopen(Filename, "wb");
+	if(!File)
+	{
+		return false;
+	}
+	u64 rc = fwrite(Data, 1, Size, File);
+	fclose(File);
+	return rc == Size;
+}
+
 void *Tiny_Malloc(u64 Size)
 {
 	Size += sizeof(u64);
@@ -244,7 +257,22 @@ u64 Tiny_GetTimerValue()
 u64 TimerOffset;
 f64 Tiny_GetTime()
 {
-	return (f64)(Tiny_GetTimerValue()-TimerOffset) / 1000000;
+	//Performance counter ticks are not microseconds.
+	u64 Frequency;
+	QueryPerformanceFrequency((LARGE_INTEGER*) &Frequency);
+	return (f64)(Tiny_GetTimerValue()-TimerOffset) / (f64)Frequency;
+}
+
+//NOTE(Kyryl): Sleep() granularity is the system timer tick, 15.6 ms by
+//default. WinMain raises it to 1 ms with timeBeginPeriod, callers that need
+//more should spin the remainder.
+void Tiny_Sleep(f64 Seconds)
+{
+	if(Seconds <= 0)
+	{
+		return;
+	}
+	Sleep((DWORD)(Seconds * 1000));
 }
 
 b32 Exit;
@@ -264,6 +292,60 @@ void SurfaceCallback(VkSurfaceKHR* Surface)
 	VK_CHECK(vkCreateWin32SurfaceKHR(Instance, &SurfaceCI, VkAllocators, Surface));
 }
 
+void Tiny_Lock(volatile s32 *Lock)
+{
+	while(InterlockedExchange((volatile LONG*)Lock, 1))
+	{
+		while(*Lock){/*spin on the cached line*/};
+	}
+}
+
+void Tiny_Unlock(volatile s32 *Lock)
+{
+	InterlockedExchange((volatile LONG*)Lock, 0);
+}
+
+u64 Tiny_GetThreadId()
+{
+	return GetCurrentThreadId();
+}
+
+u32 Tiny_GetCoreCount()
+{
+	SYSTEM_INFO SystemInfo;
+	GetSystemInfo(&SystemInfo);
+	return SystemInfo.dwNumberOfProcessors;
+}
+
+typedef struct thread_start_t
+{
+	void (*Func)(void *Data);
+	void *Data;
+} thread_start_t;
+
+DWORD WINAPI ThreadTrampoline(LPVOID Start)
+{
+	thread_start_t Copy = *(thread_start_t*)Start;
+	Tiny_Free(Start);
+	Copy.Func(Copy.Data);
+	return 0;
+}
+
+b32 Tiny_CreateThread(void (*Func)(void *Data), void *Data)
+{
+	thread_start_t *Start = (thread_start_t*) Tiny_Malloc(sizeof(thread_start_t));
+	Start->Func = Func;
+	Start->Data = Data;
+	HANDLE Thread = CreateThread(NULL, 0, &ThreadTrampoline, Start, 0, NULL);
+	if(!Thread)
+	{
+		Tiny_Free(Start);
+		return false;
+	}
+	CloseHandle(Thread);
+	return true;
+}
+
 static LRESULT CALLBACK
 Win32MainWindowCallback(HWND Window, UINT Message, WPARAM WParam, LPARAM LParam)
 {
@@ -272,6 +354,13 @@ Win32MainWindowCallback(HWND Window, UINT Message, WPARAM WParam, LPARAM LParam)
 		case WM_CLOSE:
 			Exit = true;
 			break;
+		case WM_SIZE:
+			//Swapchain does not exist before InitVulkan.
+			if(LogicalDevice)
+			{
+				VkRequestSwapchainRebuild();
+			}
+			break;
 	}
 	return DefWindowProcW(Window, Message, WParam, LParam);
 }
@@ -280,6 +369,7 @@ int WINAPI WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine
 {
 	FILE* File = fopen("./log.txt","w");
 	LogSetfp(File);
+	b32 TimerPeriod = timeBeginPeriod(1) == TIMERR_NOERROR;
 	
 	WNDCLASSW WindowClass = {0};
 	WindowClass.style = CS_OWNDC;
@@ -368,6 +458,10 @@ int WINAPI WinMain(HINSTANCE Instance, HINSTANCE PrevInstance, LPSTR CommandLine
 	{
 		Fatal("Failed to register window class.");
 	}
+	if(TimerPeriod)
+	{
+		timeEndPeriod(1);
+	}
 	p("Exit");
 	return 0;
 }